@@ -60,10 +60,49 @@ debug() {
   echo "Debug: ${msg}"
 }
 
+# Set to true if values in conf file are loaded into _INSTALLER_CONF.
+_INSTALLER_CONF_LOADED=
+
+# Load all values in conf file into associative array _INSTALLER_CONF, with
+# only one deepin-installer-settings process.
+# installer_get() is always called in command substitution, so this function
+# is called by hook_manager.sh and hook_runner.sh before running each job,
+# and values are inherited by those subshells.
+# Returns non-zero on failure, then installer_get() reads conf file directly.
+_installer_load_conf() {
+  [ -z "${CONF_FILE}" ] && return 1
+  which deepin-installer-settings 1>/dev/null 2>&1 || return 1
+  local content
+  content=$(deepin-installer-settings export "${CONF_FILE}") || return 1
+  unset _INSTALLER_CONF
+  eval "${content}"
+  _INSTALLER_CONF_LOADED=true
+}
+
+# Update value of |key| in cache after it is written to conf file.
+# Values with comma are saved as list and converted by deepin-installer-settings
+# when read, so they are read from conf file again.
+_installer_cache_value() {
+  [ -z "${_INSTALLER_CONF_LOADED}" ] && return 0
+  case "$2" in
+    *,*)
+      _INSTALLER_CONF_LOADED=
+      ;;
+    *)
+      _INSTALLER_CONF["$1"]="$2"
+      ;;
+  esac
+}
+
 # Get value in conf file. Section name is ignored.
+# Values are read from cache if conf file is loaded.
 # NOTE(xushaohua): Global variant or environment $CONF_FILE must not be empty.
 installer_get() {
   local key="$1"
+  if [ -n "${_INSTALLER_CONF_LOADED}" ]; then
+    printf '%s' "${_INSTALLER_CONF[${key}]}"
+    return 0
+  fi
   [ -z "${CONF_FILE}" ] && exit "CONF_FILE is not defined"
   which deepin-installer-settings 1>/dev/null || \
     exit "deepin-installer-settings not found!"
@@ -77,7 +116,28 @@ installer_set() {
   [ -z "${CONF_FILE}" ] && exit "CONF_FILE is not defined"
   which deepin-installer-settings 1>/dev/null || \
     exit "deepin-installer-settings not found!"
-  deepin-installer-settings set "${CONF_FILE}" "${key}" "${value}"
+  deepin-installer-settings set "${CONF_FILE}" "${key}" "${value}" || return
+  _installer_cache_value "${key}" "${value}"
+}
+
+# Set many values in conf file with only one process.
+# Usage: installer_set_batch key1 value1 [key2 value2...]
+installer_set_batch() {
+  [ -z "${CONF_FILE}" ] && exit "CONF_FILE is not defined"
+  which deepin-installer-settings 1>/dev/null || \
+    exit "deepin-installer-settings not found!"
+  deepin-installer-settings set-batch "${CONF_FILE}" "$@" || return
+  while [ $# -ge 2 ]; do
+    _installer_cache_value "$1" "$2"
+    shift 2
+  done
+}
+
+# Report progress of current hook, 0-100, which is shown in progress bar of
+# in_chroot and after_chroot stages.
+installer_progress() {
+  which deepin-installer-progress 1>/dev/null 2>&1 || return 0
+  deepin-installer-progress "$1" || true
 }
 
 # Check whether current platform is loongson or not.
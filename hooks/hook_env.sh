@@ -0,0 +1,43 @@
+#!/bin/bash
+#
+# Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Shared environment of hook scripts, loaded by hook_manager.sh and
+# hook_runner.sh. $HOOKS_DIR shall be defined before loading this file.
+
+. "${HOOKS_DIR}/basic_utils.sh"
+
+# Defines absolute path to oem folder.
+# /tmp/oem is reserved for debug.
+if [ -d /tmp/oem ]; then
+  # Debug mode
+  OEM_DIR=/tmp/oem
+elif [ -d /media/cdrom/oem ]; then
+  # chroot mode
+  OEM_DIR=/media/cdrom/oem
+elif [ -d /lib/live/mount/medium/oem ]; then
+  # chroot mode
+  OEM_DIR=/lib/live/mount/medium/oem
+elif [ -d /media/apt/oem ]; then
+  # chroot mode
+  # FIXME: maybe apt will change mount point
+  # /media/cdrom => /media/apt
+  # hook script invalid
+  OEM_DIR=/media/apt/oem
+fi
+
+# Mark $OEM_DIR as readonly constant.
+readonly OEM_DIR
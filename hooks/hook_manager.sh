@@ -23,7 +23,7 @@
 # Folder path of hooks.
 HOOKS_DIR=/tmp/installer
 
-. "${HOOKS_DIR}/basic_utils.sh"
+. "${HOOKS_DIR}/hook_env.sh"
 
 # Check arguments
 if [ $# -lt 1 ]; then
@@ -36,28 +36,6 @@ _SELF="${HOOKS_DIR}/hook_manager.sh"
 _HOOK_FILE=$1
 _IN_CHROOT=$2
 
-# Defines absolute path to oem folder.
-# /tmp/oem is reserved for debug.
-if [ -d /tmp/oem ]; then
-  # Debug mode
-  OEM_DIR=/tmp/oem
-elif [ -d /media/cdrom/oem ]; then
-  # chroot mode
-  OEM_DIR=/media/cdrom/oem
-elif [ -d /lib/live/mount/medium/oem ]; then
-  # chroot mode
-  OEM_DIR=/lib/live/mount/medium/oem
-elif [ -d /media/apt/oem ]; then
-  # chroot mode
-  # FIXME: maybe apt will change mount point
-  # /media/cdrom => /media/apt
-  # hook script invalid
-  OEM_DIR=/media/apt/oem
-fi
-
-# Mark $OEM_DIR as readonly constant.
-readonly OEM_DIR
-
 # Run hook file
 case ${_HOOK_FILE} in
   */in_chroot/*)
@@ -68,6 +46,7 @@ case ${_HOOK_FILE} in
       if [ ! -f "${CONF_FILE}" ]; then
         error "Config file ${CONF_FILE} does not exists."
       fi
+      _installer_load_conf
       . "${_HOOK_FILE}"
       exit $?
     else
@@ -81,6 +60,7 @@ case ${_HOOK_FILE} in
     if [ ! -f "${CONF_FILE}" ]; then
       error "Config file ${CONF_FILE} does not exists."
     fi
+    _installer_load_conf
     . "${_HOOK_FILE}"
     exit $?
     ;;
@@ -0,0 +1,138 @@
+#!/bin/bash
+#
+# Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Long-lived runner of hook jobs. Unlike hook_manager.sh, which is started
+# for each job, shared environment of hooks is loaded only once, then
+# requests are read from stdin, one per line:
+#   run <id> <hook-id> <hook-file>
+#   quit
+# Each job runs in its own subshell, so that variables, working directory
+# and exit of one job do not affect others or the runner. <hook-id> is
+# exported to job as DI_HOOK_ID, so that progress reported by job and its
+# children is attributed to it, see src/base/progress_bus.h. Output of jobs is
+# framed on stdout of runner, one message per line:
+#   start <id> <pid of job>
+#   out <id> <a line in stdout of job>
+#   err <id> <a line in stderr of job>
+#   stats <id> <cpu ticks> <bytes read> <bytes written>
+#   exit <id> <exit code of job>
+# After sending "start", job waits for a "go <id>" request before it runs,
+# so that installer can move it into a cgroup first. "stats" are resources
+# used by job and its children, read from /proc/<runner-pid>/stat and
+# /proc/<runner-pid>/io before and after the job.
+#
+# Usage: hook_runner.sh [in-chroot]
+# If |in-chroot| is "true", runner is already in chroot env of /target, and
+# only in_chroot jobs are accepted. This file is used by
+# service/backend/hook_runner.cpp.
+
+# Folder path of hooks.
+HOOKS_DIR=/tmp/installer
+
+. "${HOOKS_DIR}/hook_env.sh"
+
+_IN_CHROOT=$1
+
+if [ "x${_IN_CHROOT}" = "xtrue" ]; then
+  # Host device is mounted at /target/deepinhost
+  CONF_FILE="/deepinhost${CONF_FILE}"
+fi
+
+# Print each line read from stdin with message type |$1| and job id |$2|.
+_frame() {
+  local line
+  while IFS= read -r line || [ -n "${line}" ]; do
+    echo "$1 $2 ${line}"
+  done
+}
+
+# Save cpu ticks used by all finished children of runner, and bytes they
+# read from and written to block devices, into array _USAGE.
+# Only builtin commands are used, so that no process is forked.
+_read_children_usage() {
+  local stat key value
+  read -r -a stat < "/proc/$$/stat"
+  # cutime and cstime.
+  _USAGE=($(( stat[15] + stat[16] )) 0 0)
+  [ -r "/proc/$$/io" ] || return 0
+  while read -r key value; do
+    case "${key}" in
+      read_bytes:) _USAGE[1]=${value} ;;
+      write_bytes:) _USAGE[2]=${value} ;;
+    esac
+  done < "/proc/$$/io"
+}
+
+# Run job |$3| with id |$1| and hook id |$2| in a subshell.
+_run_job() {
+  local id="$1"
+  local hook_id="$2"
+  local hook="$3"
+  _read_children_usage
+  local usage_begin=("${_USAGE[@]}")
+
+  # Stdout of job is sent to fd 3, and stderr is sent to the pipe.
+  # pipefail returns exit code of job instead of _frame(), it is disabled
+  # again in subshell of job.
+  set -o pipefail
+  {
+    (
+      set +o pipefail
+      # Wait for installer to handle start message, request is read from
+      # stdin of runner.
+      echo "start ${id} ${BASHPID}" >&4
+      read -r _ <&5
+      exec 5<&-
+      export DI_HOOK_ID="${hook_id}"
+      if [ ! -f "${CONF_FILE}" ]; then
+        error "Config file ${CONF_FILE} does not exists."
+      fi
+      _installer_load_conf
+      . "${hook}"
+    ) 5<&0 </dev/null 2>&1 1>&3 3>&- | _frame err "${id}" >&4
+  } 3>&1 | _frame out "${id}"
+  local code=$?
+  set +o pipefail
+
+  _read_children_usage
+  printf 'stats %s %s %s %s\n' "${id}" \
+    "$(( _USAGE[0] - usage_begin[0] ))" \
+    "$(( _USAGE[1] - usage_begin[1] ))" \
+    "$(( _USAGE[2] - usage_begin[2] ))"
+  printf 'exit %s %s\n' "${id}" "${code}"
+}
+
+cd "${HOOKS_DIR}" || error "Failed to enter ${HOOKS_DIR}"
+
+# Keep stdout of runner at fd 4, used by _frame() of stderr of jobs.
+exec 4>&1
+
+while IFS=' ' read -r _REQUEST _ID _HOOK_ID _HOOK_FILE; do
+  case ${_REQUEST} in
+    run)
+      _run_job "${_ID}" "${_HOOK_ID}" "${_HOOK_FILE}"
+      ;;
+    quit)
+      break
+      ;;
+    *)
+      warn "Unknown request: ${_REQUEST}"
+      ;;
+  esac
+done
+
+exit 0
@@ -67,6 +67,7 @@ int main(int argc, char* argv[]) {
     log_file = QString("/var/log/%1").arg(kLogFileName);
   }
   installer::RedirectLog(log_file);
+  installer::StartLogTrace(log_file);
 
   // Delete old settings file and generate a new one.
   installer::DeleteConfigFile();
@@ -58,6 +58,7 @@ int main(int argc, char *argv[])
   }
   // Initialize log service.
   installer::RedirectLog(log_file);
+  installer::StartLogTrace(log_file);
 
   // Set language.
   QTranslator translator;
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Report progress of current hook script to installer, through ProgressBus
+// inherited from installer.
+// Usage:
+// * deepin-installer-progress percent
+// It does nothing if not run by installer.
+
+#include <stdio.h>
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include "base/progress_bus.h"
+
+namespace {
+
+const char kAppVersion[] = "0.0.1";
+const char kAppDesc[] = "Report progress of hook script to installer.";
+
+const int kExitErr = 1;
+const int kExitOk = 0;
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  QCoreApplication app(argc, argv);
+  app.setApplicationVersion(kAppVersion);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(kAppDesc);
+  parser.addHelpOption();
+  parser.addVersionOption();
+  parser.addPositionalArgument("percent", "Progress of hook, 0-100");
+
+  if (!parser.parse(app.arguments())) {
+    parser.showHelp(kExitErr);
+  }
+
+  const QStringList pos_args = parser.positionalArguments();
+  if (pos_args.length() != 1) {
+    parser.showHelp(kExitErr);
+  }
+
+  bool ok;
+  const int percent = pos_args.at(0).toInt(&ok);
+  if (!ok || percent < 0 || percent > 100) {
+    fprintf(stderr, "Invalid percent: %s\n",
+            pos_args.at(0).toLocal8Bit().constData());
+    return kExitErr;
+  }
+
+  installer::ProgressBus bus;
+  if (bus.openFromEnv()) {
+    bus.publish(installer::ProgressPhase::Hook, percent);
+  }
+  return kExitOk;
+}
@@ -20,8 +20,15 @@
 // Usage:
 // * set ini-file section-name key value
 // * set ini-file key value
+// * set-batch ini-file key value [key value...]
 // * get ini-file section-name key
 // * get ini-file key
+// * export ini-file
+//
+// `export` prints all keys in ini-file as bash assignments of associative
+// array _INSTALLER_CONF, so that hook scripts read all values with only one
+// process, see installer_get() in hooks/basic_utils.sh. Keys in sections
+// other than "General" are named "section/key".
 
 #include <stdio.h>
 
@@ -39,15 +46,39 @@ const char kAppDesc[] = "Get/set configuration in a ini file.";
 const int kExitErr = 1;
 const int kExitOk = 0;
 
+const char kCommandExport[] = "export";
 const char kCommandGet[] = "get";
 const char kCommandSet[] = "set";
+const char kCommandSetBatch[] = "set-batch";
+
+// Name of bash associative array in exported content.
+const char kExportArrayName[] = "_INSTALLER_CONF";
 
 enum class CommandType {
+  Export,
   Get,
   Set,
+  SetBatch,
   Invalid,
 };
 
+// Quote |value| in single quotes, which is safe to be evaluated in bash.
+QString QuoteShellValue(const QString& value) {
+  QString quoted(value);
+  quoted.replace("'", "'\\''");
+  return "'" + quoted + "'";
+}
+
+// Set |value| of |key|, values with comma are saved as list.
+void SetValue(QSettings& settings, const QString& key, const QString& value) {
+  if (value.contains(',')) {
+    const QStringList list = value.split(',');
+    settings.setValue(key, list);
+  } else {
+    settings.setValue(key, value);
+  }
+}
+
 }  // namespace
 
 int main(int argc, char* argv[]) {
@@ -58,7 +89,9 @@ int main(int argc, char* argv[]) {
   parser.setApplicationDescription(kAppDesc);
   parser.addHelpOption();
   parser.addVersionOption();
-  parser.addPositionalArgument("command", "Set or get value", "get/set");
+  parser.addPositionalArgument("command",
+                               "Set or get value, or export all values",
+                               "get/set/set-batch/export");
   parser.addPositionalArgument("ini-file", "Absolute path to ini file");
   parser.addPositionalArgument("section",
                                "Section name in ini file",
@@ -73,7 +106,7 @@ int main(int argc, char* argv[]) {
 
   const QStringList pos_args = parser.positionalArguments();
 
-  if (pos_args.length() < 3 || pos_args.length() > 5) {
+  if (pos_args.length() < 2) {
     parser.showHelp(kExitErr);
   }
 
@@ -82,12 +115,30 @@ int main(int argc, char* argv[]) {
     command = CommandType::Get;
   } else if (pos_args.at(0) == kCommandSet) {
     command = CommandType::Set;
+  } else if (pos_args.at(0) == kCommandSetBatch) {
+    command = CommandType::SetBatch;
+  } else if (pos_args.at(0) == kCommandExport) {
+    command = CommandType::Export;
   } else {
     parser.showHelp(kExitErr);
   }
 
+  if (command == CommandType::Export) {
+    if (pos_args.length() != 2) {
+      parser.showHelp(kExitErr);
+    }
+  } else if (command == CommandType::SetBatch) {
+    // Key-value pairs.
+    if (pos_args.length() < 4 || pos_args.length() % 2 != 0) {
+      parser.showHelp(kExitErr);
+    }
+  } else if (pos_args.length() < 3 || pos_args.length() > 5) {
+    parser.showHelp(kExitErr);
+  }
+
   const QString ini_file = pos_args.at(1);
-  if ((command == CommandType::Get) && (!QFile::exists(ini_file))) {
+  if ((command == CommandType::Get || command == CommandType::Export) &&
+      (!QFile::exists(ini_file))) {
     fprintf(stderr, "File not found! %s\n", ini_file.toStdString().c_str());
     return kExitErr;
   }
@@ -119,7 +170,18 @@ int main(int argc, char* argv[]) {
   }
 
   QSettings settings(ini_file, QSettings::IniFormat);
-  if (command == CommandType::Get) {
+  if (command == CommandType::Export) {
+    // Values are converted in the same way as `get`.
+    QString content = QString("declare -gA %1=()\n").arg(kExportArrayName);
+    for (const QString& name : settings.allKeys()) {
+      const QString item = settings.value(name).toString();
+      content += QString("%1[%2]=%3\n").arg(kExportArrayName,
+                                           QuoteShellValue(name),
+                                           QuoteShellValue(item));
+    }
+    fprintf(stdout, "%s", content.toStdString().c_str());
+
+  } else if (command == CommandType::Get) {
     if (section.isEmpty()) {
       value = settings.value(key).toString();
     } else {
@@ -134,11 +196,12 @@ int main(int argc, char* argv[]) {
     if (!section.isEmpty()) {
       settings.beginGroup(section);
     }
-    if (value.contains(',')) {
-      const QStringList list = value.split(',');
-      settings.setValue(key, list);
-    } else {
-      settings.setValue(key, value);
+    SetValue(settings, key, value);
+
+  } else if (command == CommandType::SetBatch) {
+    // All values are written to ini file only once.
+    for (int i = 2; i + 1 < pos_args.length(); i += 2) {
+      SetValue(settings, pos_args.at(i), pos_args.at(i + 1));
     }
   }
 
@@ -16,24 +16,78 @@
  */
 
 // Extract squash filesystem. Works with low memory machine.
-//  * First mount squashfs to system
-//  * Then copy each file in that folder to target, including file permissions.
-// If extraction progress is required, use --progress option.
+//  * Squashfs image is read directly by builtin reader, including inode
+//    table, directory table and data blocks, then files are written to
+//    target, including file permissions.
+//  * If compression algorithm of image is not supported by builtin reader,
+//    or --mount option is set, first mount squashfs to system, then copy
+//    each file in that folder to target.
+// If extraction progress is required, use --progress option. Progress is
+// weighted by file size, and throughput and remaining time are printed to
+// stderr. Total size is read from size file generated by live-build, like
+// filesystem.size, or from inode table of image, so that file tree is walked
+// through only once. When run by installer, progress is also published on
+// ProgressBus inherited from it.
+// On multi-core machines, use --jobs option to copy files in parallel.
+// If target folders are on different disks, like / and /home, each disk is
+// written by its own worker threads at the same time.
+// Use --verify option to check extracted files against manifest of image,
+// like filesystem.manifest of filesystem.squashfs. Files are hashed in
+// background threads while later files are still being extracted. Manifest is
+// generated with --gen-manifest option when building ISO.
+// On optical discs and slow USB sticks, use --media-order option to extract
+// files in order of their data blocks in image, with readahead window sized
+// to the source device.
+// Holes in sparse files are kept, use --sparse option to skip blocks full of
+// zero too.
+// If available memory is low, or --low-memory option is set, dirty pages are
+// limited and written pages are dropped from page cache.
+// Regular files with hard links are copied only once, other paths of them are
+// created with link().
+// More images can be stacked over the first one with --layer option, like
+// locale overlay modules over base filesystem. Files in upper layers replace
+// files in lower layers, and overlayfs/aufs whiteouts are resolved before
+// extraction, so that each file is written only once. Progress of all layers
+// is reported as a single stream.
+// Completely extracted files are recorded in a journal in target folder, which
+// is removed after all files are extracted. If extraction failed, run again
+// with --resume option to skip files recorded in journal and not changed in
+// target folder.
+// When reinstalling over an existing system, use --update option to keep files
+// in target folder which are identical to image, like rsync. Regular files
+// are compared by size and modification time, or by content with --checksum
+// option. Only metadata different from image is updated.
 // Known issues:
-//  * Selected squashfs file can be mounted to one mount-point each time.
-//    Or else `mount` command raise device-busy error.
+//  * In mount mode, selected squashfs file can be mounted to one mount-point
+//    each time. Or else `mount` command raise device-busy error.
+//  * In mount mode, layers are copied one by one, and whiteouts are copied
+//    as normal files.
+//  * In mount mode, modification time is not copied, so --update always
+//    compares content of regular files.
 
 #define _XOPEN_SOURCE 500  // Required by nftw().
 #include <fcntl.h>
 #include <ftw.h>
 #include <limits.h>
 #include <stdlib.h>
+#include <sys/resource.h>
 #include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <sys/types.h>
 #include <sys/utsname.h>
 #include <sys/xattr.h>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <thread>
+#include <vector>
 
 #include <QCoreApplication>
 #include <QCommandLineOption>
@@ -42,11 +96,23 @@
 #include <QDebug>
 #include <QDir>
 #include <QFile>
-#include <QtMath>
+#include <QFileInfo>
 
 #include "base/command.h"
 #include "base/consts.h"
 #include "base/file_util.h"
+#include "base/progress_bus.h"
+#include "base/trace.h"
+#include "sysinfo/proc_meminfo.h"
+#include "unsquashfs/device_queues.h"
+#include "unsquashfs/extract_journal.h"
+#include "unsquashfs/extract_progress.h"
+#include "unsquashfs/manifest.h"
+#include "unsquashfs/manifest_verifier.h"
+#include "unsquashfs/squashfs_extractor.h"
+#include "unsquashfs/squashfs_reader.h"
+#include "unsquashfs/work_stealing_pool.h"
+#include "unsquashfs/writeback_throttle.h"
 
 #define S_IMODE 07777
 
@@ -63,9 +129,15 @@ const char kAppVersion[] = "0.0.1";
 // Default folder name of target.
 const char kDefaultDest[] = "squashfs-root";
 
+// Journal of extracted files, in target folder.
+const char kJournalFile[] = ".deepin-installer-unsquashfs.journal";
+
 // Absolute folder path to mount filesystem to.
 const char kMountPointTmp[] = "/dev/shm/installer-unsquashfs-%1";
 
+// Category of events in trace of installer.
+const char kTraceCategory[] = "unsquashfs";
+
 const int kExitOk = 0;
 const int kExitErr = 1;
 
@@ -73,23 +145,140 @@ const int kExitErr = 1;
 // See /proc/self/limits for more information.
 const int kMaxOpenFd = 512;
 
-// File descriptor of progress file.
-FILE* g_progress_fd = nullptr;
+// Size of block checked when skipping zero blocks.
+const size_t kZeroBlockSize = 4096;
+
+// Size of pieces of files written in low memory mode, 8M.
+const off_t kWritebackChunkSize = 8 * 1024 * 1024;
+
+// Size of buffers to compare regular files in update mode.
+const size_t kCompareBufSize = 1024 * 1024;
 
-// Global references to src_dir and dest_dir.
-QString g_src_dir;
-QString g_dest_dir;
+// Low memory mode is enabled by default if available memory is less than 2G.
+const qint64 kLowMemoryThreshold = 2LL * 1024 * 1024 * 1024;
 
-// Total number of files in squashfs filesystem.
+// In low memory mode, dirty pages are limited to 1/8 of available memory,
+// and in range [16M, 256M].
+const qint64 kDirtyBudgetRatio = 8;
+const qint64 kMinDirtyBudget = 16 * 1024 * 1024;
+const qint64 kMaxDirtyBudget = 256 * 1024 * 1024;
+
+// In media order mode, readahead window is 32 times of read_ahead_kb of
+// source device, and in range [2M, 32M].
+const quint64 kReadaheadRatio = 32;
+const quint64 kMinReadaheadWindow = 2 * 1024 * 1024;
+const quint64 kMaxReadaheadWindow = 32 * 1024 * 1024;
+
+// Maximum number of pending copy tasks per worker thread.
+const int kMaxPendingTasksPerJob = 256;
+
+// Print throughput and remaining time every 5 seconds.
+const int kStatsInterval = 5;
+
+// File descriptor of progress file.
+FILE* g_progress_fd = nullptr;
+// Protects |g_progress_fd| which is written in worker threads.
+std::mutex g_progress_mutex;
+// Last progress value written.
+int g_last_progress = -1;
+// Progress channel to installer, opened if run in hooks.
+installer::ProgressBus g_progress_bus;
+
+// Absolute path to target folder.
+std::string g_dest_path;
+// Length of path to source folder, used to get relative path of items.
+size_t g_src_path_len = 0;
+
+// Target folder opened in tree walking thread. It is shared with pending
+// copy tasks of files in it, and is closed when no longer used.
+struct DestDir {
+  explicit DestDir(int dir_fd) : fd(dir_fd), dev(0) {
+    struct stat st;
+    if (fstat(dir_fd, &st) == 0) {
+      dev = st.st_dev;
+    }
+  }
+  ~DestDir() { close(fd); }
+  const int fd;
+  // Device of this folder, selects writer queue of files in it.
+  dev_t dev;
+};
+typedef std::shared_ptr<DestDir> DestDirPtr;
+
+// Opened target folders in path of current item, indexed by level of item
+// in nftw().
+std::vector<DestDirPtr> g_dest_dirs;
+
+// Total number of files in squashfs filesystem, only counted if that number
+// cannot be read from superblock.
 int g_total_files = 0;
-// Number of files has been copied.
-int g_current_files = 0;
+// Total size of regular files in squashfs filesystem.
+quint64 g_total_bytes = 0;
+// Progress weighted by bytes of copied files.
+installer::ExtractProgress g_progress;
+// Time when throughput and remaining time were printed last time.
+std::chrono::steady_clock::time_point g_stats_time;
 
 // Use sendfile() system call or not.
 bool g_use_sendfile = true;
 
-// Write progress value to file.
+// Fastest method to copy file content in mount mode known to work between
+// source and target filesystems. It falls back to slower ones once a
+// method is not supported.
+std::atomic<installer::CopyMethod> g_copy_method(
+    installer::CopyMethod::Clone);
+// Number of regular files copied with each method.
+std::atomic<quint64> g_copy_method_files[
+    int(installer::CopyMethod::ReadWrite) + 1];
+
+// Do not write blocks full of zero, leaving holes in target files.
+bool g_skip_zero_blocks = false;
+
+// Extract files in order of data blocks in image.
+bool g_media_order = false;
+
+// Verify extracted files against manifests of images.
+bool g_verify = false;
+
+// Keep files in target folder identical to image.
+bool g_update = false;
+// Compare content of regular files in update mode.
+bool g_update_checksum = false;
+// Number of regular files kept in update mode.
+std::atomic<quint64> g_unchanged_files(0);
+
+// Relative paths of items found by CollectItem().
+std::vector<std::string> g_manifest_paths;
+
+// Limits dirty pages in low memory mode if not null.
+installer::WritebackThrottle* g_throttle = nullptr;
+
+// Skip files recorded in journal by previous run.
+bool g_resume = false;
+// Records copied files if not null.
+installer::ExtractJournal* g_journal = nullptr;
+// Index of layer being copied in mount mode.
+int g_layer = 0;
+
+// Copy regular files in worker threads of their target disks if not null.
+installer::DeviceQueues* g_queues = nullptr;
+// Set to true if any worker thread failed to copy a file.
+std::atomic<bool> g_copy_failed(false);
+
+// Maps (st_dev, st_ino) of regular files with more than one link to the
+// first dest path copied. Other paths are created as hard links to it.
+// Only accessed in tree walking thread.
+std::map<std::pair<dev_t, ino_t>, std::string> g_hard_links;
+
+// Write progress value to file. Progress file only contains an integer,
+// which is read by HooksManager.
 void WriteProgress(int progress) {
+  progress = qMin(progress, 100);
+  std::lock_guard<std::mutex> lock(g_progress_mutex);
+  if (progress == g_last_progress) {
+    return;
+  }
+  g_last_progress = progress;
   if (g_progress_fd) {
     fseek(g_progress_fd, 0, SEEK_SET);
     fprintf(g_progress_fd, "%d", progress);
@@ -98,92 +287,370 @@ void WriteProgress(int progress) {
   }
 }
 
-// Copy regular file with sendfile() system call, from |src_file| to
-// |dest_file|. Size of |src_file| is |file_size|.
-bool SendFile(const char* src_file, const char* dest_file, ssize_t file_size) {
-  int src_fd, dest_fd;
-  src_fd = open(src_file, O_RDONLY);
-  if (src_fd == -1) {
-    fprintf(stderr, "SendFile() Failed to open src file: %s\n", src_file);
-    perror("Open src file failed!");
+// Print progress status to stderr, like:
+//   progress: 42%, 812/1934 MiB, 37.5 MiB/s, eta 30s
+void PrintStats(const installer::ProgressStatus& status) {
+  const double kMiB = 1024.0 * 1024.0;
+  if (status.eta_seconds < 0) {
+    fprintf(stderr, "progress: %d%%, %.0f/%.0f MiB, %.1f MiB/s\n",
+            status.percent, status.done_bytes / kMiB,
+            status.total_bytes / kMiB, status.bytes_per_second / kMiB);
+  } else {
+    fprintf(stderr, "progress: %d%%, %.0f/%.0f MiB, %.1f MiB/s, eta %ds\n",
+            status.percent, status.done_bytes / kMiB,
+            status.total_bytes / kMiB, status.bytes_per_second / kMiB,
+            status.eta_seconds);
+  }
+}
+
+// Handles progress update of |g_progress|.
+void OnProgressChanged(const installer::ProgressStatus& status) {
+  WriteProgress(status.percent);
+  g_progress_bus.publish(installer::ProgressPhase::Unsquashfs, status.percent,
+                         status.done_bytes, status.total_bytes);
+  const std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+  if (now - g_stats_time >= std::chrono::seconds(kStatsInterval)) {
+    g_stats_time = now;
+    PrintStats(status);
+  }
+}
+
+// Read size of files in |src| from its size file, like "filesystem.size" of
+// "filesystem.squashfs", which is generated by live-build.
+bool ReadSizeFile(const QString& src, quint64& bytes) {
+  const QFileInfo info(src);
+  const QString size_file = info.dir().absoluteFilePath(
+      info.completeBaseName() + ".size");
+  if (!QFile::exists(size_file)) {
     return false;
   }
+  bool ok;
+  bytes = installer::ReadFile(size_file).trimmed().toULongLong(&ok);
+  if (!ok || bytes == 0) {
+    fprintf(stderr, "Invalid size file: %s\n",
+            size_file.toLocal8Bit().constData());
+    return false;
+  }
+  return true;
+}
 
-  // TODO(xushaohua): handles umask
-  dest_fd = open(dest_file, O_CREAT | O_RDWR, S_IREAD | S_IWRITE);
-  if (dest_fd == -1) {
-    fprintf(stderr, "SendFile() Failed to open dest file: %s\n", dest_file);
-    perror("Open dest file failed!");
+// Get number of inodes and total size of regular files in image |src|,
+// without walking through its file tree.
+// If |reader| is not null, it shall be opened with |src| and its inode table
+// is scanned when no size file is found.
+// |bytes| is set to 0 if it is unknown.
+bool CountImage(const QString& src, installer::SquashfsReader* reader,
+                quint64& inodes, quint64& bytes) {
+  uint32_t inode_count;
+  if (!installer::SquashfsReader::ReadInodeCount(src.toStdString(),
+                                                 inode_count)) {
     return false;
   }
+  inodes = inode_count;
+  if (ReadSizeFile(src, bytes)) {
+    return true;
+  }
 
-  bool ok = true;
-  if (g_use_sendfile) {
-    size_t num_to_read = size_t(file_size);
-    while (num_to_read > 0) {
-      const ssize_t num_sent = sendfile(dest_fd, src_fd, nullptr, num_to_read);
-      if (num_sent <= 0) {
-        fprintf(stderr, "sendfile() error: %s\nSkip %s\n",
-                strerror(errno), src_file);
-        // NOTE(xushaohua): Skip sendfile() error.
-        // xz uncompress error, Input/output error.
-        // squashfs file might have some defects.
-//      ok = false;
-        ok = true;
-        break;
-      }
-      num_to_read -= num_sent;
+  bytes = 0;
+  installer::SquashfsReader local_reader;
+  if (reader == nullptr) {
+    // Inode table cannot be read if compression algorithm is not supported.
+    if (!local_reader.open(src.toStdString())) {
+      return true;
     }
-  } else {
-    const size_t kBufSize = 32 * 1024;  // 32k
-    char buf[kBufSize];
-    ssize_t num_read;
-    while ((num_read = read(src_fd, buf, kBufSize)) > 0) {
-      // TODO(xushaohua): write() may write less buf.
-      if (write(dest_fd, buf, (size_t)num_read) != num_read) {
-        ok = false;
+    reader = &local_reader;
+  }
+  uint64_t scanned_inodes, scanned_bytes;
+  if (reader->scanInodes(scanned_inodes, scanned_bytes)) {
+    bytes = scanned_bytes;
+  }
+  return true;
+}
+
+// Start reporting progress of |total_bytes| in |total_files| files.
+void StartProgress(quint64 total_bytes, quint64 total_files) {
+  g_stats_time = std::chrono::steady_clock::now();
+  g_progress.setCallback(OnProgressChanged);
+  if (total_files > 0) {
+    g_progress.setTotal(total_bytes, total_files);
+  }
+}
+
+// Print overall throughput.
+void FinishProgress(qint64 elapsed_ms) {
+  const installer::ProgressStatus status = g_progress.status();
+  const double seconds = qMax(elapsed_ms, qint64(1)) / 1000.0;
+  fprintf(stderr, "extracted %.0f MiB in %.1fs, %.1f MiB/s\n",
+          status.done_bytes / 1024.0 / 1024.0, seconds,
+          status.done_bytes / 1024.0 / 1024.0 / seconds);
+  if (g_update) {
+    fprintf(stderr, "unchanged %llu files\n", quint64(g_unchanged_files));
+  }
+  for (int i = 0; i <= int(installer::CopyMethod::ReadWrite); ++i) {
+    if (g_copy_method_files[i] > 0) {
+      fprintf(stderr, "copied %llu files with %s\n",
+              quint64(g_copy_method_files[i]),
+              installer::GetCopyMethodName(installer::CopyMethod(i)));
+    }
+  }
+}
+
+// Get path to manifest file of |src|, like "filesystem.manifest" of
+// "filesystem.squashfs".
+QString GetManifestFile(const QString& src) {
+  const QFileInfo info(src);
+  return info.dir().absoluteFilePath(info.completeBaseName() + ".manifest");
+}
+
+// Create verifier of files extracted from |layers| to |dest_dir|, with
+// |jobs| threads. Returns null if no manifest is found.
+std::unique_ptr<installer::ManifestVerifier> CreateVerifier(
+    const QStringList& layers, const QString& dest_dir, int jobs) {
+  std::unique_ptr<installer::ManifestVerifier> verifier(
+      new installer::ManifestVerifier(
+          QDir(dest_dir).absolutePath().toStdString(), jobs));
+  bool found = false;
+  for (int i = 0; i < layers.length(); ++i) {
+    const QString manifest_file = GetManifestFile(layers.at(i));
+    if (!QFile::exists(manifest_file)) {
+      fprintf(stderr, "Manifest not found, skip verifying %s\n",
+              layers.at(i).toLocal8Bit().constData());
+      continue;
+    }
+    if (verifier->load(i, manifest_file.toStdString())) {
+      found = true;
+    }
+  }
+  if (!found) {
+    verifier.reset();
+  }
+  return verifier;
+}
+
+// Get readahead window of device on which |image| is stored, based on its
+// read_ahead_kb in sysfs.
+quint64 GetReadaheadWindow(const QString& image) {
+  quint64 window = kMinReadaheadWindow;
+  struct stat st;
+  if (stat(image.toLocal8Bit().constData(), &st) == 0 &&
+      major(st.st_dev) != 0) {
+    // Partitions share queue settings with their disk.
+    const QString dev_dir = QString("/sys/dev/block/%1:%2")
+        .arg(major(st.st_dev)).arg(minor(st.st_dev));
+    for (const QString& path : {dev_dir + "/queue/read_ahead_kb",
+                                dev_dir + "/../queue/read_ahead_kb"}) {
+      if (QFile::exists(path)) {
+        bool ok;
+        const quint64 kb = installer::ReadFile(path).trimmed()
+            .toULongLong(&ok);
+        if (ok && kb > 0) {
+          window = kb * 1024 * kReadaheadRatio;
+        }
         break;
       }
     }
-    if (num_read < 0) {
-      ok = false;
+  }
+  window = qBound(kMinReadaheadWindow, window, kMaxReadaheadWindow);
+  if (g_throttle != nullptr) {
+    // Keep readahead small in low memory mode.
+    window = qMin(window, quint64(g_throttle->budget()) / 2);
+  }
+  return window;
+}
+
+// Open journal in |dest_dir| for images in |layers| extracted in |mode|.
+// If |g_resume| is true, records of previous run are loaded.
+// |g_journal| is not set if journal cannot be created.
+void OpenJournal(const QStringList& layers, const QString& dest_dir,
+                 const char* mode) {
+  if (!installer::CreateDirs(dest_dir)) {
+    return;
+  }
+  // Journal of previous run is ignored if any image is changed.
+  QString id = QString("%1 %2").arg(kAppName).arg(mode);
+  for (const QString& layer : layers) {
+    const QFileInfo info(layer);
+    id += QString("\n%1 %2 %3").arg(info.absoluteFilePath())
+        .arg(info.size()).arg(info.lastModified().toMSecsSinceEpoch());
+  }
+  const QString path = QDir(dest_dir).absoluteFilePath(kJournalFile);
+  installer::ExtractJournal* journal = new installer::ExtractJournal();
+  if (!journal->open(path.toStdString(), id.toStdString(), g_resume)) {
+    delete journal;
+    return;
+  }
+  g_journal = journal;
+  if (g_resume) {
+    fprintf(stdout, "resume: %zu files extracted before\n",
+            journal->loadedCount());
+  }
+}
+
+// Close journal, and delete journal file if all files are extracted |ok|.
+void CloseJournal(bool ok) {
+  if (g_journal != nullptr) {
+    if (ok) {
+      g_journal->remove();
     }
+    delete g_journal;
+    g_journal = nullptr;
   }
+}
 
-  close(src_fd);
-  close(dest_fd);
+// Returns true if all of |len| bytes in |buf| are zero.
+bool IsZeroBuffer(const char* buf, size_t len) {
+  return (len == 0) || (buf[0] == 0 && memcmp(buf, buf + 1, len - 1) == 0);
+}
 
-  return ok;
+// Write |len| bytes in |buf| to |fd| at |offset|. If |g_skip_zero_blocks| is
+// true, blocks full of zero are skipped, leaving holes in |fd|.
+bool WriteSparse(int fd, const char* buf, size_t len, off_t offset) {
+  while (len > 0) {
+    size_t num = qMin(len, kZeroBlockSize);
+    if (!g_skip_zero_blocks || !IsZeroBuffer(buf, num)) {
+      const ssize_t num_written = pwrite(fd, buf, num, offset);
+      if (num_written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      num = size_t(num_written);
+    }
+    buf += num;
+    len -= num;
+    offset += off_t(num);
+  }
+  return true;
 }
 
-bool CopySymLink(const char* src_file, const char* link_path) {
-  char buf[PATH_MAX];
-  ssize_t link_len = readlink(src_file, buf, PATH_MAX);
-  if (link_len <= 0) {
-    fprintf(stderr, "CopySymLink() readlink() failed: %s\n", src_file);
-    perror("readlink() error");
-    return false;
+// Switch to slower copy |method| if current one is not supported. Other
+// threads might switch it at the same time.
+void DowngradeCopyMethod(installer::CopyMethod method) {
+  installer::CopyMethod current = g_copy_method;
+  while (current < method &&
+         !g_copy_method.compare_exchange_weak(current, method)) {
   }
+}
 
-  char target[link_len + 1];
-  strncpy(target, buf, (size_t)link_len);
-  target[link_len] = '\0';
-  if (symlink(target, link_path) != 0) {
-    fprintf(stderr, "CopySymLink() symlink() failed, %s (%s -> %s)\n",
-            strerror(errno), link_path, target);
-    // Ignores EEXIST.
-    return (errno == EEXIST);
-  } else {
+// Copy |len| bytes at |offset| of |src_fd| to the same offset of |dest_fd|.
+// Method used is saved in |method|.
+bool CopyRange(int src_fd, int dest_fd, off_t offset, size_t len,
+               const char* src_file, installer::CopyMethod& method) {
+  if (!g_skip_zero_blocks &&
+      g_copy_method != installer::CopyMethod::ReadWrite) {
+    // copy_file_range() is tried before sendfile(), and both are skipped
+    // once they are not supported between source and target.
+    method = g_copy_method;
+    if (!installer::CopyFileRange(src_fd, dest_fd, offset, len, method)) {
+      fprintf(stderr, "%s error: %s\nSkip %s\n",
+              installer::GetCopyMethodName(method), strerror(errno),
+              src_file);
+      // NOTE(xushaohua): Skip sendfile() error.
+      // xz uncompress error, Input/output error.
+      // squashfs file might have some defects.
+    }
+    DowngradeCopyMethod(method);
     return true;
   }
+
+  method = installer::CopyMethod::ReadWrite;
+  const size_t kBufSize = 64 * 1024;  // 64k
+  char buf[kBufSize];
+  while (len > 0) {
+    const ssize_t num_read = pread(src_fd, buf, qMin(len, kBufSize), offset);
+    if (num_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (num_read <= 0) {
+      return false;
+    }
+    if (!WriteSparse(dest_fd, buf, size_t(num_read), offset)) {
+      return false;
+    }
+    len -= size_t(num_read);
+    offset += num_read;
+  }
+  return true;
 }
 
-// Update xattr (access control lists and file capabilities)
-bool CopyXAttr(const char* src_file, const char* dest_file) {
+// Copy content of regular file |src_file| from |src_fd| to |dest_fd|.
+// Size of |src_file| is |file_size|.
+// Data blocks are shared with reflink if source and target are on the same
+// btrfs or xfs filesystem. Otherwise holes in |src_file| found by SEEK_DATA
+// and SEEK_HOLE are kept in |dest_fd|, see CopyRange().
+bool SendFile(const char* src_file, int src_fd, int dest_fd, off_t file_size) {
+  installer::CopyMethod method = installer::CopyMethod::ReadWrite;
+  if (!g_skip_zero_blocks && g_copy_method == installer::CopyMethod::Clone) {
+    if (installer::CloneFile(src_fd, dest_fd)) {
+      ++g_copy_method_files[int(installer::CopyMethod::Clone)];
+      return true;
+    }
+    if (installer::IsCopyMethodUnsupported(errno)) {
+      DowngradeCopyMethod(installer::CopyMethod::CopyFileRange);
+    }
+  }
+
+  bool ok = true;
+  off_t pos = 0;
+  while (ok && pos < file_size) {
+    // Find next data region.
+    off_t data_start = lseek(src_fd, pos, SEEK_DATA);
+    if (data_start < 0) {
+      if (errno == ENXIO) {
+        // Remaining part is a hole.
+        break;
+      }
+      // SEEK_DATA is not supported, treat whole file as data.
+      data_start = pos;
+    }
+    off_t data_end = lseek(src_fd, data_start, SEEK_HOLE);
+    if (data_end < 0 || data_end > file_size) {
+      data_end = file_size;
+    }
+    if (data_end <= data_start) {
+      break;
+    }
+    if (g_throttle == nullptr) {
+      ok = CopyRange(src_fd, dest_fd, data_start,
+                     size_t(data_end - data_start), src_file, method);
+    } else {
+      // Copy in small pieces, so that dirty pages are limited.
+      for (off_t start = data_start; ok && start < data_end;
+           start += kWritebackChunkSize) {
+        const size_t len = size_t(qMin(data_end - start,
+                                       off_t(kWritebackChunkSize)));
+        ok = CopyRange(src_fd, dest_fd, start, len, src_file, method);
+        g_throttle->addRange(dest_fd, start, len);
+      }
+    }
+    pos = data_end;
+  }
+
+  // Keep trailing hole.
+  if (ok && ftruncate(dest_fd, file_size) != 0) {
+    ok = false;
+  }
+  if (file_size > 0) {
+    ++g_copy_method_files[int(method)];
+  }
+
+  return ok;
+}
+
+// Get path of |name| in folder |dir_fd| through procfs, used by path based
+// system calls which have no *at() variant, like lsetxattr().
+void GetProcPath(int dir_fd, const char* name, char* path, size_t len) {
+  snprintf(path, len, "/proc/self/fd/%d/%s", dir_fd, name);
+}
+
+// Update xattr (access control lists and file capabilities) of |dest_fd|,
+// or of |dest_file| if |dest_fd| is -1.
+bool CopyXAttr(const char* src_file, int dest_fd, const char* dest_file) {
   bool ok = true;
   // size of extended attribute list, 64k.
   char list[XATTR_LIST_MAX];
-  char value[XATTR_NAME_MAX];
   ssize_t xlist_len = llistxattr(src_file, list, XATTR_LIST_MAX);
   if (xlist_len < 0) {
     // Check errno.
@@ -195,17 +662,22 @@ bool CopyXAttr(const char* src_file, const char* dest_file) {
               strerror(errno));
       ok = false;
     }
-  } else {
+  } else if (xlist_len > 0) {
+    // size of extended attribute value, 64k.
+    char value[XATTR_SIZE_MAX];
     ssize_t value_len;
-    for (int ns = 0; ns < xlist_len; ns += strlen(&list[ns] + 1)) {
-      value_len = lgetxattr(src_file, &list[ns], value, XATTR_NAME_MAX);
+    for (ssize_t ns = 0; ns < xlist_len; ns += strlen(&list[ns]) + 1) {
+      value_len = lgetxattr(src_file, &list[ns], value, XATTR_SIZE_MAX);
       if (value_len == -1) {
         fprintf(stdout, "CopyXAttr() could not get value: %s\n", src_file);
         break;
       } else {
-        if (lsetxattr(dest_file, &list[ns], value, size_t(value_len), 0) != 0) {
-          fprintf(stdout, "CopyXAttr() setxattr() failed: %s, %s, %s, %s\n",
-                  dest_file, &list[ns], value, strerror(errno));
+        const int ret = (dest_fd != -1) ?
+            fsetxattr(dest_fd, &list[ns], value, size_t(value_len), 0) :
+            lsetxattr(dest_file, &list[ns], value, size_t(value_len), 0);
+        if (ret != 0) {
+          fprintf(stdout, "CopyXAttr() setxattr() failed: %s, %s, %s\n",
+                  src_file, &list[ns], strerror(errno));
           ok = false;
           break;
         }
@@ -216,123 +688,529 @@ bool CopyXAttr(const char* src_file, const char* dest_file) {
   return ok;
 }
 
+// Mark one file with |bytes| of content as copied and update progress.
+void UpdateProgress(quint64 bytes) {
+  g_progress.addInode(bytes);
+}
+
+// Update ownership, permissions and xattrs of opened |dest_fd|, based on
+// |st|, the file status of |src_file|.
+void CopyMetadata(const char* src_file, int dest_fd, const struct stat& st) {
+  // Update ownership first, or chmod() might ignore SUID/SGID or sticky flag.
+  if (fchown(dest_fd, st.st_uid, st.st_gid) != 0) {
+    fprintf(stderr, "CopyItem() fchown() failed: %s, %d, %d\n",
+            src_file, st.st_uid, st.st_gid);
+    perror("fchown()");
+    // Ignores copy file error.
+  }
+  // Update permissions.
+  if (fchmod(dest_fd, st.st_mode & S_IMODE) != 0) {
+    fprintf(stderr, "CopyItem() fchmod failed: %s, %o\n", src_file,
+            st.st_mode & S_IMODE);
+    perror("fchmod()");
+    // Ignores chmod error.
+  }
+
+  if (!CopyXAttr(src_file, dest_fd, nullptr)) {
+    // NOTE(xushaohua): Do not exit when failed to copy file capacities.
+    // This may be happen in Alpha based computer.
+    fprintf(stderr, "CopyXAttr() failed: %s\n", src_file);
+  }
+}
+
+// Update metadata of symbolic link or special file |name| in folder |dir_fd|,
+// which cannot be opened.
+void CopyMetadataAt(const char* src_file, int dir_fd, const char* name,
+                    const struct stat& st) {
+  if (fchownat(dir_fd, name, st.st_uid, st.st_gid,
+               AT_SYMLINK_NOFOLLOW) != 0) {
+    fprintf(stderr, "CopyItem() fchownat() failed: %s, %d, %d\n",
+            src_file, st.st_uid, st.st_gid);
+    perror("fchownat()");
+  }
+  if (!S_ISLNK(st.st_mode)) {
+    if (fchmodat(dir_fd, name, st.st_mode & S_IMODE, 0) != 0) {
+      fprintf(stderr, "CopyItem() fchmodat failed: %s, %o\n", src_file,
+              st.st_mode & S_IMODE);
+      perror("fchmodat()");
+    }
+  }
+
+  char dest_file[PATH_MAX];
+  GetProcPath(dir_fd, name, dest_file, sizeof(dest_file));
+  if (!CopyXAttr(src_file, -1, dest_file)) {
+    fprintf(stderr, "CopyXAttr() failed: %s\n", src_file);
+  }
+}
+
+// Create regular file |name| in folder |dir_fd|, replacing existing file.
+int CreateFileAt(int dir_fd, const char* name) {
+  // O_EXCL saves a system call to remove old file in empty target.
+  const int flags = O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC;
+  int fd = openat(dir_fd, name, flags, S_IRUSR | S_IWUSR);
+  if (fd == -1 && errno == EEXIST && unlinkat(dir_fd, name, 0) == 0) {
+    fd = openat(dir_fd, name, flags, S_IRUSR | S_IWUSR);
+  }
+  return fd;
+}
+
+// Create folder |name| in folder |dir_fd|, replacing existing non-folder
+// file, and open it.
+DestDirPtr CreateDirAt(int dir_fd, const char* name) {
+  const int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC;
+  if (mkdirat(dir_fd, name, S_IRWXU) != 0 && errno != EEXIST) {
+    return nullptr;
+  }
+  int fd = openat(dir_fd, name, flags);
+  if (fd == -1 && (errno == ENOTDIR || errno == ELOOP) &&
+      unlinkat(dir_fd, name, 0) == 0 &&
+      mkdirat(dir_fd, name, S_IRWXU) == 0) {
+    fd = openat(dir_fd, name, flags);
+  }
+  if (fd == -1) {
+    return nullptr;
+  }
+  return std::make_shared<DestDir>(fd);
+}
+
+// Copy symbolic link |src_file| to |name| in folder |dir_fd|.
+bool CopySymLink(const char* src_file, int dir_fd, const char* name) {
+  char target[PATH_MAX];
+  const ssize_t link_len = readlink(src_file, target, PATH_MAX - 1);
+  if (link_len <= 0) {
+    fprintf(stderr, "CopySymLink() readlink() failed: %s\n", src_file);
+    perror("readlink() error");
+    return false;
+  }
+  target[link_len] = '\0';
+
+  int ret = symlinkat(target, dir_fd, name);
+  if (ret != 0 && errno == EEXIST && g_update) {
+    char old_target[PATH_MAX];
+    const ssize_t old_len = readlinkat(dir_fd, name, old_target,
+                                       PATH_MAX - 1);
+    if (old_len == link_len &&
+        memcmp(old_target, target, size_t(link_len)) == 0) {
+      // Same symbolic link.
+      return true;
+    }
+  }
+  if (ret != 0 && errno == EEXIST && unlinkat(dir_fd, name, 0) == 0) {
+    ret = symlinkat(target, dir_fd, name);
+  }
+  if (ret != 0) {
+    fprintf(stderr, "CopySymLink() symlinkat() failed, %s (%s -> %s)\n",
+            strerror(errno), src_file, target);
+    // Ignores EEXIST.
+    return (errno == EEXIST);
+  }
+  return true;
+}
+
+// Create device file, fifo or socket |name| in folder |dir_fd|.
+bool CopySpecialFile(int dir_fd, const char* name, const struct stat& st) {
+  const mode_t mode = st.st_mode & (S_IFMT | S_IMODE);
+  const dev_t dev = (S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode)) ?
+                    st.st_rdev : 0;
+  int ret = mknodat(dir_fd, name, mode, dev);
+  struct stat dest_st;
+  if (ret != 0 && errno == EEXIST && g_update &&
+      fstatat(dir_fd, name, &dest_st, AT_SYMLINK_NOFOLLOW) == 0 &&
+      (dest_st.st_mode & S_IFMT) == (st.st_mode & S_IFMT) &&
+      dest_st.st_rdev == dev) {
+    // Same special file.
+    return true;
+  }
+  if (ret != 0 && errno == EEXIST && unlinkat(dir_fd, name, 0) == 0) {
+    ret = mknodat(dir_fd, name, mode, dev);
+  }
+  if (ret != 0) {
+    fprintf(stderr, "CopySpecialFile() mknodat() failed, %s (%s)\n",
+            strerror(errno), name);
+    // Ignores EEXIST, same as CopySymLink().
+    return (errno == EEXIST);
+  }
+  return true;
+}
+
+// Get key of |fpath| in current layer in journal.
+std::string GetJournalKey(const char* fpath) {
+  return std::to_string(g_layer) + ":" + (fpath + g_src_path_len);
+}
+
+// Returns true if regular file with |key| is recorded in journal, and
+// |name| in folder |dir_fd| still has the same size as |st|.
+// Modification time is not checked, as it is not copied in mount mode.
+bool IsFileCopied(const std::string& key, int dir_fd, const char* name,
+                  const struct stat& st) {
+  struct stat dest_st;
+  return g_journal->contains(key) &&
+         fstatat(dir_fd, name, &dest_st, AT_SYMLINK_NOFOLLOW) == 0 &&
+         S_ISREG(dest_st.st_mode) && dest_st.st_size == st.st_size;
+}
+
+// Returns true if regular file |name| in folder |dir_fd| has the same size
+// and content as |src_fd|, whose status is |st|.
+bool IsSameFile(int src_fd, int dir_fd, const char* name,
+                const struct stat& st) {
+  const int dest_fd = openat(dir_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (dest_fd == -1) {
+    return false;
+  }
+  struct stat dest_st;
+  bool same = (fstat(dest_fd, &dest_st) == 0 && S_ISREG(dest_st.st_mode) &&
+               dest_st.st_size == st.st_size);
+  // Buffers are reused in each thread.
+  thread_local std::vector<char> src_buf(kCompareBufSize);
+  thread_local std::vector<char> dest_buf(kCompareBufSize);
+  for (off_t offset = 0; same && offset < st.st_size;
+       offset += off_t(kCompareBufSize)) {
+    const size_t len = size_t(qMin(off_t(kCompareBufSize),
+                                   st.st_size - offset));
+    same = pread(src_fd, src_buf.data(), len, offset) == ssize_t(len) &&
+           pread(dest_fd, dest_buf.data(), len, offset) == ssize_t(len) &&
+           memcmp(src_buf.data(), dest_buf.data(), len) == 0;
+  }
+  close(dest_fd);
+  return same;
+}
+
+// Keep existing regular file |name| in folder |dir_fd| in update mode, only
+// updating its metadata if it differs from |st|, the file status of
+// |src_file|.
+void KeepFile(const char* src_file, int dir_fd, const char* name,
+              const struct stat& st, const std::string& journal_key) {
+  const int dest_fd = openat(dir_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  struct stat dest_st;
+  if (dest_fd != -1 && fstat(dest_fd, &dest_st) == 0) {
+    if (dest_st.st_uid == st.st_uid && dest_st.st_gid == st.st_gid &&
+        (dest_st.st_mode & S_IMODE) == (st.st_mode & S_IMODE)) {
+      if (!CopyXAttr(src_file, dest_fd, nullptr)) {
+        fprintf(stderr, "CopyXAttr() failed: %s\n", src_file);
+      }
+    } else {
+      CopyMetadata(src_file, dest_fd, st);
+    }
+  }
+  if (dest_fd != -1) {
+    close(dest_fd);
+  }
+  if (g_journal != nullptr) {
+    g_journal->append(journal_key);
+  }
+  ++g_unchanged_files;
+  UpdateProgress(quint64(st.st_size));
+}
+
+// Copy regular file |src_file| to |name| in folder |dir|. If |created| is
+// true, that file is already created in tree walking thread. |journal_key|
+// is recorded in journal if file is copied completely.
+// This function is called in worker threads in parallel mode.
+bool CopyRegularFile(const char* src_file, const DestDir& dir,
+                     const char* name, const struct stat& st, bool created,
+                     const std::string& journal_key) {
+  const int src_fd = open(src_file, O_RDONLY | O_CLOEXEC);
+  if (src_fd == -1) {
+    fprintf(stderr, "CopyRegularFile() Failed to open src file: %s\n",
+            src_file);
+    perror("Open src file failed!");
+    return false;
+  }
+
+  if (g_update && !created && IsSameFile(src_fd, dir.fd, name, st)) {
+    KeepFile(src_file, dir.fd, name, st, journal_key);
+    close(src_fd);
+    return true;
+  }
+
+  const int dest_fd = created ?
+      openat(dir.fd, name, O_WRONLY | O_NOFOLLOW | O_CLOEXEC) :
+      CreateFileAt(dir.fd, name);
+  if (dest_fd == -1) {
+    fprintf(stderr, "CopyRegularFile() Failed to open dest file: %s\n",
+            src_file);
+    perror("Open dest file failed!");
+    close(src_fd);
+    return false;
+  }
+
+  const bool ok = SendFile(src_file, src_fd, dest_fd, st.st_size);
+  if (!ok) {
+    fprintf(stderr, "Failed to copy item: %s\n", src_file);
+  }
+  CopyMetadata(src_file, dest_fd, st);
+  if (g_throttle != nullptr) {
+    g_throttle->finishFile(dest_fd);
+    installer::WritebackThrottle::DropCache(src_fd, 0, 0);
+  }
+  close(src_fd);
+  close(dest_fd);
+  if (ok && g_journal != nullptr) {
+    g_journal->append(journal_key);
+  }
+  UpdateProgress(quint64(st.st_size));
+  return ok;
+}
+
+// Create |name| in folder |dir_fd| as hard link if |st| is a regular file
+// whose inode was copied before. Returns true if |name| is handled, and
+// |ok| is set to false if linkat() failed. |fpath| is path to source file.
+bool CopyHardLink(const char* fpath, const struct stat& st, int dir_fd,
+                  const char* name, bool& ok) {
+  if (!S_ISREG(st.st_mode) || st.st_nlink <= 1) {
+    return false;
+  }
+  const std::pair<dev_t, ino_t> key(st.st_dev, st.st_ino);
+  const auto iter = g_hard_links.find(key);
+  if (iter == g_hard_links.end()) {
+    // Save absolute path of dest file.
+    g_hard_links.emplace(key, g_dest_path + (fpath + g_src_path_len));
+    return false;
+  }
+
+  const char* target = iter->second.c_str();
+  struct stat target_st, dest_st;
+  if (g_update && lstat(target, &target_st) == 0 &&
+      fstatat(dir_fd, name, &dest_st, AT_SYMLINK_NOFOLLOW) == 0 &&
+      target_st.st_dev == dest_st.st_dev &&
+      target_st.st_ino == dest_st.st_ino) {
+    // Already linked.
+    ok = true;
+    return true;
+  }
+  int ret = linkat(AT_FDCWD, target, dir_fd, name, 0);
+  if (ret != 0 && errno == EEXIST && unlinkat(dir_fd, name, 0) == 0) {
+    ret = linkat(AT_FDCWD, target, dir_fd, name, 0);
+  }
+  ok = (ret == 0);
+  if (!ok) {
+    fprintf(stderr, "CopyHardLink() linkat() failed: %s, %s -> %s\n",
+            strerror(errno), fpath, target);
+  }
+  return true;
+}
+
 // Tree walk handler. Copy one item from |fpath|.
+// Items are created relative to opened target folders in |g_dest_dirs|.
 int CopyItem(const char* fpath, const struct stat* sb,
              int typeflag, struct FTW* ftwbuf) {
-  Q_UNUSED(sb);
-  Q_UNUSED(typeflag);
-  Q_UNUSED(ftwbuf);
+  if (g_copy_failed) {
+    // Stop tree walking if any worker thread failed.
+    return 1;
+  }
 
-  struct stat st;
-  if (lstat(fpath, &st) != 0) {
+  if (typeflag == FTW_NS) {
     fprintf(stderr, "CopyItem() call lstat() failed: %s\n", fpath);
-    perror("lstat()");
     return 1;
   }
-
-  QString relative_path(fpath);
-  relative_path.remove(g_src_dir);
-  if (relative_path.startsWith('/')) {
-    relative_path = relative_path.mid(1);
+  // |sb| is returned by lstat(), as FTW_PHYS flag is set.
+  const struct stat& st = *sb;
+
+  const size_t level = size_t(ftwbuf->level);
+  if (level == 0) {
+    // Root folder is created and opened in CopyFiles().
+    CopyMetadata(fpath, g_dest_dirs[0]->fd, st);
+    UpdateProgress(0);
+    return 0;
   }
-  const QString dest_filepath =
-      QDir(g_dest_dir).absoluteFilePath(relative_path);
-
-  // Create parent dirs.
-  installer::CreateParentDirs(dest_filepath);
 
-  const std::string std_dest_filepath(dest_filepath.toStdString());
-  const char* dest_file = std_dest_filepath.c_str();
+  // Parent folder is always opened before its children, as nftw() visits
+  // folders first. Close folders not in current path.
+  g_dest_dirs.resize(level);
+  const DestDirPtr& parent = g_dest_dirs[level - 1];
+  const char* name = fpath + ftwbuf->base;
 
-  // Get file mode.
-  const mode_t mode = st.st_mode & S_IMODE;
   bool ok = true;
+  if (CopyHardLink(fpath, st, parent->fd, name, ok)) {
+    // Inode is counted only once in progress.
+    if (!ok) {
+      fprintf(stderr, "Failed to copy item: %s\n", fpath);
+    }
+    return ok ? 0 : 1;
+  }
 
-  // Remove dest_file if it exists.
-  struct stat dest_stat;
-  if (stat(dest_file, &dest_stat) == 0) {
-    if (!S_ISDIR(dest_stat.st_mode)) {
-      unlink(dest_file);
-    }
-  }
-
-  if (S_ISLNK(st.st_mode)) {
-    // Symbolic link
-    ok = CopySymLink(fpath, dest_file);
-  } else if (S_ISREG(sb->st_mode)) {
-    // Regular file
-    ok = SendFile(fpath, dest_file, st.st_size);
-  } else if (S_ISDIR(st.st_mode)) {
-    // Directory
-    ok = installer::CreateDirs(dest_filepath);
-  } else if (S_ISCHR(st.st_mode)) {
-    // Character device
-    ok = (mknod(dest_file, mode | S_IFCHR, st.st_dev) == 0);
-  } else if (S_ISBLK(st.st_mode)) {
-    // For block device.
-    ok = (mknod(dest_file, mode | S_IFBLK, st.st_dev) == 0);
-  } else if (S_ISFIFO(st.st_mode)) {
-    // FIFO
-    ok = (mknod(dest_file, mode | S_IFIFO, st.st_dev) == 0);
-  } else if (S_ISSOCK(st.st_mode)) {
-    // Socket
-    ok = (mknod(dest_file, mode | S_IFSOCK, st.st_dev) == 0);
+  if (S_ISREG(st.st_mode)) {
+    std::string journal_key;
+    if (g_journal != nullptr) {
+      journal_key = GetJournalKey(fpath);
+      if (IsFileCopied(journal_key, parent->fd, name, st)) {
+        // Copied by previous run.
+        UpdateProgress(quint64(st.st_size));
+        return 0;
+      }
+    }
+    if (g_queues == nullptr) {
+      return CopyRegularFile(fpath, *parent, name, st, false,
+                             journal_key) ? 0 : 1;
+    }
+
+    // File with hard links is created here, so that its links can be
+    // created before its content is copied. In update mode, it is compared
+    // here too.
+    bool created = false;
+    if (st.st_nlink > 1 && g_update) {
+      const int src_fd = open(fpath, O_RDONLY | O_CLOEXEC);
+      const bool same = (src_fd != -1 &&
+                         IsSameFile(src_fd, parent->fd, name, st));
+      if (src_fd != -1) {
+        close(src_fd);
+      }
+      if (same) {
+        KeepFile(fpath, parent->fd, name, st, journal_key);
+        return 0;
+      }
+    }
+    if (st.st_nlink > 1) {
+      const int fd = CreateFileAt(parent->fd, name);
+      if (fd != -1) {
+        close(fd);
+        created = true;
+      }
+    }
+    const std::string src_file(fpath);
+    const std::string dest_name(name);
+    g_queues->submit(parent->dev, [src_file, parent, dest_name, st, created,
+                                   journal_key](int) {
+      if (!CopyRegularFile(src_file.c_str(), *parent, dest_name.c_str(), st,
+                           created, journal_key)) {
+        g_copy_failed = true;
+      }
+    });
+    return 0;
+  }
+
+  if (S_ISDIR(st.st_mode)) {
+    const DestDirPtr dir = CreateDirAt(parent->fd, name);
+    ok = (dir != nullptr);
+    if (ok) {
+      // Creating files in this folder does not affect its metadata.
+      CopyMetadata(fpath, dir->fd, st);
+      g_dest_dirs.push_back(dir);
+    }
+  } else if (S_ISLNK(st.st_mode)) {
+    ok = CopySymLink(fpath, parent->fd, name);
+  } else if (S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode) ||
+             S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode)) {
+    // Device file, fifo or socket.
+    ok = CopySpecialFile(parent->fd, name, st);
   } else {
     fprintf(stderr, "CopyItem() Unknown file mode: %d\n", st.st_mode);
+    ok = false;
   }
 
   if (!ok) {
-    fprintf(stderr, "Failed to copy item: %s\n", dest_file);
-    // Ignore copy file error.
-    // Return if error occurs
-//    return 1;
+    fprintf(stderr, "Failed to copy item: %s, %s\n", fpath, strerror(errno));
+    // Stop copying if a folder, link or special file cannot be created,
+    // the same as SquashfsExtractor. Errors of file content and metadata
+    // are still skipped.
+    return 1;
   }
 
-  // Update ownership first, or chmod() might ignore SUID/SGID or sticky flag.
-  if (lchown(dest_file, st.st_uid, st.st_gid) != 0) {
-    fprintf(stderr, "CopyItem() lchown() failed: %s, %d, %d\n",
-            dest_file, st.st_uid, st.st_gid);
-    perror("lchown()");
-    // Ignores copy file error.
-//    ok = false;
+  if (!S_ISDIR(st.st_mode)) {
+    CopyMetadataAt(fpath, parent->fd, name, st);
   }
-  // Update permissions.
-  if (!S_ISLNK(st.st_mode)) {
-    if (chmod(dest_file, mode) != 0) {
-      fprintf(stderr, "CopyItem() chmod failed: %s, %ul\n", dest_file, mode);
-      perror("chmod()");
-      // Ignores chmod error.
-//      ok = false;
+
+  UpdateProgress(0);
+
+  return 0;
+}
+
+// Raise soft limit of opened file descriptors to its hard limit.
+void RaiseOpenFileLimit() {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+      limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &limit) != 0) {
+      perror("setrlimit()");
     }
   }
+}
 
-  if (!CopyXAttr(fpath, dest_file)) {
-    // NOTE(xushaohua): Do not exit when failed to copy file capacities.
-    // This may be happen in Alpha based computer.
-    fprintf(stderr, "CopyXAttr() failed: %s\n", fpath);
-//    ok = false;
+// Tree walk handler. Save relative path of |fpath| in folder of length
+// |g_src_path_len|.
+int CollectItem(const char* fpath, const struct stat* sb,
+                int typeflag, struct FTW* ftwbuf) {
+  Q_UNUSED(sb);
+  Q_UNUSED(typeflag);
+  if (ftwbuf->level == 0) {
+    g_manifest_paths.push_back(".");
+  } else {
+    // Skip slash after folder path.
+    g_manifest_paths.push_back(fpath + g_src_path_len + 1);
   }
+  return 0;
+}
 
-  g_current_files ++;
-  const int progress = qFloor(g_current_files * 100.0 / g_total_files);
-  WriteProgress(progress);
+// Write manifest of all files in |dir| to |manifest_file|, hashing files in
+// |jobs| threads.
+bool GenerateManifest(const QString& dir, const QString& manifest_file,
+                      int jobs) {
+  const std::string root = QDir(dir).absolutePath().toStdString();
+  g_src_path_len = root.size();
+  g_manifest_paths.clear();
+  if (nftw(root.c_str(), CollectItem, kMaxOpenFd, FTW_PHYS) != 0) {
+    fprintf(stderr, "GenerateManifest() failed to walk %s\n", root.c_str());
+    return false;
+  }
+  std::sort(g_manifest_paths.begin(), g_manifest_paths.end());
+
+  std::vector<installer::ManifestEntry> entries(g_manifest_paths.size());
+  std::atomic<bool> ok(true);
+  {
+    installer::WorkStealingPool pool(jobs, jobs * kMaxPendingTasksPerJob);
+    for (size_t i = 0; i < entries.size(); ++i) {
+      pool.submit([&, i](int) {
+        if (!installer::ReadManifestEntry(root, g_manifest_paths[i],
+                                          entries[i])) {
+          fprintf(stderr, "GenerateManifest() failed to read %s\n",
+                  g_manifest_paths[i].c_str());
+          ok = false;
+        }
+      });
+    }
+    pool.wait();
+  }
+  if (!ok) {
+    return false;
+  }
 
-  return ok ? 0 : 1;
+  FILE* file = fopen(manifest_file.toLocal8Bit().constData(), "w");
+  if (file == nullptr) {
+    perror("fopen() Failed to open manifest file");
+    return false;
+  }
+  fprintf(file, "%s\n", installer::kManifestHeader);
+  for (const installer::ManifestEntry& entry : entries) {
+    fprintf(file, "%s\n", installer::FormatManifestEntry(entry).c_str());
+  }
+  return fclose(file) == 0;
 }
 
 int CountItem(const char* fpath, const struct stat* sb,
               int typeflag, struct FTW* ftwbuf) {
   Q_UNUSED(fpath);
-  Q_UNUSED(sb);
   Q_UNUSED(typeflag);
   Q_UNUSED(ftwbuf);
   g_total_files ++;
+  // |sb| is returned by lstat(), as FTW_PHYS flag is set.
+  if (S_ISREG(sb->st_mode)) {
+    g_total_bytes += quint64(sb->st_size);
+  }
   return 0;
 }
 
-// Copy files from |mount_point| to |dest_dir|, keeping xattrs.
-bool CopyFiles(const QString& src_dir, const QString& dest_dir,
-               const QString& progress_file) {
+// Copy files from mount points in |src_dirs| to |dest_dir| one by one,
+// keeping xattrs.
+// If |jobs| is greater than 1, regular files are copied in |jobs| threads.
+// |total_inodes| and |total_bytes| are counted by walking through |src_dirs|
+// if |total_inodes| is 0.
+bool CopyFiles(const QStringList& src_dirs, const QString& dest_dir,
+               const QString& progress_file, int jobs,
+               quint64 total_inodes, quint64 total_bytes) {
+  installer::ScopedTrace trace(kTraceCategory, "copy_files",
+                               {{"src", src_dirs.join(' ')},
+                                {"jobs", jobs}});
   if (!installer::CreateDirs(dest_dir)) {
     fprintf(stderr, "CopyFiles() failed to create dest dir: %s\n",
             dest_dir.toLocal8Bit().constData());
@@ -350,17 +1228,171 @@ bool CopyFiles(const QString& src_dir, const QString& dest_dir,
     }
   }
 
-  g_src_dir = src_dir;
-  g_dest_dir = dest_dir;
+  g_dest_path = QDir(dest_dir).absolutePath().toStdString();
 
-  // Count file numbers.
-  bool ok = (nftw(src_dir.toUtf8().data(),
-                  CountItem, kMaxOpenFd, FTW_PHYS) == 0);
-  if (!ok || (g_total_files == 0)) {
+  bool ok = true;
+  if (total_inodes == 0) {
+    // Count file numbers.
+    for (const QString& src_dir : src_dirs) {
+      ok = ok && (nftw(src_dir.toUtf8().data(), CountItem, kMaxOpenFd,
+                       FTW_PHYS) == 0);
+    }
+    total_inodes = quint64(g_total_files);
+    total_bytes = g_total_bytes;
+  }
+  if (!ok || (total_inodes == 0)) {
     fprintf(stderr, "CopyFiles() Failed to count file number!\n");
   } else {
-    ok = (nftw(src_dir.toUtf8().data(), CopyItem, kMaxOpenFd, FTW_PHYS) == 0);
+    StartProgress(total_bytes, total_inodes);
+    if (jobs > 1) {
+      // Target folders are kept open by pending copy tasks.
+      RaiseOpenFileLimit();
+      g_queues = new installer::DeviceQueues(
+          jobs, jobs * kMaxPendingTasksPerJob);
+    }
+    for (int i = 0; i < src_dirs.length(); ++i) {
+      const QString& src_dir = src_dirs.at(i);
+      g_layer = i;
+      const int root_fd = open(g_dest_path.c_str(),
+                               O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      if (root_fd == -1) {
+        fprintf(stderr, "CopyFiles() failed to open dest dir: %s\n",
+                g_dest_path.c_str());
+        ok = false;
+        break;
+      }
+      g_src_path_len = src_dir.toUtf8().size();
+      g_dest_dirs.clear();
+      g_dest_dirs.push_back(std::make_shared<DestDir>(root_fd));
+      ok = (nftw(src_dir.toUtf8().data(), CopyItem, kMaxOpenFd,
+                 FTW_PHYS) == 0);
+      if (!ok) {
+        break;
+      }
+    }
+    if (g_queues != nullptr) {
+      // Wait for worker threads to copy remaining files.
+      g_queues->wait();
+      delete g_queues;
+      g_queues = nullptr;
+      ok = ok && !g_copy_failed;
+    }
+  }
+  g_dest_dirs.clear();
+
+  // Reset umask.
+  umask(old_mask);
+
+  if (ok) {
+    g_progress.finish();
+    WriteProgress(100);
+  }
+  trace.addArg("files", total_inodes);
+  trace.addArg("bytes", total_bytes);
+  trace.addArg("ok", ok);
+
+  if (g_progress_fd) {
+    fclose(g_progress_fd);
+  }
+
+  return ok;
+}
+
+// Extract files in squashfs images |layers| to |dest_dir| with builtin
+// reader, images are stacked from bottom to top.
+// Returns false if builtin reader failed to open any image, in which case
+// |reader_ok| is set to false.
+bool ExtractFiles(const QStringList& layers, const QString& dest_dir,
+                  const QString& progress_file, int jobs, bool& reader_ok) {
+  installer::ScopedTrace trace(kTraceCategory, "extract",
+                               {{"layers", layers.join(' ')},
+                                {"jobs", jobs},
+                                {"media_order", g_media_order}});
+  std::vector<std::unique_ptr<installer::SquashfsReader>> readers;
+  for (const QString& src : layers) {
+    readers.emplace_back(new installer::SquashfsReader());
+    installer::SquashfsReader& reader = *readers.back();
+    reader_ok = reader.open(src.toStdString());
+    if (!reader_ok) {
+      return false;
+    }
+    fprintf(stdout, "compression: %s, %s\n",
+            installer::Decompressor::GetName(reader.compression()),
+            src.toLocal8Bit().constData());
+  }
+
+  if (!progress_file.isEmpty()) {
+    // Set progress file descriptor.
+    g_progress_fd = fopen(progress_file.toStdString().c_str(), "w");
+    if (g_progress_fd == nullptr) {
+      perror("fopen() Failed to open progress file");
+    }
+  }
+
+  // Save current umask.
+  const mode_t old_mask = umask(0);
+
+  installer::ExtractOptions options;
+  options.dest_dir = QDir(dest_dir).absolutePath().toStdString();
+  options.jobs = jobs;
+  options.skip_zero_blocks = g_skip_zero_blocks;
+  options.media_order = g_media_order;
+  options.update = g_update;
+  options.update_checksum = g_update_checksum;
+  if (g_media_order) {
+    options.readahead_window = GetReadaheadWindow(layers.at(0));
+    fprintf(stdout, "media_order: yes, readahead: %llu KiB\n",
+            quint64(options.readahead_window / 1024));
+  }
+  installer::SquashfsExtractor extractor(*readers.front(), options);
+  if (g_throttle != nullptr) {
+    extractor.setThrottle(g_throttle);
+  }
+  OpenJournal(layers, dest_dir, "native");
+  extractor.setJournal(g_journal);
+  std::unique_ptr<installer::ManifestVerifier> verifier;
+  if (g_verify) {
+    verifier = CreateVerifier(layers, dest_dir, jobs);
+    extractor.setVerifier(verifier.get());
+  }
+  // Total size is unknown if it is unknown in any layer.
+  quint64 total_inodes = 0;
+  quint64 total_bytes = 0;
+  bool bytes_known = true;
+  for (int i = 0; i < layers.length(); ++i) {
+    installer::SquashfsReader* reader = readers.at(size_t(i)).get();
+    if (i > 0) {
+      extractor.addLayer(*reader);
+    }
+    if (g_throttle != nullptr) {
+      reader->setDropCache(true);
+    }
+    quint64 inodes, bytes;
+    if (!CountImage(layers.at(i), reader, inodes, bytes)) {
+      inodes = reader->inodeCount();
+      bytes = 0;
+    }
+    total_inodes += inodes;
+    total_bytes += bytes;
+    bytes_known = bytes_known && (bytes > 0);
+  }
+  StartProgress(bytes_known ? total_bytes : 0, total_inodes);
+  extractor.setProgress(&g_progress);
+  bool ok = extractor.extract();
+  CloseJournal(ok);
+  g_unchanged_files = extractor.unchangedFiles();
+  trace.addArg("files", total_inodes);
+  trace.addArg("bytes", total_bytes);
+  trace.addArg("unchanged_files", quint64(g_unchanged_files));
+  if (ok && verifier) {
+    // Files not verified yet in background threads.
+    installer::ScopedTrace verify_trace(kTraceCategory, "verify");
+    ok = verifier->finish();
+    if (!ok) {
+      fprintf(stderr, "Verify files failed!\n");
+    }
   }
+  trace.addArg("ok", ok);
 
   // Reset umask.
   umask(old_mask);
@@ -371,6 +1403,7 @@ bool CopyFiles(const QString& src_dir, const QString& dest_dir,
 
   if (g_progress_fd) {
     fclose(g_progress_fd);
+    g_progress_fd = nullptr;
   }
 
   return ok;
@@ -431,36 +1464,120 @@ int main(int argc, char* argv[]) {
       "progress","print progress info to <file>",
       "file", "");
   parser.addOption(progress_option);
+  const QCommandLineOption jobs_option(
+      "jobs", "copy files with <num> threads, 0 means number of cpu cores, "
+      "default 1",
+      "num", "1");
+  parser.addOption(jobs_option);
+  const QCommandLineOption mount_option(
+      "mount", "mount filesystem and copy files from mount point, "
+      "instead of reading it directly");
+  parser.addOption(mount_option);
+  const QCommandLineOption low_memory_option(
+      "low-memory", "limit dirty pages and drop written pages from cache, "
+      "enabled by default if available memory is less than 2G");
+  parser.addOption(low_memory_option);
+  const QCommandLineOption sparse_option(
+      "sparse", "do not write blocks full of zero, leave holes in files");
+  parser.addOption(sparse_option);
+  const QCommandLineOption no_sendfile_option(
+      "no-sendfile", "copy files with read() and write() only in mount mode, "
+      "used by benchmark");
+  parser.addOption(no_sendfile_option);
+  const QCommandLineOption layer_option(
+      "layer", "stack <file> over previous images, files in it replace "
+      "files in lower images, can be set multiple times",
+      "file");
+  parser.addOption(layer_option);
+  const QCommandLineOption resume_option(
+      "resume", "skip files extracted completely by previous run, "
+      "which are recorded in journal in target folder");
+  parser.addOption(resume_option);
+  const QCommandLineOption media_order_option(
+      "media-order", "extract files in order of their data blocks in image, "
+      "faster on optical discs and slow USB sticks");
+  parser.addOption(media_order_option);
+  const QCommandLineOption update_option(
+      "update", "keep files in target folder identical to image, "
+      "compared by size and modification time");
+  parser.addOption(update_option);
+  const QCommandLineOption checksum_option(
+      "checksum", "with --update, compare regular files by content, "
+      "always enabled in mount mode");
+  parser.addOption(checksum_option);
+  const QCommandLineOption verify_option(
+      "verify", "verify extracted files against manifest of each image, "
+      "like filesystem.manifest of filesystem.squashfs");
+  parser.addOption(verify_option);
+  const QCommandLineOption gen_manifest_option(
+      "gen-manifest", "write manifest of files in --dest folder to <file> "
+      "and exit, used when building ISO",
+      "file");
+  parser.addOption(gen_manifest_option);
   parser.setApplicationDescription(kAppDesc);
   parser.addHelpOption();
   parser.addVersionOption();
-  parser.addPositionalArgument("file", "squashfs filesystem to be extracted");
+  parser.addPositionalArgument("file", "squashfs filesystem to be extracted, "
+                               "optional if --layer is set");
 
   if (!parser.parse(app.arguments())) {
     parser.showHelp(kExitErr);
   }
 
+  // Append events to trace of installer, and report progress to it, if run
+  // in hooks.
+  installer::InitTraceFromEnv();
+  g_progress_bus.openFromEnv();
+
   if (parser.isSet("version") || parser.isSet("help")) {
     // Show help and exit.
     parser.showHelp(kExitOk);
   }
 
   const QStringList positional_args = parser.positionalArguments();
-  if (positional_args.length() != 1) {
+  if (positional_args.length() > 1) {
     fprintf(stderr, "Too many files to extract, expect one!\n");
     parser.showHelp(kExitErr);
   }
 
-  const QString src(positional_args.at(0));
-  const QFile src_file(src);
-  if (!src_file.exists()) {
-    fprintf(stderr, "File not found: %s\n", src.toLocal8Bit().constData());
+  bool jobs_ok;
+  int jobs = parser.value(jobs_option).toInt(&jobs_ok);
+  if (!jobs_ok || jobs < 0) {
+    fprintf(stderr, "Invalid jobs number: %s\n",
+            parser.value(jobs_option).toLocal8Bit().constData());
     parser.showHelp(kExitErr);
   }
-  if (src_file.size() == 0) {
-    fprintf(stderr, "Filesystem is empty: %s\n", src.toLocal8Bit().constData());
+  if (jobs == 0) {
+    jobs = int(std::thread::hardware_concurrency());
+  }
+
+  if (parser.isSet(gen_manifest_option)) {
+    const bool ok = GenerateManifest(parser.value(dest_option),
+                                     parser.value(gen_manifest_option), jobs);
+    if (!ok) {
+      fprintf(stderr, "Generate manifest failed!\n");
+    }
+    exit(ok ? kExitOk : kExitErr);
+  }
+
+  // Images to be extracted, from bottom layer to top layer.
+  const QStringList layers = positional_args + parser.values(layer_option);
+  if (layers.isEmpty()) {
+    fprintf(stderr, "No file to extract!\n");
     parser.showHelp(kExitErr);
   }
+  for (const QString& src : layers) {
+    const QFile src_file(src);
+    if (!src_file.exists()) {
+      fprintf(stderr, "File not found: %s\n", src.toLocal8Bit().constData());
+      parser.showHelp(kExitErr);
+    }
+    if (src_file.size() == 0) {
+      fprintf(stderr, "Filesystem is empty: %s\n",
+              src.toLocal8Bit().constData());
+      parser.showHelp(kExitErr);
+    }
+  }
 
   struct utsname uname_buf;
   if (uname(&uname_buf) == 0) {
@@ -469,36 +1586,127 @@ int main(int argc, char* argv[]) {
   } else {
     g_use_sendfile = false;
   }
+  if (parser.isSet(no_sendfile_option)) {
+    g_use_sendfile = false;
+  }
+  if (!g_use_sendfile) {
+    g_copy_method = installer::CopyMethod::ReadWrite;
+  }
   fprintf(stdout, "use_sendfile: %s\n", g_use_sendfile ? "yes" : "no");
 
-  const qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
-  const QString mount_point(QString(kMountPointTmp).arg(timestamp));
+  g_skip_zero_blocks = parser.isSet(sparse_option);
+  g_resume = parser.isSet(resume_option);
+  g_media_order = parser.isSet(media_order_option);
+  g_verify = parser.isSet(verify_option);
+  g_update = parser.isSet(update_option);
+  g_update_checksum = parser.isSet(checksum_option);
+  if (g_update) {
+    fprintf(stdout, "update: yes, checksum: %s\n",
+            g_update_checksum ? "yes" : "no");
+  }
+
+  const qint64 mem_available = installer::GetMemInfo().mem_available;
+  std::unique_ptr<installer::WritebackThrottle> throttle;
+  if (parser.isSet(low_memory_option) ||
+      (mem_available > 0 && mem_available < kLowMemoryThreshold)) {
+    const qint64 budget = qBound(kMinDirtyBudget,
+                                 mem_available / kDirtyBudgetRatio,
+                                 kMaxDirtyBudget);
+    throttle.reset(new installer::WritebackThrottle(quint64(budget)));
+    g_throttle = throttle.get();
+    fprintf(stdout, "low_memory: yes, dirty budget: %lld MiB\n",
+            budget / 1024 / 1024);
+  } else {
+    fprintf(stdout, "low_memory: no\n");
+  }
 
   const QString dest_dir = parser.value(dest_option);
   const QString progress_file = parser.value(progress_option);
+  fprintf(stdout, "jobs: %d\n", jobs);
 
-  if (!MountFs(src, mount_point)) {
-    fprintf(stderr, "Mount %s to %s failed!\n",
-            src.toLocal8Bit().constData(),
-            mount_point.toLocal8Bit().constData());
-    exit(kExitErr);
+  const qint64 start_time = QDateTime::currentMSecsSinceEpoch();
+
+  if (!parser.isSet(mount_option)) {
+    bool reader_ok = false;
+    const bool ok = ExtractFiles(layers, dest_dir, progress_file, jobs,
+                                 reader_ok);
+    if (reader_ok) {
+      if (!ok) {
+        fprintf(stderr, "Extract files failed!\n");
+      }
+      FinishProgress(QDateTime::currentMSecsSinceEpoch() - start_time);
+      exit(ok ? kExitOk : kExitErr);
+    }
+    fprintf(stderr, "Builtin reader failed, fallback to mount mode\n");
   }
 
-  const bool ok = CopyFiles(mount_point, dest_dir, progress_file);
-  if (!ok) {
-    fprintf(stderr, "Copy files failed!\n");
+  const qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
+  QStringList mount_points;
+  quint64 total_inodes = 0;
+  quint64 total_bytes = 0;
+  bool ok = true;
+  for (int i = 0; i < layers.length(); ++i) {
+    const QString& src = layers.at(i);
+    const QString mount_point(QString(kMountPointTmp).arg(
+        QString("%1-%2").arg(timestamp).arg(i)));
+    if (!MountFs(src, mount_point)) {
+      fprintf(stderr, "Mount %s to %s failed!\n",
+              src.toLocal8Bit().constData(),
+              mount_point.toLocal8Bit().constData());
+      ok = false;
+      break;
+    }
+    mount_points.append(mount_point);
+
+    quint64 inodes, bytes;
+    if (total_inodes > 0 || i == 0) {
+      if (CountImage(src, nullptr, inodes, bytes)) {
+        total_inodes += inodes;
+        total_bytes += bytes;
+      } else {
+        // Not a squashfs image, count files in mount points instead.
+        total_inodes = 0;
+        total_bytes = 0;
+      }
+    }
+  }
+
+  if (ok) {
+    OpenJournal(layers, dest_dir, "mount");
+    ok = CopyFiles(mount_points, dest_dir, progress_file, jobs,
+                   total_inodes, total_bytes);
+    CloseJournal(ok);
+    if (!ok) {
+      fprintf(stderr, "Copy files failed!\n");
+    } else if (g_verify) {
+      // Files replaced by upper layers are unknown in mount mode, so only
+      // single image is verified, after all files are copied.
+      if (layers.length() == 1) {
+        std::unique_ptr<installer::ManifestVerifier> verifier =
+            CreateVerifier(layers, dest_dir, jobs);
+        if (verifier && !verifier->finish()) {
+          fprintf(stderr, "Verify files failed!\n");
+          ok = false;
+        }
+      } else {
+        fprintf(stderr, "Verifying layers is not supported in mount mode\n");
+      }
+    }
+    FinishProgress(QDateTime::currentMSecsSinceEpoch() - start_time);
   }
 
   // Commit filesystem caches to disk.
 //  sync();
 
-  for (int retry = 0; retry < 5; ++retry) {
-    if (!UnMountFs(mount_point)) {
-      fprintf(stderr, "Unmount %s failed\n",
-              mount_point.toLocal8Bit().constData());
-      sleep((unsigned int)(retry * 2 + 1));
-    } else {
-      break;
+  for (const QString& mount_point : mount_points) {
+    for (int retry = 0; retry < 5; ++retry) {
+      if (!UnMountFs(mount_point)) {
+        fprintf(stderr, "Unmount %s failed\n",
+                mount_point.toLocal8Bit().constData());
+        sleep((unsigned int)(retry * 2 + 1));
+      } else {
+        break;
+      }
     }
   }
 
@@ -0,0 +1,632 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Benchmark of deepin-installer-unsquashfs, without running a full install.
+//  * Reproducible synthetic file trees are generated with --seed, like many
+//    small files, a few huge files, deep folders, files with many xattrs and
+//    symbolic link farms. Then each tree is packed with mksquashfs.
+//  * Each image is extracted into tmpfs and into a file backed ext4 image,
+//    with each extraction mode, like builtin reader, media order, and mount
+//    mode with sendfile() or read()/write().
+//  * For each extraction, files/s, MiB/s, read/write system calls per file
+//    and peak RSS of deepin-installer-unsquashfs are reported. Elapsed time
+//    includes syncfs() of target, so that dirty pages are counted too.
+// Page cache is dropped before each extraction. Mount mode and ext4 target
+// require root privilege, they are skipped if not run as root.
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/xattr.h>
+#include <time.h>
+#include <unistd.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <QCoreApplication>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include "base/command.h"
+#include "base/file_util.h"
+
+namespace {
+
+const char kAppName[] = "deepin-installer-unsquashfs-bench";
+const char kAppDesc[] = "Benchmark of deepin-installer-unsquashfs";
+const char kAppVersion[] = "0.0.1";
+
+const char kDefaultWorkDir[] = "/var/tmp/deepin-installer-unsquashfs-bench";
+const char kTmpfsDir[] = "/dev/shm/deepin-installer-unsquashfs-bench";
+const char kUnsquashfsName[] = "deepin-installer-unsquashfs";
+const char kDropCachesFile[] = "/proc/sys/vm/drop_caches";
+
+const int kExitOk = 0;
+const int kExitErr = 1;
+
+// Modification time of all generated items, so that images of the same seed
+// are identical.
+const time_t kMtime = 1500000000;
+
+// Content of generated files is written in pieces of this size, half of them
+// are random bytes and others are repeated text, so that compression ratio
+// is close to real system files.
+const size_t kPieceSize = 64 * 1024;
+
+const int kMaxOpenFd = 64;
+
+// Number of inodes and bytes of regular files in generated tree.
+struct TreeStats {
+  quint64 inodes = 0;
+  quint64 bytes = 0;
+};
+
+typedef bool (*GenerateFunc)(const std::string& root, int scale,
+                             std::mt19937& rng, TreeStats& stats);
+
+struct Profile {
+  const char* name;
+  GenerateFunc generate;
+};
+
+struct Mode {
+  QString name;
+  // Extra arguments of deepin-installer-unsquashfs.
+  QStringList args;
+  bool need_root;
+};
+
+struct Target {
+  QString name;
+  QString dir;
+};
+
+// Resource usage of one extraction.
+struct RunResult {
+  double seconds = 0;
+  double cpu_seconds = 0;
+  // Number of read and write system calls, from /proc/[pid]/io.
+  quint64 syscalls = 0;
+  // Peak RSS in KiB.
+  long max_rss = 0;
+};
+
+bool MakeDir(const std::string& path, TreeStats& stats) {
+  if (mkdir(path.c_str(), 0755) != 0) {
+    fprintf(stderr, "mkdir() failed: %s, %s\n", path.c_str(),
+            strerror(errno));
+    return false;
+  }
+  stats.inodes ++;
+  return true;
+}
+
+// Write a regular file of |size| bytes to |path|.
+bool MakeFile(const std::string& path, size_t size, std::mt19937& rng,
+              TreeStats& stats) {
+  const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                      0644);
+  if (fd == -1) {
+    fprintf(stderr, "open() failed: %s, %s\n", path.c_str(),
+            strerror(errno));
+    return false;
+  }
+  std::vector<char> buf(kPieceSize);
+  bool ok = true;
+  for (size_t offset = 0, piece = 0; ok && offset < size;
+       offset += kPieceSize, ++piece) {
+    const size_t len = std::min(kPieceSize, size - offset);
+    if (piece % 2 == 0) {
+      for (size_t i = 0; i < len; ++i) {
+        buf[i] = char(rng());
+      }
+    } else {
+      const char kText[] = "deepin-installer-unsquashfs-bench ";
+      for (size_t i = 0; i < len; ++i) {
+        buf[i] = kText[i % (sizeof(kText) - 1)];
+      }
+    }
+    ok = (write(fd, buf.data(), len) == ssize_t(len));
+  }
+  if (close(fd) != 0 || !ok) {
+    fprintf(stderr, "write() failed: %s\n", path.c_str());
+    return false;
+  }
+  stats.inodes ++;
+  stats.bytes += size;
+  return true;
+}
+
+// Many small files, 200 in each folder.
+bool GenerateSmallFiles(const std::string& root, int scale,
+                        std::mt19937& rng, TreeStats& stats) {
+  const int num_files = 20000 * scale;
+  const int files_per_dir = 200;
+  for (int i = 0; i < num_files; ++i) {
+    const std::string dir = root + "/d" + std::to_string(i / files_per_dir);
+    if (i % files_per_dir == 0 && !MakeDir(dir, stats)) {
+      return false;
+    }
+    // Most files are less than 4K, some are up to 64K.
+    const size_t size = rng() % ((rng() % 4 == 0) ? 65536 : 4096);
+    if (!MakeFile(dir + "/f" + std::to_string(i), size, rng, stats)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// A few huge files.
+bool GenerateHugeFiles(const std::string& root, int scale,
+                       std::mt19937& rng, TreeStats& stats) {
+  const size_t size = size_t(128) * 1024 * 1024 * size_t(scale);
+  for (int i = 0; i < 4; ++i) {
+    if (!MakeFile(root + "/huge" + std::to_string(i), size, rng, stats)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Chains of deep folders, with a small file in each level.
+bool GenerateDeepDirs(const std::string& root, int scale,
+                      std::mt19937& rng, TreeStats& stats) {
+  const int num_chains = 200 * scale;
+  const int depth = 40;
+  for (int i = 0; i < num_chains; ++i) {
+    std::string dir = root + "/chain" + std::to_string(i);
+    for (int level = 0; level < depth; ++level) {
+      if (!MakeDir(dir, stats) ||
+          !MakeFile(dir + "/f", rng() % 2048, rng, stats)) {
+        return false;
+      }
+      dir += "/l" + std::to_string(level);
+    }
+  }
+  return true;
+}
+
+// Small files with many extended attributes.
+bool GenerateXAttrFiles(const std::string& root, int scale,
+                        std::mt19937& rng, TreeStats& stats) {
+  const int num_files = 5000 * scale;
+  const int files_per_dir = 500;
+  const int xattrs_per_file = 8;
+  for (int i = 0; i < num_files; ++i) {
+    const std::string dir = root + "/d" + std::to_string(i / files_per_dir);
+    if (i % files_per_dir == 0 && !MakeDir(dir, stats)) {
+      return false;
+    }
+    const std::string path = dir + "/f" + std::to_string(i);
+    if (!MakeFile(path, rng() % 4096, rng, stats)) {
+      return false;
+    }
+    for (int j = 0; j < xattrs_per_file; ++j) {
+      const std::string name = "user.bench." + std::to_string(j);
+      std::string value(32 + rng() % 224, 'x');
+      for (char& c : value) {
+        c = char('a' + rng() % 26);
+      }
+      if (setxattr(path.c_str(), name.c_str(), value.data(), value.size(),
+                   0) != 0) {
+        fprintf(stderr, "setxattr() failed: %s, %s\n", path.c_str(),
+                strerror(errno));
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Farm of symbolic links to a few files, some of them are dangling.
+bool GenerateSymlinks(const std::string& root, int scale,
+                      std::mt19937& rng, TreeStats& stats) {
+  const int num_targets = 1000;
+  const int num_links = 20000 * scale;
+  const int links_per_dir = 500;
+  const std::string target_dir = root + "/targets";
+  if (!MakeDir(target_dir, stats)) {
+    return false;
+  }
+  for (int i = 0; i < num_targets; ++i) {
+    if (!MakeFile(target_dir + "/f" + std::to_string(i), rng() % 4096, rng,
+                  stats)) {
+      return false;
+    }
+  }
+  for (int i = 0; i < num_links; ++i) {
+    const std::string dir = root + "/links" +
+                            std::to_string(i / links_per_dir);
+    if (i % links_per_dir == 0 && !MakeDir(dir, stats)) {
+      return false;
+    }
+    const std::string target = (i % 50 == 0) ?
+        "../targets/missing" + std::to_string(i) :
+        "../targets/f" + std::to_string(rng() % num_targets);
+    const std::string path = dir + "/l" + std::to_string(i);
+    if (symlink(target.c_str(), path.c_str()) != 0) {
+      fprintf(stderr, "symlink() failed: %s, %s\n", path.c_str(),
+              strerror(errno));
+      return false;
+    }
+    stats.inodes ++;
+  }
+  return true;
+}
+
+const Profile kProfiles[] = {
+  { "small", GenerateSmallFiles },
+  { "huge", GenerateHugeFiles },
+  { "deep", GenerateDeepDirs },
+  { "xattr", GenerateXAttrFiles },
+  { "symlink", GenerateSymlinks },
+};
+
+QList<Mode> GetModes() {
+  return {
+    { "native", {}, false },
+    { "native-media", { "--media-order" }, false },
+    { "mount-sendfile", { "--mount" }, true },
+    { "mount-rw", { "--mount", "--no-sendfile" }, true },
+  };
+}
+
+// Tree walk handler, reset modification time of each item.
+int SetItemTime(const char* fpath, const struct stat* sb, int typeflag,
+                struct FTW* ftwbuf) {
+  Q_UNUSED(sb);
+  Q_UNUSED(typeflag);
+  Q_UNUSED(ftwbuf);
+  const struct timespec times[2] = { { kMtime, 0 }, { kMtime, 0 } };
+  if (utimensat(AT_FDCWD, fpath, times, AT_SYMLINK_NOFOLLOW) != 0) {
+    fprintf(stderr, "utimensat() failed: %s, %s\n", fpath, strerror(errno));
+    return 1;
+  }
+  return 0;
+}
+
+// Generate tree of |profile| at |root| and pack it into |image|.
+bool GenerateImage(const Profile& profile, const QString& root,
+                   const QString& image, int scale, unsigned int seed,
+                   const QString& comp, TreeStats& stats) {
+  QDir(root).removeRecursively();
+  QFile::remove(image);
+  if (!installer::CreateParentDirs(root) ||
+      !installer::CreateParentDirs(image)) {
+    fprintf(stderr, "Failed to create work dir of %s\n", profile.name);
+    return false;
+  }
+  const std::string root_path = root.toStdString();
+  std::mt19937 rng(seed);
+  stats = TreeStats();
+  if (!MakeDir(root_path, stats) ||
+      !profile.generate(root_path, scale, rng, stats)) {
+    return false;
+  }
+  // Folders are visited after their children, as creating files in folder
+  // updates its modification time.
+  if (nftw(root_path.c_str(), SetItemTime, kMaxOpenFd,
+           FTW_PHYS | FTW_DEPTH) != 0) {
+    return false;
+  }
+
+  QString output, err;
+  if (!installer::SpawnCmd("mksquashfs",
+                           { root, image, "-noappend", "-no-progress",
+                             "-comp", comp },
+                           output, err)) {
+    fprintf(stderr, "mksquashfs failed: %s\n", err.toLocal8Bit().constData());
+    return false;
+  }
+  return true;
+}
+
+// Drop page cache, so that image is read from disk again.
+void DropCaches() {
+  sync();
+  if (!installer::WriteTextFile(kDropCachesFile, "3")) {
+    fprintf(stderr, "Failed to drop caches\n");
+  }
+}
+
+double GetMonotonicTime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Read number of read and write system calls of exited but not reaped
+// process |pid|.
+quint64 ReadSyscalls(pid_t pid) {
+  const QString content = installer::ReadFile(
+      QString("/proc/%1/io").arg(pid));
+  quint64 syscalls = 0;
+  for (const QString& line : content.split('\n')) {
+    if (line.startsWith("syscr:") || line.startsWith("syscw:")) {
+      syscalls += line.section(':', 1).trimmed().toULongLong();
+    }
+  }
+  return syscalls;
+}
+
+// Run |program| with |args| to extract files into |dest_dir|, output of it
+// is appended to |log_file|. Returns false if it failed.
+bool RunUnsquashfs(const QString& program, const QStringList& args,
+                   const QString& dest_dir, const QString& log_file,
+                   RunResult& result) {
+  std::vector<std::string> arg_strs;
+  arg_strs.push_back(program.toStdString());
+  for (const QString& arg : args) {
+    arg_strs.push_back(arg.toStdString());
+  }
+  std::vector<char*> argv;
+  for (std::string& arg : arg_strs) {
+    argv.push_back(&arg[0]);
+  }
+  argv.push_back(nullptr);
+  const std::string log_path = log_file.toStdString();
+
+  const double start_time = GetMonotonicTime();
+  const pid_t pid = fork();
+  if (pid == -1) {
+    perror("fork()");
+    return false;
+  }
+  if (pid == 0) {
+    const int log_fd = open(log_path.c_str(),
+                            O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (log_fd != -1) {
+      dup2(log_fd, STDOUT_FILENO);
+      dup2(log_fd, STDERR_FILENO);
+      close(log_fd);
+    }
+    execvp(argv[0], argv.data());
+    _exit(127);
+  }
+
+  // Keep exited process as zombie, so that its io counters can be read.
+  siginfo_t info;
+  if (waitid(P_PID, id_t(pid), &info, WEXITED | WNOWAIT) == 0) {
+    result.syscalls = ReadSyscalls(pid);
+  }
+  int status = 0;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) != pid) {
+    perror("wait4()");
+    return false;
+  }
+
+  // Write back dirty pages of target.
+  const int dest_fd = open(dest_dir.toLocal8Bit().constData(),
+                           O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dest_fd != -1) {
+    syncfs(dest_fd);
+    close(dest_fd);
+  }
+  result.seconds = GetMonotonicTime() - start_time;
+  result.cpu_seconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                       usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+  result.max_rss = usage.ru_maxrss;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Create ext4 filesystem in |image| of |size_mib| MiB and mount it at
+// |mount_point|.
+bool MountExt4Image(const QString& image, int size_mib,
+                    const QString& mount_point) {
+  QFile file(image);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+      !file.resize(qint64(size_mib) * 1024 * 1024)) {
+    fprintf(stderr, "Failed to create ext4 image: %s\n",
+            image.toLocal8Bit().constData());
+    return false;
+  }
+  file.close();
+  return installer::SpawnCmd("mkfs.ext4", { "-q", "-F", image }) &&
+         installer::CreateDirs(mount_point) &&
+         installer::SpawnCmd("mount", { "-o", "loop", image, mount_point });
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  QCoreApplication app(argc, argv);
+  app.setApplicationName(kAppName);
+  app.setApplicationVersion(kAppVersion);
+
+  QCommandLineParser parser;
+  const QCommandLineOption work_dir_option(
+      "work-dir", "folder to store generated trees, images and ext4 image",
+      "dir", kDefaultWorkDir);
+  parser.addOption(work_dir_option);
+  const QCommandLineOption seed_option(
+      "seed", "seed of random generator, same seed generates same trees",
+      "seed", "1");
+  parser.addOption(seed_option);
+  const QCommandLineOption scale_option(
+      "scale", "multiply number of files in each tree", "scale", "1");
+  parser.addOption(scale_option);
+  const QCommandLineOption comp_option(
+      "comp", "compression algorithm of mksquashfs", "comp", "xz");
+  parser.addOption(comp_option);
+  const QCommandLineOption jobs_option(
+      "jobs", "--jobs of deepin-installer-unsquashfs, 0 for all cpu cores",
+      "jobs", "0");
+  parser.addOption(jobs_option);
+  const QCommandLineOption profiles_option(
+      "profiles", "comma separated trees: small,huge,deep,xattr,symlink",
+      "profiles");
+  parser.addOption(profiles_option);
+  const QCommandLineOption modes_option(
+      "modes", "comma separated extraction modes: "
+      "native,native-media,mount-sendfile,mount-rw",
+      "modes");
+  parser.addOption(modes_option);
+  const QCommandLineOption ext4_size_option(
+      "ext4-size", "size of ext4 image in MiB, 0 to skip ext4 target",
+      "size", "8192");
+  parser.addOption(ext4_size_option);
+  const QCommandLineOption unsquashfs_option(
+      "unsquashfs", "path to deepin-installer-unsquashfs, defaults to the "
+      "one next to this program",
+      "file");
+  parser.addOption(unsquashfs_option);
+  const QCommandLineOption keep_option(
+      "keep", "keep generated trees and images");
+  parser.addOption(keep_option);
+  parser.setApplicationDescription(kAppDesc);
+  parser.addHelpOption();
+  parser.addVersionOption();
+
+  if (!parser.parse(app.arguments())) {
+    parser.showHelp(kExitErr);
+  }
+  if (parser.isSet("version") || parser.isSet("help")) {
+    parser.showHelp(kExitOk);
+  }
+
+  const QString work_dir = QDir(parser.value(work_dir_option)).absolutePath();
+  const unsigned int seed = parser.value(seed_option).toUInt();
+  const int scale = qMax(1, parser.value(scale_option).toInt());
+  const QString comp = parser.value(comp_option);
+  const QString jobs = parser.value(jobs_option);
+  const int ext4_size = parser.value(ext4_size_option).toInt();
+  const QStringList profile_names = parser.value(profiles_option).split(
+      ',', QString::SkipEmptyParts);
+  const QStringList mode_names = parser.value(modes_option).split(
+      ',', QString::SkipEmptyParts);
+  const bool is_root = (geteuid() == 0);
+
+  QString unsquashfs = parser.value(unsquashfs_option);
+  if (unsquashfs.isEmpty()) {
+    unsquashfs = QDir(app.applicationDirPath()).filePath(kUnsquashfsName);
+    if (!QFile::exists(unsquashfs)) {
+      // Search in PATH.
+      unsquashfs = kUnsquashfsName;
+    }
+  }
+
+  QList<Target> targets;
+  if (installer::CreateDirs(kTmpfsDir)) {
+    targets.append({ "tmpfs", kTmpfsDir });
+  } else {
+    fprintf(stderr, "Failed to create %s, skip tmpfs target\n", kTmpfsDir);
+  }
+  const QString ext4_image = QDir(work_dir).filePath("ext4.img");
+  const QString ext4_dir = QDir(work_dir).filePath("ext4");
+  bool ext4_mounted = false;
+  if (ext4_size > 0 && !is_root) {
+    fprintf(stderr, "Not run as root, skip ext4 target\n");
+  } else if (ext4_size > 0) {
+    if (installer::CreateDirs(work_dir) &&
+        MountExt4Image(ext4_image, ext4_size, ext4_dir)) {
+      ext4_mounted = true;
+      targets.append({ "ext4", ext4_dir });
+    } else {
+      fprintf(stderr, "Failed to mount ext4 image, skip ext4 target\n");
+    }
+  }
+  if (!is_root) {
+    fprintf(stderr, "Not run as root, skip mount modes and page cache is "
+            "not dropped\n");
+  }
+
+  const QString log_file = QDir(work_dir).filePath("unsquashfs.log");
+  fprintf(stdout, "%-8s %-6s %-15s %8s %8s %9s %8s %9s %8s\n",
+          "profile", "target", "mode", "files", "seconds", "files/s",
+          "MiB/s", "sysc/file", "rss MiB");
+  bool ok = true;
+  for (const Profile& profile : kProfiles) {
+    if (!profile_names.isEmpty() && !profile_names.contains(profile.name)) {
+      continue;
+    }
+    const QString root = QDir(work_dir).filePath(
+        QString("trees/%1").arg(profile.name));
+    const QString image = QDir(work_dir).filePath(
+        QString("images/%1.squashfs").arg(profile.name));
+    TreeStats stats;
+    if (!GenerateImage(profile, root, image, scale, seed, comp, stats)) {
+      fprintf(stderr, "Failed to generate image of %s\n", profile.name);
+      ok = false;
+      break;
+    }
+    if (!parser.isSet(keep_option)) {
+      QDir(root).removeRecursively();
+    }
+
+    for (const Target& target : targets) {
+      for (const Mode& mode : GetModes()) {
+        if (!mode_names.isEmpty() && !mode_names.contains(mode.name)) {
+          continue;
+        }
+        if (mode.need_root && !is_root) {
+          continue;
+        }
+        const QString dest_dir = QDir(target.dir).filePath(profile.name);
+        QDir(dest_dir).removeRecursively();
+        if (is_root) {
+          DropCaches();
+        }
+        RunResult result;
+        const QStringList args = QStringList{ "--dest", dest_dir,
+                                              "--jobs", jobs } +
+                                 mode.args + QStringList{ image };
+        if (!RunUnsquashfs(unsquashfs, args, dest_dir, log_file, result)) {
+          fprintf(stderr, "Extract %s into %s with %s failed, see %s\n",
+                  profile.name, target.name.toLocal8Bit().constData(),
+                  mode.name.toLocal8Bit().constData(),
+                  log_file.toLocal8Bit().constData());
+          ok = false;
+        } else {
+          const double seconds = qMax(result.seconds, 0.001);
+          fprintf(stdout, "%-8s %-6s %-15s %8llu %8.2f %9.0f %8.1f %9.1f "
+                  "%8.1f\n",
+                  profile.name, target.name.toLocal8Bit().constData(),
+                  mode.name.toLocal8Bit().constData(), stats.inodes, seconds,
+                  stats.inodes / seconds,
+                  stats.bytes / 1024.0 / 1024.0 / seconds,
+                  double(result.syscalls) / qMax(stats.inodes, quint64(1)),
+                  result.max_rss / 1024.0);
+          fflush(stdout);
+        }
+        QDir(dest_dir).removeRecursively();
+      }
+    }
+
+    if (!parser.isSet(keep_option)) {
+      QFile::remove(image);
+    }
+  }
+
+  if (ext4_mounted) {
+    installer::SpawnCmd("umount", { ext4_dir });
+    QFile::remove(ext4_image);
+  }
+  QDir(kTmpfsDir).removeRecursively();
+
+  return ok ? kExitOk : kExitErr;
+}
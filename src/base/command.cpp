@@ -17,13 +17,322 @@
 
 #include "base/command.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
 #include <QDebug>
 #include <QDir>
-#include <QProcess>
-#include <QThread>
+#include <QElapsedTimer>
+#include <QVector>
+
+#include "base/trace.h"
+
+extern char** environ;
 
 namespace installer {
 
+namespace {
+
+// Category of command events in trace.
+const char kTraceCategory[] = "command";
+
+// Interval of checking whether command exits, which grows from min value to
+// max value, so that short commands are reaped quickly.
+const int kMinPollInterval = 1;
+const int kMaxPollInterval = 100;
+
+// Terminated command is killed if it does not quit in 3000ms.
+const int kKillTimeout = 3000;
+
+const int kReadBufferSize = 64 * 1024;
+
+// Name of |cmd| in trace, like "mkfs.ext4".
+QString GetTraceName(const QString& cmd) {
+  return QFileInfo(cmd).fileName();
+}
+
+qint64 GetRusageMs(const struct rusage& usage) {
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+}
+
+// Captures output of command from a pipe, and splits it into lines.
+struct OutputChannel {
+  int fd = -1;
+  QByteArray data;
+  // Incomplete last line.
+  QByteArray line;
+  const std::function<void(const QString& line)>* callback = nullptr;
+
+  void append(const char* buf, ssize_t len) {
+    data.append(buf, int(len));
+    if (callback == nullptr || !(*callback)) {
+      return;
+    }
+    line.append(buf, int(len));
+    int index;
+    while ((index = line.indexOf('\n')) != -1) {
+      (*callback)(QString::fromUtf8(line.constData(), index));
+      line.remove(0, index + 1);
+    }
+  }
+
+  void close() {
+    if (fd != -1) {
+      ::close(fd);
+      fd = -1;
+    }
+    if (!line.isEmpty() && callback != nullptr && (*callback)) {
+      (*callback)(QString::fromUtf8(line));
+    }
+    line.clear();
+  }
+};
+
+// Read from channels which are ready in |timeout_ms|. Returns false if no
+// channel is ready.
+bool ReadChannels(OutputChannel* channels[], int count, int timeout_ms) {
+  struct pollfd fds[2];
+  OutputChannel* polled[2];
+  int nfds = 0;
+  for (int i = 0; i < count; ++i) {
+    if (channels[i]->fd != -1) {
+      fds[nfds].fd = channels[i]->fd;
+      fds[nfds].events = POLLIN;
+      fds[nfds].revents = 0;
+      polled[nfds] = channels[i];
+      nfds++;
+    }
+  }
+
+  const int ready = poll(fds, nfds, timeout_ms);
+  if (ready <= 0) {
+    return false;
+  }
+  char buf[kReadBufferSize];
+  for (int i = 0; i < nfds; ++i) {
+    if (fds[i].revents == 0) {
+      continue;
+    }
+    const ssize_t len = read(fds[i].fd, buf, sizeof(buf));
+    if (len > 0) {
+      polled[i]->append(buf, len);
+    } else if (len == 0 || (errno != EINTR && errno != EAGAIN)) {
+      polled[i]->close();
+    }
+  }
+  return true;
+}
+
+// Run |cmd| once. Remaining time is |timeout_ms|, -1 means no limit.
+void RunCmdOnce(const QString& cmd, const QStringList& args,
+                const CommandOptions& options, int timeout_ms,
+                const std::atomic<bool>* canceled, CommandResult& result) {
+  OutputChannel out_channel;
+  OutputChannel err_channel;
+  out_channel.callback = &options.stdout_line;
+  err_channel.callback = &options.stderr_line;
+  OutputChannel* channels[2] = { &out_channel, &err_channel };
+
+  // Pipes are not inherited by commands started by other threads.
+  int out_pipe[2] = { -1, -1 };
+  int err_pipe[2] = { -1, -1 };
+  if (options.capture_output &&
+      (pipe2(out_pipe, O_CLOEXEC) != 0 || pipe2(err_pipe, O_CLOEXEC) != 0)) {
+    qCritical() << "RunCmd() failed to create pipe:" << strerror(errno);
+    for (int fd : { out_pipe[0], out_pipe[1], err_pipe[0], err_pipe[1] }) {
+      if (fd != -1) {
+        close(fd);
+      }
+    }
+    result.exit_code = -1;
+    return;
+  }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+                                   O_RDONLY, 0);
+  if (options.capture_output) {
+    posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, err_pipe[1], STDERR_FILENO);
+  }
+
+  const QByteArray program = cmd.toLocal8Bit();
+  QList<QByteArray> arg_list = { program };
+  for (const QString& arg : args) {
+    arg_list.append(arg.toLocal8Bit());
+  }
+  QVector<char*> argv;
+  for (QByteArray& arg : arg_list) {
+    argv.append(arg.data());
+  }
+  argv.append(nullptr);
+
+  // Reset signals ignored or blocked by current process, like SIGPIPE.
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  sigset_t signals;
+  sigemptyset(&signals);
+  posix_spawnattr_setsigmask(&attr, &signals);
+  sigaddset(&signals, SIGPIPE);
+  posix_spawnattr_setsigdefault(&attr, &signals);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK |
+                                  POSIX_SPAWN_SETSIGDEF);
+
+  pid_t pid = -1;
+  const int spawn_err = posix_spawnp(&pid, program.constData(), &actions,
+                                     &attr, argv.data(), environ);
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+  if (options.capture_output) {
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+    out_channel.fd = out_pipe[0];
+    err_channel.fd = err_pipe[0];
+  }
+  if (spawn_err != 0) {
+    qWarning() << "RunCmd() failed to start:" << cmd << strerror(spawn_err);
+    out_channel.close();
+    err_channel.close();
+    result.exit_code = -1;
+    return;
+  }
+
+  QElapsedTimer timer;
+  timer.start();
+  int status = 0;
+  struct rusage usage;
+  memset(&usage, 0, sizeof(usage));
+  bool reaped = false;
+  qint64 kill_time = -1;
+  int interval = kMinPollInterval;
+  while (true) {
+    const pid_t ret = wait4(pid, &status, WNOHANG, &usage);
+    if (ret == pid) {
+      reaped = true;
+      break;
+    }
+    if (ret == -1 && errno != EINTR) {
+      qCritical() << "RunCmd() failed to wait for:" << cmd << strerror(errno);
+      break;
+    }
+
+    const qint64 elapsed = timer.elapsed();
+    if (kill_time == -1) {
+      const bool is_canceled = (canceled != nullptr && canceled->load());
+      const bool is_timed_out = (timeout_ms >= 0 && elapsed >= timeout_ms);
+      if (is_canceled || is_timed_out) {
+        result.canceled = is_canceled;
+        result.timed_out = !is_canceled;
+        kill(pid, SIGTERM);
+        kill_time = elapsed + kKillTimeout;
+      }
+    } else if (elapsed >= kill_time) {
+      kill(pid, SIGKILL);
+    }
+
+    if (ReadChannels(channels, 2, interval)) {
+      interval = kMinPollInterval;
+    } else {
+      interval = qMin(interval * 2, kMaxPollInterval);
+    }
+  }
+
+  // Children of command may still keep pipes open, so only read data
+  // available now instead of waiting for end of file.
+  while ((out_channel.fd != -1 || err_channel.fd != -1) &&
+         ReadChannels(channels, 2, 0)) {
+    // Continue.
+  }
+  out_channel.close();
+  err_channel.close();
+
+  result.output += QString::fromUtf8(out_channel.data);
+  result.err += QString::fromUtf8(err_channel.data);
+  result.cpu_ms += GetRusageMs(usage);
+  if (reaped && WIFEXITED(status)) {
+    result.exit_code = WEXITSTATUS(status);
+    result.ok = (result.exit_code == 0);
+  } else {
+    result.exit_code = -1;
+  }
+}
+
+// Sleep |ms| milliseconds, unless |canceled| is set.
+void SleepUnlessCanceled(int ms, const std::atomic<bool>* canceled) {
+  QElapsedTimer timer;
+  timer.start();
+  while (timer.elapsed() < ms && !(canceled != nullptr && canceled->load())) {
+    const qint64 remaining = ms - timer.elapsed();
+    std::this_thread::sleep_for(
+        std::chrono::milliseconds(qMin(remaining, qint64(kMaxPollInterval))));
+  }
+}
+
+CommandResult RunCmdInternal(const QString& cmd, const QStringList& args,
+                             const CommandOptions& options,
+                             const std::atomic<bool>* canceled) {
+  ScopedTrace trace(kTraceCategory, GetTraceName(cmd),
+                    {{"cmd", cmd}, {"args", args.join(' ')}});
+  CommandResult result;
+  QElapsedTimer timer;
+  timer.start();
+  const int max_attempts = qMax(options.retry.max_attempts, 1);
+  while (result.attempts < max_attempts) {
+    int remaining = -1;
+    if (options.timeout_ms >= 0) {
+      remaining = int(qMax(options.timeout_ms - timer.elapsed(), qint64(0)));
+    }
+    result.attempts++;
+    result.ok = false;
+    RunCmdOnce(cmd, args, options, remaining, canceled, result);
+    if (result.ok || result.canceled || result.timed_out) {
+      break;
+    }
+
+    if (result.attempts < max_attempts) {
+      qWarning() << "Command failed, retry:" << cmd << args
+                 << result.exit_code;
+      int delay = options.retry.delay_ms;
+      if (options.timeout_ms >= 0) {
+        delay = int(qMin(qint64(delay),
+                         options.timeout_ms - timer.elapsed()));
+      }
+      SleepUnlessCanceled(delay, canceled);
+      if (canceled != nullptr && canceled->load()) {
+        result.canceled = true;
+        break;
+      }
+      if (options.timeout_ms >= 0 && timer.elapsed() >= options.timeout_ms) {
+        result.timed_out = true;
+        break;
+      }
+    }
+  }
+  result.wall_ms = timer.elapsed();
+
+  trace.addArg("exit_code", result.exit_code);
+  trace.addArg("attempts", result.attempts);
+  trace.addArg("cpu_ms", result.cpu_ms);
+  if (result.timed_out) {
+    trace.addArg("timed_out", true);
+  }
+  if (result.canceled) {
+    trace.addArg("canceled", true);
+  }
+  return result;
+}
+
+}  // namespace
+
 bool RunScriptFile(const QStringList& args) {
   Q_ASSERT(!args.isEmpty());
   if (args.isEmpty()) {
@@ -62,16 +371,10 @@ bool RunScriptFile(const QStringList& args, QString& output, QString& err) {
 }
 
 bool SpawnCmd(const QString& cmd, const QStringList& args) {
-  QProcess process;
-  process.setProgram(cmd);
-  process.setArguments(args);
+  CommandOptions options;
   // Merge stdout and stderr of subprocess with main process.
-  process.setProcessChannelMode(QProcess::ForwardedChannels);
-  process.start();
-  // Wait for process to finish without timeout.
-  process.waitForFinished(-1);
-  return (process.exitStatus() == QProcess::NormalExit &&
-          process.exitCode() == 0);
+  options.capture_output = false;
+  return RunCmd(cmd, args, options).ok;
 }
 
 bool SpawnCmd(const QString& cmd, const QStringList& args, QString& output) {
@@ -81,29 +384,81 @@ bool SpawnCmd(const QString& cmd, const QStringList& args, QString& output) {
 
 bool SpawnCmd(const QString& cmd, const QStringList& args,
               QString& output, QString& err) {
+  const CommandResult result = RunCmd(cmd, args);
+  output += result.output;
+  err += result.err;
+  return result.ok;
+}
 
-    uint loop_num = 0;
-    QProcess process;
-    process.setProgram(cmd);
-    process.setArguments(args);
+CommandResult RunCmd(const QString& cmd, const QStringList& args,
+                     const CommandOptions& options) {
+  return RunCmdInternal(cmd, args, options, nullptr);
+}
 
-    // try 2
-    while (loop_num++ < 2) {
-        process.start();
-        // Wait for process to finish without timeout.
-        process.waitForFinished(-1);
-        output += process.readAllStandardOutput();
-        err += process.readAllStandardError();
+CommandJob::CommandJob(const QString& cmd, const QStringList& args,
+                       const CommandOptions& options)
+    : cmd_(cmd),
+      args_(args),
+      options_(options),
+      canceled_(false) {
+}
 
-        if (process.exitStatus() == QProcess::NormalExit && process.exitCode() == 0) {
-            return true;
-        }
-        qDebug() << err;
-        qDebug() << "try again!!!!!";
-        QThread::sleep(1);
+CommandJob::~CommandJob() {
+  if (thread_.joinable()) {
+    this->cancel();
+    thread_.join();
+  }
+}
+
+void CommandJob::start() {
+  Q_ASSERT(!thread_.joinable());
+  if (thread_.joinable()) {
+    qCritical() << "CommandJob::start() is called twice:" << cmd_;
+    return;
+  }
+  thread_ = std::thread([this]() {
+    CommandResult result = RunCmdInternal(cmd_, args_, options_, &canceled_);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      result_ = result;
+      finished_ = true;
     }
+    finished_cond_.notify_all();
+  });
+}
 
-    return false;
+void CommandJob::cancel() {
+  canceled_ = true;
+}
+
+bool CommandJob::isFinished() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return finished_;
+}
+
+bool CommandJob::wait(int timeout_ms) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (timeout_ms < 0) {
+    finished_cond_.wait(lock, [this]() { return finished_; });
+    return true;
+  }
+  return finished_cond_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                 [this]() { return finished_; });
+}
+
+bool WaitForCommandJobs(const QList<CommandJob*>& jobs, int timeout_ms) {
+  QElapsedTimer timer;
+  timer.start();
+  for (CommandJob* job : jobs) {
+    int remaining = -1;
+    if (timeout_ms >= 0) {
+      remaining = int(qMax(timeout_ms - timer.elapsed(), qint64(0)));
+    }
+    if (!job->wait(remaining)) {
+      return false;
+    }
+  }
+  return true;
 }
 
 }  // namespace installer
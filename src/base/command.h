@@ -18,10 +18,126 @@
 #ifndef INSTALLER_BASE_COMMAND_H
 #define INSTALLER_BASE_COMMAND_H
 
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <QList>
 #include <QStringList>
 
 namespace installer {
 
+// Retry policy of commands. Commands are not retried by default.
+struct CommandRetryPolicy {
+  // Total number of runs, including the first one.
+  int max_attempts = 1;
+
+  // Delay between two attempts, in milliseconds.
+  int delay_ms = 0;
+};
+
+struct CommandOptions {
+  CommandRetryPolicy retry;
+
+  // Command is terminated if it is not finished in |timeout_ms|, including
+  // all attempts and delays between them. -1 means no timeout.
+  int timeout_ms = -1;
+
+  // If true, stdout and stderr of command are captured, else they are
+  // forwarded to stdout and stderr of current process.
+  bool capture_output = true;
+
+  // Called with each line of stdout and stderr, without trailing newline.
+  // Only used if |capture_output| is true. Callbacks of CommandJob are
+  // called in its background thread.
+  std::function<void(const QString& line)> stdout_line;
+  std::function<void(const QString& line)> stderr_line;
+};
+
+struct CommandResult {
+  // True if command exited with 0.
+  bool ok = false;
+
+  // Exit code of last attempt, or -1 if it failed to start or was killed
+  // by signal.
+  int exit_code = -1;
+
+  // Number of runs.
+  int attempts = 0;
+
+  // Command is terminated because of timeout or cancel().
+  bool timed_out = false;
+  bool canceled = false;
+
+  // Captured stdout and stderr of all attempts.
+  QString output;
+  QString err;
+
+  // Wall time of all attempts, and cpu time (user + system) used by command
+  // and its children, in milliseconds.
+  qint64 wall_ms = 0;
+  qint64 cpu_ms = 0;
+};
+
+// Run |cmd| with |args| and wait for it to finish. |cmd| is searched in PATH
+// if it is not an absolute path.
+CommandResult RunCmd(const QString& cmd, const QStringList& args,
+                     const CommandOptions& options = CommandOptions());
+
+// Runs a command in a background thread, so that many commands can be run
+// at the same time, see WaitForCommandJobs().
+// Usage:
+//   CommandJob job("dumpe2fs", {"-h", path});
+//   job.start();
+//   ...
+//   if (job.wait(5000) && job.result().ok) {
+//     ...
+//   }
+class CommandJob {
+ public:
+  CommandJob(const QString& cmd, const QStringList& args,
+             const CommandOptions& options = CommandOptions());
+  // Cancel command if it is still running, and wait for it to quit.
+  ~CommandJob();
+
+  CommandJob(const CommandJob&) = delete;
+  CommandJob& operator=(const CommandJob&) = delete;
+
+  // Start command. It shall be called only once.
+  void start();
+
+  // Terminate command and skip all remaining attempts. Command is killed if
+  // it does not quit in a few seconds. Returns immediately.
+  void cancel();
+
+  bool isFinished() const;
+
+  // Wait at most |timeout_ms| for command to finish, -1 means no limit.
+  // Returns true if command is finished.
+  bool wait(int timeout_ms = -1);
+
+  // Result of command, only valid after it is finished.
+  const CommandResult& result() const { return result_; }
+
+ private:
+  QString cmd_;
+  QStringList args_;
+  CommandOptions options_;
+
+  std::thread thread_;
+  std::atomic<bool> canceled_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable finished_cond_;
+  bool finished_ = false;
+  CommandResult result_;
+};
+
+// Wait at most |timeout_ms| for all started |jobs| to finish, -1 means no
+// limit. Returns true if all of them are finished.
+bool WaitForCommandJobs(const QList<CommandJob*>& jobs, int timeout_ms = -1);
+
 // Run a script file in bash, no matter it is executable or not.
 // First argument in |args| is the path to script file.
 // Current working directory is changed to folder of |args[0]|.
@@ -30,7 +146,8 @@ namespace installer {
 bool RunScriptFile(const QStringList& args);
 bool RunScriptFile(const QStringList& args, QString& output, QString& err);
 
-// Run |cmd| with |args| in background and returns its result.
+// Run |cmd| with |args| and returns true if it exited with 0. It is not
+// retried on failure, use RunCmd() with a retry policy instead.
 bool SpawnCmd(const QString& cmd, const QStringList& args);
 bool SpawnCmd(const QString& cmd, const QStringList& args, QString& output);
 bool SpawnCmd(const QString& cmd, const QStringList& args, QString& output,
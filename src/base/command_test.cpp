@@ -38,5 +38,68 @@ TEST(CommandTest, SpawnCmd) {
   EXPECT_GT(output.indexOf("root"), 0);
 }
 
+TEST(CommandTest, SpawnCmdNotFound) {
+  EXPECT_FALSE(SpawnCmd("installer-command-not-found", {}));
+  EXPECT_FALSE(SpawnCmd("false", {}));
+}
+
+TEST(CommandTest, RunCmd) {
+  QStringList lines;
+  CommandOptions options;
+  options.stdout_line = [&](const QString& line) { lines.append(line); };
+  const CommandResult result = RunCmd(
+      "sh", {"-c", "printf 'a\\nb\\nc'; echo err >&2; exit 3"}, options);
+  EXPECT_FALSE(result.ok);
+  EXPECT_EQ(result.exit_code, 3);
+  EXPECT_EQ(result.attempts, 1);
+  EXPECT_EQ(result.output, "a\nb\nc");
+  EXPECT_EQ(result.err, "err\n");
+  EXPECT_EQ(lines, QStringList({"a", "b", "c"}));
+}
+
+TEST(CommandTest, RunCmdRetry) {
+  CommandOptions options;
+  options.retry.max_attempts = 3;
+  CommandResult result = RunCmd("false", {}, options);
+  EXPECT_FALSE(result.ok);
+  EXPECT_EQ(result.attempts, 3);
+
+  result = RunCmd("true", {}, options);
+  EXPECT_TRUE(result.ok);
+  EXPECT_EQ(result.attempts, 1);
+}
+
+TEST(CommandTest, RunCmdTimeout) {
+  CommandOptions options;
+  options.timeout_ms = 100;
+  const CommandResult result = RunCmd("sleep", {"10"}, options);
+  EXPECT_FALSE(result.ok);
+  EXPECT_TRUE(result.timed_out);
+  EXPECT_LT(result.wall_ms, 5000);
+}
+
+TEST(CommandTest, CommandJob) {
+  QList<CommandJob*> jobs;
+  for (int i = 0; i < 4; ++i) {
+    CommandJob* job = new CommandJob("sleep", {"0.2"});
+    job->start();
+    jobs.append(job);
+  }
+  EXPECT_TRUE(WaitForCommandJobs(jobs));
+  for (CommandJob* job : jobs) {
+    EXPECT_TRUE(job->isFinished());
+    EXPECT_TRUE(job->result().ok);
+    delete job;
+  }
+
+  CommandJob job("sleep", {"10"});
+  job.start();
+  EXPECT_FALSE(job.wait(50));
+  job.cancel();
+  EXPECT_TRUE(job.wait());
+  EXPECT_TRUE(job.result().canceled);
+  EXPECT_FALSE(job.result().ok);
+}
+
 }  // namespace
 }  // namespace installer
\ No newline at end of file
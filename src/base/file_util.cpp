@@ -17,7 +17,13 @@
 
 #include "base/file_util.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <QDebug>
@@ -26,8 +32,70 @@
 #include <QFileInfo>
 #include <QTextCodec>
 
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
 namespace installer {
 
+namespace {
+
+// Size of user space buffer in ReadWrite method.
+const size_t kCopyBufSize = 64 * 1024;
+
+// copy_file_range() is not wrapped by older glibc.
+ssize_t CopyFileRangeSyscall(int src_fd, loff_t* src_offset, int dest_fd,
+                             loff_t* dest_offset, size_t len) {
+#ifdef __NR_copy_file_range
+  return syscall(__NR_copy_file_range, src_fd, src_offset, dest_fd,
+                 dest_offset, len, 0u);
+#else
+  Q_UNUSED(src_fd);
+  Q_UNUSED(src_offset);
+  Q_UNUSED(dest_fd);
+  Q_UNUSED(dest_offset);
+  Q_UNUSED(len);
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+// Copy |len| bytes at |offset| with pread() and pwrite().
+bool ReadWriteRange(int src_fd, int dest_fd, off_t offset, size_t len) {
+  char buf[kCopyBufSize];
+  while (len > 0) {
+    const ssize_t num_read = pread(src_fd, buf, qMin(len, kCopyBufSize),
+                                   offset);
+    if (num_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (num_read <= 0) {
+      return false;
+    }
+    for (ssize_t pos = 0; pos < num_read; ) {
+      const ssize_t num_written = pwrite(dest_fd, buf + pos,
+                                         size_t(num_read - pos),
+                                         offset + pos);
+      if (num_written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (num_written <= 0) {
+        return false;
+      }
+      pos += num_written;
+    }
+    len -= size_t(num_read);
+    offset += num_read;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool CloneFile(int src_fd, int dest_fd) {
+  return ioctl(dest_fd, FICLONE, src_fd) == 0;
+}
+
 QDir ConcateDir(const QDir& parent_dir, const QString& folder_name) {
   if (!parent_dir.exists(folder_name)) {
     // TODO(xushaohua): Handles permission error.
@@ -38,7 +106,8 @@ QDir ConcateDir(const QDir& parent_dir, const QString& folder_name) {
 
 bool CopyFile(const QString& src_file,
               const QString& dest_file,
-              bool overwrite) {
+              bool overwrite,
+              CopyMethod* method) {
   QFile dest(dest_file);
   if (dest.exists()) {
     if (overwrite) {
@@ -51,7 +120,106 @@ bool CopyFile(const QString& src_file,
       return false;
     }
   }
-  return QFile::copy(src_file, dest_file);
+
+  const int src_fd = open(src_file.toLocal8Bit().constData(),
+                          O_RDONLY | O_CLOEXEC);
+  if (src_fd == -1) {
+    qCritical() << "CopyFile() failed to open:" << src_file;
+    return false;
+  }
+  struct stat st;
+  if (fstat(src_fd, &st) != 0) {
+    close(src_fd);
+    return false;
+  }
+  const int dest_fd = open(dest_file.toLocal8Bit().constData(),
+                           O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                           st.st_mode & 0777);
+  if (dest_fd == -1) {
+    qCritical() << "CopyFile() failed to create:" << dest_file;
+    close(src_fd);
+    return false;
+  }
+
+  CopyMethod used_method = CopyMethod::Clone;
+  bool ok = CopyFileContent(src_fd, dest_fd, used_method);
+  // Permissions are masked by umask in open().
+  ok = (fchmod(dest_fd, st.st_mode & 0777) == 0) && ok;
+  ok = (close(dest_fd) == 0) && ok;
+  close(src_fd);
+  if (!ok) {
+    qCritical() << "CopyFile() failed to copy" << src_file << "to"
+                << dest_file;
+  }
+  if (method != nullptr) {
+    *method = used_method;
+  }
+  return ok;
+}
+
+bool CopyFileContent(int src_fd, int dest_fd, CopyMethod& method) {
+  struct stat st;
+  if (fstat(src_fd, &st) != 0) {
+    return false;
+  }
+  if (method == CopyMethod::Clone) {
+    if (CloneFile(src_fd, dest_fd)) {
+      return true;
+    }
+    if (!IsCopyMethodUnsupported(errno)) {
+      return false;
+    }
+    method = CopyMethod::CopyFileRange;
+  }
+  return CopyFileRange(src_fd, dest_fd, 0, size_t(st.st_size), method);
+}
+
+bool CopyFileRange(int src_fd, int dest_fd, off_t offset, size_t len,
+                   CopyMethod& method) {
+  if (method == CopyMethod::Clone) {
+    method = CopyMethod::CopyFileRange;
+  }
+  while (len > 0 && method == CopyMethod::CopyFileRange) {
+    loff_t src_offset = offset;
+    loff_t dest_offset = offset;
+    const ssize_t num = CopyFileRangeSyscall(src_fd, &src_offset, dest_fd,
+                                             &dest_offset, len);
+    if (num < 0 && errno == EINTR) {
+      continue;
+    }
+    if (num < 0 && IsCopyMethodUnsupported(errno)) {
+      method = CopyMethod::SendFile;
+      break;
+    }
+    if (num <= 0) {
+      return false;
+    }
+    len -= size_t(num);
+    offset += num;
+  }
+
+  if (len > 0 && method == CopyMethod::SendFile) {
+    // sendfile() writes to current position of |dest_fd|.
+    if (lseek(dest_fd, offset, SEEK_SET) != offset) {
+      return false;
+    }
+    while (len > 0) {
+      const ssize_t num = sendfile(dest_fd, src_fd, &offset, len);
+      if (num < 0 && errno == EINTR) {
+        continue;
+      }
+      if (num < 0 && IsCopyMethodUnsupported(errno)) {
+        method = CopyMethod::ReadWrite;
+        break;
+      }
+      if (num <= 0) {
+        return false;
+      }
+      len -= size_t(num);
+    }
+  }
+
+  return ReadWriteRange(src_fd, dest_fd, offset, len);
 }
 
 bool CopyFolder(const QString src_dir, const QString& dest_dir,
@@ -67,6 +235,8 @@ bool CopyFolder(const QString src_dir, const QString& dest_dir,
   QFileInfo src_info;
   QString dest_filepath;
   bool ok = true;
+  // Number of files copied with each CopyMethod.
+  int method_count[int(CopyMethod::ReadWrite) + 1] = { 0 };
   if (!QDir(dest_dir).exists()) {
     ok = CreateDirs(dest_dir);
   }
@@ -84,14 +254,11 @@ bool CopyFolder(const QString src_dir, const QString& dest_dir,
                       dest_filepath.toStdString().c_str());
       }
     } else if (src_info.isFile()) {
-      if (QFile::exists(dest_filepath)) {
-        // Remove old file first.
-        QFile::remove(dest_filepath);
-      }
-      ok = QFile::copy(iter.filePath(), dest_filepath);
+      // Old file is removed first.
+      CopyMethod method;
+      ok = CopyFile(iter.filePath(), dest_filepath, true, &method);
       if (ok) {
-        ok = CopyMode(iter.filePath().toStdString().c_str(),
-                      dest_filepath.toStdString().c_str());
+        method_count[int(method)] ++;
       }
     } else if (src_info.isSymLink()) {
       if (QFile::exists(dest_filepath)) {
@@ -102,6 +269,16 @@ bool CopyFolder(const QString src_dir, const QString& dest_dir,
       // Ignores other type of files.
     }
   }
+
+  qDebug() << "CopyFolder()" << src_dir << "to" << dest_dir
+           << GetCopyMethodName(CopyMethod::Clone)
+           << method_count[int(CopyMethod::Clone)]
+           << GetCopyMethodName(CopyMethod::CopyFileRange)
+           << method_count[int(CopyMethod::CopyFileRange)]
+           << GetCopyMethodName(CopyMethod::SendFile)
+           << method_count[int(CopyMethod::SendFile)]
+           << GetCopyMethodName(CopyMethod::ReadWrite)
+           << method_count[int(CopyMethod::ReadWrite)];
   return ok;
 }
 
@@ -123,6 +300,24 @@ bool CreateParentDirs(const QString& filepath) {
   return QFileInfo(filepath).absoluteDir().mkpath(".");
 }
 
+const char* GetCopyMethodName(CopyMethod method) {
+  switch (method) {
+    case CopyMethod::Clone: {
+      return "clone";
+    }
+    case CopyMethod::CopyFileRange: {
+      return "copy_file_range";
+    }
+    case CopyMethod::SendFile: {
+      return "sendfile";
+    }
+    case CopyMethod::ReadWrite: {
+      return "read_write";
+    }
+  }
+  return "";
+}
+
 QString GetFileBasename(const QString& filepath) {
   const QString filename = GetFileName(filepath);
   const int dot_index = filename.lastIndexOf(QChar('.'));
@@ -163,6 +358,14 @@ qint64 GetFileSize(const QString& filepath) {
   }
 }
 
+bool IsCopyMethodUnsupported(int err) {
+  // EXDEV: files on different filesystems.
+  // EINVAL: not supported by this filesystem or file type.
+  // EBADF: |dest_fd| is opened with O_APPEND.
+  return (err == EXDEV || err == EINVAL || err == EOPNOTSUPP ||
+          err == ENOTTY || err == ENOSYS || err == EBADF);
+}
+
 QString ReadFile(const QString& path) {
   QFile file(path);
   if (file.exists()) {
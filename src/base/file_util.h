@@ -18,11 +18,48 @@
 #ifndef INSTALLER_BASE_FILE_UTIL_H
 #define INSTALLER_BASE_FILE_UTIL_H
 
+#include <sys/types.h>
 #include <QDir>
 #include <QString>
 
 namespace installer {
 
+// Methods to copy content of regular files, from the fastest to the slowest.
+enum class CopyMethod {
+  // Share data blocks with FICLONE ioctl, on btrfs and xfs.
+  Clone,
+  // Copy in kernel with copy_file_range(), might be offloaded to filesystem.
+  CopyFileRange,
+  // Copy in kernel with sendfile().
+  SendFile,
+  // Copy through user space buffer.
+  ReadWrite,
+};
+
+// Returns name of |method|, used in log.
+const char* GetCopyMethodName(CopyMethod method);
+
+// Returns true if |err| set by CloneFile(), copy_file_range() or sendfile()
+// means that method is not supported between the two files, so that next
+// method shall be tried.
+bool IsCopyMethodUnsupported(int err);
+
+// Share all data blocks of |src_fd| with |dest_fd|, replacing content of
+// |dest_fd|. Returns false and sets errno if failed.
+bool CloneFile(int src_fd, int dest_fd);
+
+// Copy |len| bytes at |offset| of |src_fd| to the same offset of |dest_fd|.
+// |method| is the first method to try, Clone is treated as CopyFileRange.
+// If it is not supported, next methods are tried in order, and |method| is
+// updated to the one finally used, so that callers can start with it for
+// next file.
+bool CopyFileRange(int src_fd, int dest_fd, off_t offset, size_t len,
+                   CopyMethod& method);
+
+// Copy whole content of regular file |src_fd| to |dest_fd|, starting with
+// |method|. See CopyFileRange().
+bool CopyFileContent(int src_fd, int dest_fd, CopyMethod& method);
+
 // Create a folder with |folder_name| in |parent_dir| directory and
 // returns a QDir object referencing to its absolute path.
 QDir ConcateDir(const QDir& parent_dir, const QString& folder_name);
@@ -30,7 +67,11 @@ QDir ConcateDir(const QDir& parent_dir, const QString& folder_name);
 // Copy file from |src_file| to |dest_file|.
 // If |dest_file| exists, overwrite its content if |overwrite| is true, or
 // returns false if not overwrite.
-bool CopyFile(const QString& src_file, const QString& dest_file, bool overwrite);
+// Content is copied with reflink if possible, and falls back to slower
+// methods, see CopyFileContent(). Method used is saved to |method| if it is
+// not null.
+bool CopyFile(const QString& src_file, const QString& dest_file,
+              bool overwrite, CopyMethod* method = nullptr);
 
 // Folder content in |src_dir| into |dest_dir|.
 // This method only copy normal files, folders and symbolic link file.
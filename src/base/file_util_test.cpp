@@ -17,6 +17,9 @@
 
 #include "base/file_util.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include "third_party/googletest/include/gtest/gtest.h"
 
 namespace installer {
@@ -27,6 +30,33 @@ TEST(FileUtil, CopyFodlerTest) {
   EXPECT_TRUE(CopyFolder("/etc/apt", "/tmp/apt", false));
 }
 
+TEST(FileUtil, CopyFileContentTest) {
+  const char kSrcFile[] = "/tmp/file-util-copy-src";
+  const char kDestFile[] = "/tmp/file-util-copy-dest";
+  const QString content(QString("0123456789").repeated(100000));
+  ASSERT_TRUE(WriteTextFile(kSrcFile, content));
+
+  // Each method falls back to slower ones if it is not supported.
+  for (CopyMethod method : { CopyMethod::Clone, CopyMethod::CopyFileRange,
+                             CopyMethod::SendFile, CopyMethod::ReadWrite }) {
+    const int src_fd = open(kSrcFile, O_RDONLY);
+    const int dest_fd = open(kDestFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ASSERT_NE(src_fd, -1);
+    ASSERT_NE(dest_fd, -1);
+    const CopyMethod first_method = method;
+    EXPECT_TRUE(CopyFileContent(src_fd, dest_fd, method));
+    EXPECT_GE(int(method), int(first_method));
+    close(src_fd);
+    close(dest_fd);
+    EXPECT_EQ(ReadFile(kDestFile), content);
+  }
+
+  CopyMethod method;
+  EXPECT_TRUE(CopyFile(kSrcFile, kDestFile, true, &method));
+  EXPECT_EQ(ReadFile(kDestFile), content);
+  EXPECT_FALSE(CopyFile(kSrcFile, kDestFile, false));
+}
+
 TEST(FileUtil, GetFileNameTest) {
   EXPECT_EQ(GetFileName("/etc/apt/sources.list"), "sources.list");
 }
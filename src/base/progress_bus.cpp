@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "base/progress_bus.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+
+namespace installer {
+
+namespace {
+
+// Environment variables holding fds of shared memory and eventfd.
+const char kProgressFdEnv[] = "DI_PROGRESS_FD";
+const char kProgressEventFdEnv[] = "DI_PROGRESS_EVENT_FD";
+// Environment variable holding id of current hook, set by hook_runner.sh.
+const char kHookIdEnv[] = "DI_HOOK_ID";
+
+// Template of shared memory file, which is removed once it is opened.
+const char kShmTemplate[] = "/dev/shm/deepin-installer-progress-XXXXXX";
+
+// "DIPB", marks a valid bus.
+const uint32_t kProgressBusMagic = 0x44495042;
+
+// Fds are moved above this number, so that they are not replaced by
+// redirections in shell scripts.
+const int kMinFd = 100;
+
+// Times to retry when seqlock is held by another writer.
+const int kMaxSpins = 1000;
+
+// Move |fd| above kMinFd, and close the old one.
+int MoveFd(int fd) {
+  const int high_fd = fcntl(fd, F_DUPFD, kMinFd);
+  close(fd);
+  return high_fd;
+}
+
+// Read non-negative number in environment variable |name|, -1 if not set.
+int GetEnvInt(const char* name) {
+  const char* env = getenv(name);
+  if (env == nullptr || *env == '\0') {
+    return -1;
+  }
+  char* end = nullptr;
+  const long val = strtol(env, &end, 10);
+  if (*end != '\0' || val < 0 || val > INT_MAX) {
+    return -1;
+  }
+  return static_cast<int>(val);
+}
+
+void SetEnvFd(const char* name, int fd) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%d", fd);
+  setenv(name, buf, 1);
+}
+
+}  // namespace
+
+// Layout of shared memory. Fields after |sequence| are only accessed inside
+// seqlock.
+struct ProgressBus::Data {
+  uint32_t magic;
+  // Odd while a writer is updating fields.
+  std::atomic<uint32_t> sequence;
+  std::atomic<uint64_t> counter;
+  std::atomic<uint32_t> phase;
+  std::atomic<uint32_t> hook_id;
+  std::atomic<int32_t> percent;
+  std::atomic<uint64_t> done_bytes;
+  std::atomic<uint64_t> total_bytes;
+};
+
+ProgressBus::ProgressBus()
+    : data_(nullptr),
+      shm_fd_(-1),
+      event_fd_(-1),
+      hook_id_(0),
+      owner_(false) {
+}
+
+ProgressBus::~ProgressBus() {
+  if (data_ != nullptr) {
+    munmap(data_, sizeof(Data));
+    data_ = nullptr;
+  }
+  // Inherited fds are kept open, as they might be used by child processes
+  // of current process.
+  if (owner_) {
+    close(shm_fd_);
+    close(event_fd_);
+  }
+}
+
+bool ProgressBus::create() {
+  char path[sizeof(kShmTemplate)];
+  memcpy(path, kShmTemplate, sizeof(kShmTemplate));
+  int fd = mkstemp(path);
+  if (fd == -1) {
+    perror("ProgressBus::create() failed to create shared memory");
+    return false;
+  }
+  // Shared memory is only accessed through inherited fd.
+  unlink(path);
+  if (ftruncate(fd, sizeof(Data)) == -1) {
+    perror("ProgressBus::create() ftruncate()");
+    close(fd);
+    return false;
+  }
+  fd = MoveFd(fd);
+  if (fd == -1) {
+    perror("ProgressBus::create() failed to move fd");
+    return false;
+  }
+  if (!this->map(fd)) {
+    close(fd);
+    return false;
+  }
+  // Atomics shared between processes shall be lock free.
+  if (!data_->sequence.is_lock_free() || !data_->counter.is_lock_free()) {
+    fprintf(stderr, "ProgressBus::create() atomics are not lock free\n");
+    munmap(data_, sizeof(Data));
+    data_ = nullptr;
+    close(fd);
+    return false;
+  }
+  data_->magic = kProgressBusMagic;
+  shm_fd_ = fd;
+
+  // Writers never block, as counter of eventfd is cleared by reader.
+  fd = eventfd(0, EFD_NONBLOCK);
+  if (fd != -1) {
+    event_fd_ = MoveFd(fd);
+  } else {
+    perror("ProgressBus::create() eventfd()");
+  }
+
+  owner_ = true;
+  SetEnvFd(kProgressFdEnv, shm_fd_);
+  if (event_fd_ != -1) {
+    SetEnvFd(kProgressEventFdEnv, event_fd_);
+  }
+  return true;
+}
+
+bool ProgressBus::openFromEnv() {
+  const int fd = GetEnvInt(kProgressFdEnv);
+  if (fd == -1) {
+    return false;
+  }
+  // Ignore fd closed or reused by a parent process.
+  struct stat st;
+  if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) ||
+      st.st_size < off_t(sizeof(Data))) {
+    return false;
+  }
+  if (!this->map(fd)) {
+    return false;
+  }
+  if (data_->magic != kProgressBusMagic) {
+    munmap(data_, sizeof(Data));
+    data_ = nullptr;
+    return false;
+  }
+  shm_fd_ = fd;
+  event_fd_ = GetEnvInt(kProgressEventFdEnv);
+  hook_id_ = static_cast<uint32_t>(std::max(GetEnvInt(kHookIdEnv), 0));
+  return true;
+}
+
+void ProgressBus::publish(ProgressPhase phase, int percent,
+                          uint64_t done_bytes, uint64_t total_bytes) {
+  if (data_ == nullptr) {
+    return;
+  }
+  if (percent < 0) {
+    percent = 0;
+  } else if (percent > 100) {
+    percent = 100;
+  }
+
+  // Take write side of seqlock, which also serializes writers.
+  uint32_t seq = data_->sequence.load(std::memory_order_relaxed);
+  for (int i = 0; ; ++i) {
+    if ((seq & 1) == 0 &&
+        data_->sequence.compare_exchange_weak(seq, seq + 1,
+                                              std::memory_order_acquire)) {
+      break;
+    }
+    if (i >= kMaxSpins) {
+      // Another writer might be killed while updating, drop this progress.
+      return;
+    }
+    sched_yield();
+    seq = data_->sequence.load(std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+
+  data_->phase.store(static_cast<uint32_t>(phase), std::memory_order_relaxed);
+  data_->hook_id.store(hook_id_, std::memory_order_relaxed);
+  data_->percent.store(percent, std::memory_order_relaxed);
+  data_->done_bytes.store(done_bytes, std::memory_order_relaxed);
+  data_->total_bytes.store(total_bytes, std::memory_order_relaxed);
+  data_->counter.fetch_add(1, std::memory_order_relaxed);
+  data_->sequence.store(seq + 2, std::memory_order_release);
+
+  if (event_fd_ != -1) {
+    const uint64_t value = 1;
+    ssize_t ret;
+    do {
+      ret = write(event_fd_, &value, sizeof(value));
+    } while (ret == -1 && errno == EINTR);
+  }
+}
+
+bool ProgressBus::read(ProgressSnapshot& snapshot) const {
+  if (data_ == nullptr) {
+    return false;
+  }
+  for (int i = 0; i < kMaxSpins; ++i) {
+    const uint32_t seq = data_->sequence.load(std::memory_order_acquire);
+    if ((seq & 1) != 0) {
+      sched_yield();
+      continue;
+    }
+    const uint64_t counter = data_->counter.load(std::memory_order_relaxed);
+    const uint32_t phase = data_->phase.load(std::memory_order_relaxed);
+    const uint32_t hook_id = data_->hook_id.load(std::memory_order_relaxed);
+    const int32_t percent = data_->percent.load(std::memory_order_relaxed);
+    const uint64_t done_bytes =
+        data_->done_bytes.load(std::memory_order_relaxed);
+    const uint64_t total_bytes =
+        data_->total_bytes.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (data_->sequence.load(std::memory_order_relaxed) == seq) {
+      snapshot.counter = counter;
+      snapshot.phase = static_cast<ProgressPhase>(phase);
+      snapshot.hook_id = hook_id;
+      snapshot.percent = percent;
+      snapshot.done_bytes = done_bytes;
+      snapshot.total_bytes = total_bytes;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ProgressBus::clearEvent() {
+  if (event_fd_ != -1) {
+    uint64_t value;
+    ssize_t ret;
+    do {
+      ret = ::read(event_fd_, &value, sizeof(value));
+    } while (ret == -1 && errno == EINTR);
+  }
+}
+
+bool ProgressBus::map(int fd) {
+  void* addr = mmap(nullptr, sizeof(Data), PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+  if (addr == MAP_FAILED) {
+    perror("ProgressBus::map() mmap()");
+    return false;
+  }
+  data_ = static_cast<Data*>(addr);
+  return true;
+}
+
+}  // namespace installer
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_BASE_PROGRESS_BUS_H
+#define INSTALLER_BASE_PROGRESS_BUS_H
+
+#include <stdint.h>
+
+namespace installer {
+
+// Source of progress published on ProgressBus.
+enum class ProgressPhase : uint32_t {
+  None = 0,
+  // Extracting base filesystem with deepin-installer-unsquashfs.
+  Unsquashfs = 1,
+  // Progress of a hook script, reported by deepin-installer-progress.
+  Hook = 2,
+};
+
+// Latest progress read from ProgressBus.
+struct ProgressSnapshot {
+  // Number of progress published, 0 if nothing is published yet.
+  uint64_t counter = 0;
+  ProgressPhase phase = ProgressPhase::None;
+  // Id of hook publishing this progress, read from DI_HOOK_ID of writer,
+  // or 0 if unknown.
+  uint32_t hook_id = 0;
+  // 0-100.
+  int percent = 0;
+  uint64_t done_bytes = 0;
+  uint64_t total_bytes = 0;
+};
+
+// Progress channel from child processes to installer, in shared memory.
+// Installer creates the bus, and child processes inherit it through fds
+// exported in environment, which also works in chroot env.
+// Writers update fields in a seqlock and wake up reader with an eventfd,
+// so that reader is notified without polling, and never sees half updated
+// fields. Only the latest progress is kept, multiple updates between two
+// reads are coalesced.
+class ProgressBus {
+ public:
+  ProgressBus();
+  ~ProgressBus();
+
+  ProgressBus(const ProgressBus&) = delete;
+  ProgressBus& operator=(const ProgressBus&) = delete;
+
+  // Create a new bus and export it to child processes.
+  bool create();
+
+  // Open bus inherited from parent process. Returns false if not found.
+  // Progress published by this object is tagged with DI_HOOK_ID in
+  // environment, which is exported by hook runner to each hook.
+  bool openFromEnv();
+
+  bool isOpen() const { return data_ != nullptr; }
+
+  // Publish progress and wake up reader. This method is safe to be called
+  // in multiple threads and processes.
+  void publish(ProgressPhase phase, int percent, uint64_t done_bytes = 0,
+               uint64_t total_bytes = 0);
+
+  // Read latest progress. Returns false if bus is not open or a writer is
+  // stuck in updating.
+  bool read(ProgressSnapshot& snapshot) const;
+
+  // fd which is readable after progress is published, or -1 if bus is not
+  // open. Call clearEvent() before reading progress.
+  int eventFd() const { return event_fd_; }
+  void clearEvent();
+
+ private:
+  struct Data;
+
+  // Map shared memory in |fd|.
+  bool map(int fd);
+
+  Data* data_;
+  int shm_fd_;
+  int event_fd_;
+  // Id of hook which this process belongs to.
+  uint32_t hook_id_;
+  // Whether fds are created by this object, and closed in destructor.
+  bool owner_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_BASE_PROGRESS_BUS_H
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "base/progress_bus.h"
+
+#include <poll.h>
+#include <stdlib.h>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+// Returns true if |fd| is readable now.
+bool IsReadable(int fd) {
+  struct pollfd pfd = { fd, POLLIN, 0 };
+  return poll(&pfd, 1, 0) == 1;
+}
+
+TEST(ProgressBusTest, PublishAndRead) {
+  ProgressBus bus;
+  ASSERT_TRUE(bus.create());
+  ProgressSnapshot snapshot;
+  EXPECT_TRUE(bus.read(snapshot));
+  EXPECT_EQ(snapshot.counter, 0u);
+  EXPECT_FALSE(IsReadable(bus.eventFd()));
+
+  // Bus and hook id are inherited through environment.
+  setenv("DI_HOOK_ID", "7", 1);
+  ProgressBus writer;
+  ASSERT_TRUE(writer.openFromEnv());
+  unsetenv("DI_HOOK_ID");
+  writer.publish(ProgressPhase::Unsquashfs, 42, 420, 1000);
+  writer.publish(ProgressPhase::Hook, 120);
+  EXPECT_TRUE(IsReadable(bus.eventFd()));
+  bus.clearEvent();
+  EXPECT_FALSE(IsReadable(bus.eventFd()));
+
+  // Updates are coalesced.
+  EXPECT_TRUE(bus.read(snapshot));
+  EXPECT_EQ(snapshot.counter, 2u);
+  EXPECT_EQ(snapshot.phase, ProgressPhase::Hook);
+  EXPECT_EQ(snapshot.hook_id, 7u);
+  EXPECT_EQ(snapshot.percent, 100);
+  EXPECT_EQ(snapshot.done_bytes, 0u);
+
+  // Progress published outside of hooks is not tagged.
+  ProgressBus other_writer;
+  ASSERT_TRUE(other_writer.openFromEnv());
+  other_writer.publish(ProgressPhase::Unsquashfs, 10);
+  EXPECT_TRUE(bus.read(snapshot));
+  EXPECT_EQ(snapshot.hook_id, 0u);
+}
+
+}  // namespace
+}  // namespace installer
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "base/trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <QDebug>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+namespace installer {
+
+const char kTraceFdEnv[] = "DI_TRACE_FD";
+
+namespace {
+
+// Trace fd is moved above this number, so that it is not replaced by
+// redirections in shell scripts, like `exec 4>&1`.
+const int kTraceMinFd = 100;
+
+// fd of trace file, -1 if trace is not enabled.
+std::atomic<int> g_trace_fd(-1);
+
+void WriteEvent(const QJsonObject& event) {
+  const int fd = g_trace_fd.load();
+  if (fd == -1) {
+    return;
+  }
+  QByteArray data = QJsonDocument(event).toJson(QJsonDocument::Compact);
+  data.append(",\n");
+  // Trace is best effort, errors are ignored.
+  ssize_t ret;
+  do {
+    ret = write(fd, data.constData(), static_cast<size_t>(data.size()));
+  } while (ret == -1 && errno == EINTR);
+}
+
+QJsonObject NewEvent(const char* category, const QString& name,
+                     const char* phase, int64_t timestamp,
+                     const TraceArgs& args) {
+  QJsonObject event;
+  event.insert("name", name);
+  event.insert("cat", category);
+  event.insert("ph", phase);
+  event.insert("ts", static_cast<double>(timestamp));
+  event.insert("pid", static_cast<int>(getpid()));
+  event.insert("tid", static_cast<int>(syscall(SYS_gettid)));
+  if (!args.isEmpty()) {
+    event.insert("args", QJsonObject::fromVariantMap(args));
+  }
+  return event;
+}
+
+// Name current process in trace viewer.
+void WriteProcessName() {
+  TraceArgs args;
+  args.insert("name", program_invocation_short_name);
+  WriteEvent(NewEvent("__metadata", "process_name", "M", 0, args));
+}
+
+}  // namespace
+
+bool StartTrace(const QString& filepath) {
+  const int fd = open(filepath.toStdString().c_str(),
+                      O_WRONLY | O_CREAT | O_TRUNC | O_APPEND,
+                      S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd == -1) {
+    qCritical() << "Failed to create trace file:" << filepath;
+    return false;
+  }
+  // Do not set FD_CLOEXEC, it is inherited by child processes.
+  const int high_fd = fcntl(fd, F_DUPFD, kTraceMinFd);
+  close(fd);
+  if (high_fd == -1) {
+    qCritical() << "Failed to move fd of trace file:" << filepath;
+    return false;
+  }
+  if (write(high_fd, "[\n", 2) != 2) {
+    qCritical() << "Failed to write trace file:" << filepath;
+    close(high_fd);
+    return false;
+  }
+
+  setenv(kTraceFdEnv, QByteArray::number(high_fd).constData(), 1);
+  g_trace_fd = high_fd;
+  WriteProcessName();
+  return true;
+}
+
+bool InitTraceFromEnv() {
+  const char* env = getenv(kTraceFdEnv);
+  if (env == nullptr) {
+    return false;
+  }
+  bool ok;
+  const int fd = QByteArray(env).toInt(&ok);
+  if (!ok || fd < 0) {
+    return false;
+  }
+  // Ignore fd closed or reused by a parent process.
+  const int flags = fcntl(fd, F_GETFL);
+  if (flags == -1 || (flags & O_APPEND) == 0) {
+    return false;
+  }
+  g_trace_fd = fd;
+  WriteProcessName();
+  return true;
+}
+
+bool IsTraceEnabled() {
+  return g_trace_fd.load() != -1;
+}
+
+int64_t GetTraceTimestamp() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void TraceBegin(const char* category, const QString& name,
+                const TraceArgs& args) {
+  if (IsTraceEnabled()) {
+    WriteEvent(NewEvent(category, name, "B", GetTraceTimestamp(), args));
+  }
+}
+
+void TraceEnd(const char* category, const QString& name,
+              const TraceArgs& args) {
+  if (IsTraceEnabled()) {
+    WriteEvent(NewEvent(category, name, "E", GetTraceTimestamp(), args));
+  }
+}
+
+ScopedTrace::ScopedTrace(const char* category, const QString& name,
+                         const TraceArgs& args)
+    : category_(category),
+      name_(name),
+      args_(args),
+      begin_(GetTraceTimestamp()) {
+}
+
+ScopedTrace::~ScopedTrace() {
+  if (IsTraceEnabled()) {
+    // Complete event, with both begin time and duration.
+    QJsonObject event = NewEvent(category_, name_, "X", begin_, args_);
+    event.insert("dur", static_cast<double>(GetTraceTimestamp() - begin_));
+    WriteEvent(event);
+  }
+}
+
+void ScopedTrace::addArg(const QString& key, const QVariant& value) {
+  args_.insert(key, value);
+}
+
+}  // namespace installer
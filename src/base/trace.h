@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_BASE_TRACE_H
+#define INSTALLER_BASE_TRACE_H
+
+#include <stdint.h>
+#include <QString>
+#include <QVariantMap>
+
+namespace installer {
+
+// Timeline of installation, written in Chrome trace event format, which can
+// be opened in chrome://tracing or https://ui.perfetto.dev.
+// Events are appended to one file shared by installer and its child
+// processes. Its fd is exported in environment variable kTraceFdEnv, and
+// child processes call InitTraceFromEnv() to append their events. Each event
+// is written with a single write() to the file opened with O_APPEND, so no
+// lock is needed between threads and processes.
+// Closing bracket of the JSON array is never written, which is allowed by
+// this format.
+
+// Name of environment variable holding fd of trace file.
+extern const char kTraceFdEnv[];
+
+// Arguments of event, shown in trace viewer.
+typedef QVariantMap TraceArgs;
+
+// Create trace file at |filepath|, and export its fd to child processes.
+// Old file is overwritten.
+bool StartTrace(const QString& filepath);
+
+// Append events to trace file inherited from parent process, if any.
+// Returns false if trace is not enabled.
+bool InitTraceFromEnv();
+
+// Returns true if events are recorded.
+bool IsTraceEnabled();
+
+// Microseconds since boot, used as timestamp of events. It is the same in
+// all processes.
+int64_t GetTraceTimestamp();
+
+// Record begin and end of event |name| in current thread. Both events shall
+// be recorded in the same thread, and nested events shall end in reverse
+// order. Used for events ended in another function.
+void TraceBegin(const char* category, const QString& name,
+                const TraceArgs& args = TraceArgs());
+void TraceEnd(const char* category, const QString& name,
+              const TraceArgs& args = TraceArgs());
+
+// Record an event lasting from construction to destruction of this object.
+class ScopedTrace {
+ public:
+  ScopedTrace(const char* category, const QString& name,
+              const TraceArgs& args = TraceArgs());
+  ~ScopedTrace();
+
+  ScopedTrace(const ScopedTrace&) = delete;
+  ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+  // Add argument known only at end of event, like result of a command.
+  void addArg(const QString& key, const QVariant& value);
+
+ private:
+  const char* category_;
+  QString name_;
+  TraceArgs args_;
+  int64_t begin_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_BASE_TRACE_H
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "base/trace.h"
+
+#include <stdlib.h>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "base/command.h"
+#include "base/file_util.h"
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+// Read events in unterminated trace file.
+QJsonArray ReadTraceEvents(const QString& filepath) {
+  QString content = ReadFile(filepath).trimmed();
+  if (content.endsWith(',')) {
+    content.chop(1);
+  }
+  content.append(']');
+  return QJsonDocument::fromJson(content.toUtf8()).array();
+}
+
+TEST(TraceTest, WriteEvents) {
+  const QString trace_file = "/tmp/installer-trace-test.json";
+  ASSERT_TRUE(StartTrace(trace_file));
+  EXPECT_TRUE(IsTraceEnabled());
+  EXPECT_TRUE(getenv(kTraceFdEnv) != nullptr);
+
+  TraceBegin("test", "outer");
+  {
+    ScopedTrace trace("test", "inner", {{"key", "value"}});
+    trace.addArg("ok", true);
+  }
+  TraceEnd("test", "outer");
+
+  // Child process inherits fd of trace file.
+  QString output;
+  const QString cmd = "printf '{},\\n' >&${DI_TRACE_FD}";
+  EXPECT_TRUE(SpawnCmd("/bin/sh", {"-c", cmd}, output));
+
+  const QJsonArray events = ReadTraceEvents(trace_file);
+  ASSERT_GE(events.size(), 6);
+  EXPECT_EQ(events.at(0).toObject().value("ph").toString(), "M");
+  EXPECT_EQ(events.at(1).toObject().value("ph").toString(), "B");
+  const QJsonObject inner = events.at(2).toObject();
+  EXPECT_EQ(inner.value("name").toString(), "inner");
+  EXPECT_EQ(inner.value("ph").toString(), "X");
+  EXPECT_GE(inner.value("dur").toDouble(), 0);
+  EXPECT_EQ(inner.value("args").toObject().value("key").toString(), "value");
+  EXPECT_TRUE(inner.value("args").toObject().value("ok").toBool());
+  EXPECT_EQ(events.at(3).toObject().value("ph").toString(), "E");
+  EXPECT_EQ(events.at(3).toObject().value("tid"),
+            events.at(1).toObject().value("tid"));
+  EXPECT_TRUE(events.at(4).toObject().isEmpty());
+  EXPECT_EQ(events.at(5).toObject().value("cat").toString(), "command");
+}
+
+}  // namespace
+}  // namespace installer
@@ -27,39 +27,35 @@
 namespace installer {
 
 QDebug& operator<<(QDebug& debug, const OperationType& op_type) {
-  QString type;
+  debug << GetOperationTypeName(op_type);
+  return debug;
+}
+
+QString GetOperationTypeName(OperationType op_type) {
   switch (op_type) {
     case OperationType::Create: {
-      type = "Create";
-      break;
+      return "Create";
     }
     case OperationType::Delete: {
-      type = "Delete";
-      break;
+      return "Delete";
     }
     case OperationType::Format: {
-      type = "Format";
-      break;
+      return "Format";
     }
     case OperationType::MountPoint: {
-      type = "MountPoint";
-      break;
+      return "MountPoint";
     }
     case OperationType::NewPartTable: {
-      type = "NewPartTable";
-      break;
+      return "NewPartTable";
     }
     case OperationType::Resize: {
-      type = "Resize";
-      break;
+      return "Resize";
     }
     case OperationType::Invalid: {
-      type = "Invalid";
-      break;
+      return "Invalid";
     }
   }
-  debug << type;
-  return debug;
+  return QString();
 }
 
 Operation::Operation(const Device::Ptr device)
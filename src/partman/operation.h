@@ -36,6 +36,9 @@ enum class OperationType {
 };
 QDebug& operator<<(QDebug& debug, const OperationType& op_type);
 
+// Returns name of |op_type|, like "Create".
+QString GetOperationTypeName(OperationType op_type);
+
 // Abstract class for operations.
 class Operation {
  public:
@@ -22,6 +22,7 @@
 #include <QDir>
 
 #include "base/command.h"
+#include "base/trace.h"
 #include "partman/libparted_util.h"
 #include "partman/os_prober.h"
 #include "partman/partition_usage.h"
@@ -35,6 +36,9 @@ namespace {
 // Absolute path to hook_manager.sh
 const char kHookManagerFile[] = BUILTIN_HOOKS_DIR "/hook_manager.sh";
 
+// Category of partition events in trace.
+const char kTraceCategory[] = "partman";
+
 // Get flags of |lp_partition|.
 PartitionFlags GetPartitionFlags(PedPartition* lp_partition) {
   Q_ASSERT(lp_partition);
@@ -208,17 +212,28 @@ void PartitionManager::doAutoPart(const QString& script_path) {
 
 void PartitionManager::doManualPart(const OperationList& operations) {
   qDebug() << Q_FUNC_INFO << "\n" << "operations:" << operations;
+  ScopedTrace trace(kTraceCategory, "manual_part",
+                    {{"operations", operations.length()}});
   bool ok = true;
   // Copy operation list, as partition path will be updated in applyToDisk().
   OperationList real_operations(operations);
   for (int i = 0; ok && i < real_operations.length(); ++i) {
     Operation& operation = real_operations[i];
+    ScopedTrace operation_trace(kTraceCategory,
+                                GetOperationTypeName(operation.type));
     ok = operation.applyToDisk();
+    if (operation.type == OperationType::NewPartTable) {
+      operation_trace.addArg("device", operation.device->path);
+    } else {
+      operation_trace.addArg("partition", operation.new_partition->path);
+    }
+    operation_trace.addArg("ok", ok);
   }
   qDebug() << Q_FUNC_INFO << "\n" << "real operations:" << real_operations;
 
   DeviceList devices;
   if (ok) {
+    ScopedTrace scan_trace(kTraceCategory, "scan_devices");
     devices = ScanDevices(false);
     // Update mount point of real partitions.
     for (Device::Ptr device : devices) {
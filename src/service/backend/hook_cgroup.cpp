@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "service/backend/hook_cgroup.h"
+
+#include <signal.h>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+
+#include "base/file_util.h"
+#include "service/backend/hook_stats.h"
+
+namespace installer {
+
+namespace {
+
+const char kCgroupRoot[] = "/sys/fs/cgroup";
+// Parent cgroup of all hook jobs, created in root cgroup.
+const char kHooksCgroup[] = "/sys/fs/cgroup/deepin-installer";
+
+// Controllers used to account resources of hook jobs.
+const char* const kControllers[] = { "cpu", "io", "memory" };
+
+bool g_cgroups_enabled = false;
+
+bool WriteCgroupFile(const QString& path, const QByteArray& content) {
+  QFile file(path);
+  if (!file.open(QIODevice::WriteOnly)) {
+    return false;
+  }
+  // Each write is a single request to kernel.
+  const bool ok = (file.write(content) == content.length());
+  file.close();
+  return ok;
+}
+
+// Enable controllers of children in cgroup at |path|. Controllers not
+// supported by kernel are ignored.
+void EnableControllers(const QString& path) {
+  const QString file = QDir(path).absoluteFilePath("cgroup.subtree_control");
+  for (const char* controller : kControllers) {
+    if (!WriteCgroupFile(file, QByteArray("+") + controller)) {
+      qWarning() << "Failed to enable cgroup controller:" << controller
+                 << path;
+    }
+  }
+}
+
+// Read value of |key| in flat keyed file |content|, like "usage_usec 123".
+qint64 ReadKeyedValue(const QString& content, const QString& key) {
+  for (const QString& line : content.split('\n')) {
+    const QStringList parts = line.split(' ');
+    if (parts.length() == 2 && parts.at(0) == key) {
+      return parts.at(1).toLongLong();
+    }
+  }
+  return -1;
+}
+
+}  // namespace
+
+bool InitHookCgroups() {
+  g_cgroups_enabled = false;
+  if (!QFile::exists(QDir(kCgroupRoot).absoluteFilePath(
+      "cgroup.controllers"))) {
+    qDebug() << "cgroup v2 is not mounted at" << kCgroupRoot;
+    return false;
+  }
+  if (!QDir().mkpath(kHooksCgroup)) {
+    qWarning() << "Failed to create cgroup:" << kHooksCgroup;
+    return false;
+  }
+  EnableControllers(kCgroupRoot);
+  EnableControllers(kHooksCgroup);
+  g_cgroups_enabled = true;
+  return true;
+}
+
+HookCgroup::HookCgroup(const QString& name)
+    : path_(QDir(kHooksCgroup).absoluteFilePath(name)) {
+}
+
+HookCgroup::~HookCgroup() {
+  // Cgroup with daemons started by job cannot be removed, it is kept until
+  // system reboots.
+  if (created_ && !QDir().rmdir(path_)) {
+    qWarning() << "Failed to remove cgroup:" << path_;
+  }
+}
+
+bool HookCgroup::create() {
+  if (!g_cgroups_enabled) {
+    return false;
+  }
+  created_ = QDir().mkpath(path_);
+  if (!created_) {
+    qWarning() << "Failed to create cgroup:" << path_;
+  }
+  return created_;
+}
+
+bool HookCgroup::addProcess(qint64 pid) {
+  return created_ &&
+         WriteCgroupFile(QDir(path_).absoluteFilePath("cgroup.procs"),
+                         QByteArray::number(pid));
+}
+
+void HookCgroup::kill(int sig) {
+  if (!created_) {
+    return;
+  }
+  // cgroup.kill is only available in kernel 5.14 and later.
+  if (sig == SIGKILL &&
+      WriteCgroupFile(QDir(path_).absoluteFilePath("cgroup.kill"), "1")) {
+    return;
+  }
+  const QString procs = ReadFile(QDir(path_).absoluteFilePath("cgroup.procs"));
+  for (const QString& pid : procs.split('\n', QString::SkipEmptyParts)) {
+    ::kill(pid_t(pid.toLongLong()), sig);
+  }
+}
+
+void HookCgroup::readStats(HookStats& stats) const {
+  if (!created_) {
+    return;
+  }
+  const QDir dir(path_);
+
+  const QString cpu_stat = ReadFile(dir.absoluteFilePath("cpu.stat"));
+  const qint64 usage_usec = ReadKeyedValue(cpu_stat, "usage_usec");
+  if (usage_usec >= 0) {
+    stats.cpu_ms = usage_usec / 1000;
+  }
+
+  // Each line is "<major>:<minor> rbytes=N wbytes=N rios=N ...".
+  const QString io_stat_file = dir.absoluteFilePath("io.stat");
+  if (QFile::exists(io_stat_file)) {
+    qint64 read_bytes = 0;
+    qint64 write_bytes = 0;
+    for (const QString& line : ReadFile(io_stat_file).split('\n')) {
+      for (const QString& field : line.split(' ')) {
+        if (field.startsWith("rbytes=")) {
+          read_bytes += field.mid(7).toLongLong();
+        } else if (field.startsWith("wbytes=")) {
+          write_bytes += field.mid(7).toLongLong();
+        }
+      }
+    }
+    stats.read_bytes = read_bytes;
+    stats.write_bytes = write_bytes;
+  }
+
+  // memory.peak is only available in kernel 5.19 and later.
+  const QString peak_file = dir.absoluteFilePath("memory.peak");
+  if (QFile::exists(peak_file)) {
+    stats.peak_memory = ReadFile(peak_file).trimmed().toLongLong();
+  }
+}
+
+}  // namespace installer
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_SERVICE_BACKEND_HOOK_CGROUP_H
+#define INSTALLER_SERVICE_BACKEND_HOOK_CGROUP_H
+
+#include <QString>
+
+namespace installer {
+
+struct HookStats;
+
+// Create parent cgroup of hook jobs and enable cpu, io and memory
+// controllers in it. Returns false if cgroup v2 is not available, then
+// resources used by jobs are collected by hook runner instead.
+// This function shall be called before any hook job starts.
+bool InitHookCgroups();
+
+// A cgroup v2 in which a hook job and all of its child processes run, even
+// if they are daemonized.
+class HookCgroup {
+ public:
+  explicit HookCgroup(const QString& name);
+  // Removes cgroup if it is created.
+  ~HookCgroup();
+
+  HookCgroup(const HookCgroup&) = delete;
+  HookCgroup& operator=(const HookCgroup&) = delete;
+
+  // Returns false if InitHookCgroups() failed or cgroup cannot be created.
+  bool create();
+
+  // Move process |pid| into this cgroup. Processes forked by it later stay
+  // in this cgroup.
+  bool addProcess(qint64 pid);
+
+  // Send |sig| to all processes in this cgroup.
+  void kill(int sig);
+
+  // Update |stats| with values available in this cgroup.
+  void readStats(HookStats& stats) const;
+
+ private:
+  QString path_;
+  bool created_ = false;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_SERVICE_BACKEND_HOOK_CGROUP_H
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "service/backend/hook_runner.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QMultiHash>
+#include <QProcess>
+
+#include "base/file_util.h"
+#include "service/backend/hook_cgroup.h"
+#include "service/backend/hook_stats.h"
+
+namespace installer {
+
+namespace {
+
+// Absolute path to hook_runner.sh on host.
+const char kHookRunnerFile[] = BUILTIN_HOOKS_DIR "/hook_runner.sh";
+
+// Absolute path to hook_runner.sh in chroot env, copied by
+// ChrootBindHooks().
+const char kChrootHookRunnerFile[] = "/tmp/installer/hook_runner.sh";
+const char kChrootDir[] = "/target";
+
+// Wait for session to quit, 5s.
+const int kQuitTimeout = 5000;
+
+// Terminated job is killed if it does not quit in 5s.
+const int kKillTimeout = 5000;
+
+// Returns |pid| and all of its descendant processes.
+QList<qint64> ListProcessTree(qint64 pid) {
+  QMultiHash<qint64, qint64> children;
+  const QDir proc_dir("/proc");
+  for (const QString& name : proc_dir.entryList(QDir::Dirs)) {
+    bool ok;
+    const qint64 child = name.toLongLong(&ok);
+    if (!ok) {
+      continue;
+    }
+    QFile file(proc_dir.absoluteFilePath(name + "/stat"));
+    if (!file.open(QIODevice::ReadOnly)) {
+      continue;
+    }
+    // Fields after comm, which may contain spaces: "state ppid ...".
+    const QByteArray stat = file.readAll();
+    const QList<QByteArray> fields =
+        stat.mid(stat.lastIndexOf(')') + 2).split(' ');
+    if (fields.length() > 1) {
+      children.insert(fields.at(1).toLongLong(), child);
+    }
+  }
+
+  QList<qint64> pids = { pid };
+  for (int i = 0; i < pids.length(); ++i) {
+    pids.append(children.values(pids.at(i)));
+  }
+  return pids;
+}
+
+// Send |sig| to job processes, in |cgroup| if it is available, or in
+// process tree of |pids| instead.
+void KillJob(HookCgroup& cgroup, bool in_cgroup, const QList<qint64>& pids,
+             int sig) {
+  if (in_cgroup) {
+    cgroup.kill(sig);
+  } else {
+    for (qint64 pid : pids) {
+      kill(pid_t(pid), sig);
+    }
+  }
+}
+
+}  // namespace
+
+HookRunner::HookRunner(bool in_chroot) : in_chroot_(in_chroot) {
+}
+
+HookRunner::~HookRunner() {
+  this->stop();
+}
+
+bool HookRunner::start() {
+  this->stop();
+
+  process_ = new QProcess();
+  if (in_chroot_) {
+    process_->setProgram("chroot");
+    process_->setArguments({kChrootDir, "/bin/bash", kChrootHookRunnerFile,
+                            "true"});
+  } else {
+    process_->setProgram("/bin/bash");
+    process_->setArguments({kHookRunnerFile});
+  }
+  // Stdout is framed output of jobs, stderr of runner itself is merged with
+  // current process.
+  process_->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+  process_->start();
+  if (!process_->waitForStarted(-1)) {
+    qCritical() << "Failed to start hook runner:" << process_->program()
+                << process_->arguments();
+    this->stop();
+    return false;
+  }
+  return true;
+}
+
+void HookRunner::stop() {
+  if (process_ == nullptr) {
+    return;
+  }
+  if (process_->state() != QProcess::NotRunning) {
+    process_->write("quit\n");
+    process_->closeWriteChannel();
+    if (!process_->waitForFinished(kQuitTimeout)) {
+      qWarning() << "Hook runner does not quit, kill it";
+      process_->kill();
+      process_->waitForFinished(-1);
+    }
+  }
+  delete process_;
+  process_ = nullptr;
+}
+
+bool HookRunner::isRunning() const {
+  return (process_ != nullptr && process_->state() == QProcess::Running);
+}
+
+bool HookRunner::runHook(const QString& hook, int hook_id, int timeout_ms,
+                         HookStats& stats) {
+  if (!this->isRunning() && !this->start()) {
+    return false;
+  }
+
+  job_id_ ++;
+  const QByteArray id = QByteArray::number(job_id_);
+  QElapsedTimer timer;
+  timer.start();
+  process_->write("run " + id + " " + QByteArray::number(hook_id) + " " +
+                  hook.toLocal8Bit() + "\n");
+
+  HookCgroup cgroup(QString("%1-%2").arg(getpid()).arg(GetFileName(hook)));
+  bool in_cgroup = false;
+  // Job processes to be killed if cgroup is not available.
+  QList<qint64> job_pids;
+  qint64 job_pid = -1;
+  // Time to send next signal to job, -1 if no deadline.
+  qint64 deadline = timeout_ms;
+  int kill_signal = SIGTERM;
+
+  // Each message is "<type> <id> <content>".
+  while (true) {
+    if (!process_->canReadLine()) {
+      const int wait_ms = (deadline < 0) ? -1 :
+          int(qMax(deadline - timer.elapsed(), qint64(0)));
+      if (process_->waitForReadyRead(wait_ms)) {
+        // Wait for the rest of line.
+        continue;
+      }
+      if (process_->state() != QProcess::Running) {
+        break;
+      }
+      if (deadline < 0 || timer.elapsed() < deadline) {
+        continue;
+      }
+
+      // Watchdog.
+      if (kill_signal == SIGTERM) {
+        qCritical() << "Hook" << GetFileName(hook) << "timed out after"
+                    << timeout_ms << "ms, terminate it";
+        stats.timed_out = true;
+        if (!in_cgroup && job_pid != -1) {
+          job_pids = ListProcessTree(job_pid);
+        }
+      } else if (kill_signal == SIGKILL) {
+        qCritical() << "Hook" << GetFileName(hook)
+                    << "does not quit, kill it";
+      } else {
+        // Children of job may still keep output pipes open.
+        break;
+      }
+      KillJob(cgroup, in_cgroup, job_pids, kill_signal);
+      kill_signal = (kill_signal == SIGTERM) ? SIGKILL : 0;
+      deadline = timer.elapsed() + kKillTimeout;
+      continue;
+    }
+
+    QByteArray line = process_->readLine();
+    line.chop(1);
+    const int type_end = line.indexOf(' ');
+    const int id_end = line.indexOf(' ', type_end + 1);
+    const QByteArray type = line.left(type_end);
+    const QByteArray content = (id_end == -1) ? QByteArray() :
+                                                line.mid(id_end + 1);
+    if (type == "out") {
+      fprintf(stdout, "%s\n", content.constData());
+      fflush(stdout);
+    } else if (type == "err") {
+      fprintf(stderr, "%s\n", content.constData());
+    } else if (type == "start") {
+      job_pid = content.toLongLong();
+      if (job_pid > 1) {
+        job_pids = { job_pid };
+        in_cgroup = cgroup.create() && cgroup.addProcess(job_pid);
+      } else {
+        qWarning() << "Invalid pid of job:" << line;
+        job_pid = -1;
+      }
+      // Job waits for this request before running hook.
+      process_->write("go " + id + "\n");
+    } else if (type == "stats") {
+      // "<cpu ticks> <bytes read> <bytes written>".
+      const QList<QByteArray> values = content.split(' ');
+      if (values.length() == 3) {
+        stats.cpu_ms = values.at(0).toLongLong() * 1000 /
+                       sysconf(_SC_CLK_TCK);
+        stats.read_bytes = values.at(1).toLongLong();
+        stats.write_bytes = values.at(2).toLongLong();
+      }
+    } else if (type == "exit") {
+      const int code = content.toInt();
+      stats.wall_ms = timer.elapsed();
+      // Values of cgroup include daemons started by job.
+      cgroup.readStats(stats);
+      qDebug() << "Hook" << GetFileName(hook) << "exited with" << code
+               << "in" << stats.wall_ms << "ms";
+      return (code == 0 && !stats.timed_out);
+    } else {
+      qWarning() << "Invalid message from hook runner:" << line;
+    }
+  }
+
+  stats.wall_ms = timer.elapsed();
+  if (process_->state() == QProcess::Running) {
+    qCritical() << "Hook runner is blocked by:" << hook;
+  } else {
+    qCritical() << "Hook runner exited while running:" << hook;
+  }
+  KillJob(cgroup, in_cgroup, job_pids, SIGKILL);
+  this->stop();
+  return false;
+}
+
+}  // namespace installer
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_SERVICE_BACKEND_HOOK_RUNNER_H
+#define INSTALLER_SERVICE_BACKEND_HOOK_RUNNER_H
+
+#include <QString>
+class QProcess;
+
+namespace installer {
+
+struct HookStats;
+
+// Runs hook jobs in a long-lived hooks/hook_runner.sh session, on host or in
+// chroot env of /target. Shared environment of hooks is loaded only once in
+// each session, instead of starting bash and chroot for each job.
+// Each job runs in its own subshell of the session, and its output is
+// forwarded to stdout and stderr of current process.
+// Each job runs in its own cgroup if InitHookCgroups() succeeded, and
+// resources used by it are collected.
+// This class is not thread safe, it shall be used in only one thread.
+class HookRunner {
+ public:
+  explicit HookRunner(bool in_chroot);
+  ~HookRunner();
+
+  HookRunner(const HookRunner&) = delete;
+  HookRunner& operator=(const HookRunner&) = delete;
+
+  // Start runner session. Returns false if failed.
+  bool start();
+
+  // Quit runner session if it is running. Jobs running in chroot env keep
+  // /target busy, so session in chroot shall be stopped before unmounting
+  // /target.
+  void stop();
+
+  bool isRunning() const;
+
+  // Run |hook| and wait for it to finish. Session is started first if it is
+  // not running. Returns true if |hook| exited with 0.
+  // |hook_id| is exported to |hook| as DI_HOOK_ID, see ProgressBus.
+  // If |timeout_ms| is not -1, job is terminated if it does not finish in
+  // time, and killed a few seconds later. Resources used by job are saved
+  // into |stats|.
+  bool runHook(const QString& hook, int hook_id, int timeout_ms,
+               HookStats& stats);
+
+ private:
+  bool in_chroot_;
+  QProcess* process_ = nullptr;
+  // Id of last job.
+  int job_id_ = 0;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_SERVICE_BACKEND_HOOK_RUNNER_H
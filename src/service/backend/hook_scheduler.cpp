@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "service/backend/hook_scheduler.h"
+
+#include <QDebug>
+#include <QRegularExpression>
+
+#include "base/file_util.h"
+
+namespace installer {
+
+namespace {
+
+const char kRequiresKey[] = "requires:";
+const char kExclusiveKey[] = "exclusive:";
+const char kTimeoutKey[] = "timeout:";
+// Names in header are separated by spaces or commas.
+const char kNameSeparator[] = "[\\s,]+";
+
+QStringList SplitNames(const QString& value) {
+  return value.split(QRegularExpression(kNameSeparator),
+                     QString::SkipEmptyParts);
+}
+
+}  // namespace
+
+bool ParseHookHeader(const QString& content, HookJob& job) {
+  bool found = false;
+  for (const QString& raw_line : content.split('\n')) {
+    const QString line = raw_line.trimmed();
+    if (line.isEmpty()) {
+      continue;
+    }
+    if (!line.startsWith('#')) {
+      // End of leading comment lines.
+      break;
+    }
+    const QString comment = line.mid(1).trimmed();
+    if (comment.startsWith(kRequiresKey)) {
+      const QString value = comment.mid(sizeof(kRequiresKey) - 1);
+      for (const QString& name : SplitNames(value)) {
+        // Extension name of required hook is optional.
+        job.required_jobs.append(GetFileBasename(name));
+      }
+      found = true;
+    } else if (comment.startsWith(kExclusiveKey)) {
+      const QString value = comment.mid(sizeof(kExclusiveKey) - 1);
+      job.exclusive.append(SplitNames(value));
+      found = true;
+    } else if (comment.startsWith(kTimeoutKey)) {
+      const QString value = comment.mid(sizeof(kTimeoutKey) - 1).trimmed();
+      bool ok;
+      const int timeout = value.toInt(&ok);
+      if (ok && timeout >= 0) {
+        job.timeout = timeout;
+      } else {
+        qWarning() << "Invalid timeout in hook header:" << value;
+      }
+    }
+  }
+  job.has_header = found;
+  return found;
+}
+
+HookScheduler::HookScheduler(const QStringList& hooks, int max_jobs)
+    : max_jobs_(qMax(max_jobs, 1)) {
+  for (const QString& hook : hooks) {
+    HookJob job;
+    job.file = hook;
+    job.name = GetFileBasename(hook);
+    ParseHookHeader(ReadFile(hook), job);
+    jobs_.append(job);
+  }
+  states_.fill(JobState::Pending, jobs_.length());
+  deps_.resize(jobs_.length());
+
+  // Index of last job without header block.
+  int barrier = -1;
+  for (int index = 0; index < jobs_.length(); ++index) {
+    const HookJob& job = jobs_.at(index);
+    QVector<int>& deps = deps_[index];
+    if (!job.has_header) {
+      for (int prev = 0; prev < index; ++prev) {
+        deps.append(prev);
+      }
+      barrier = index;
+      continue;
+    }
+
+    if (barrier != -1) {
+      deps.append(barrier);
+    }
+    for (const QString& name : job.required_jobs) {
+      int dep = -1;
+      for (int i = 0; i < jobs_.length(); ++i) {
+        if (jobs_.at(i).name == name) {
+          dep = i;
+          break;
+        }
+      }
+      if (dep == -1 || dep == index) {
+        // Required job might be removed by oem.
+        qWarning() << "Hook" << job.name << "requires unknown job:" << name;
+      } else if (!deps.contains(dep)) {
+        deps.append(dep);
+      }
+    }
+  }
+}
+
+QStringList HookScheduler::takeReadyHooks() {
+  QStringList hooks;
+  for (int index = 0; index < jobs_.length(); ++index) {
+    if (running_count_ >= max_jobs_) {
+      break;
+    }
+    if (states_.at(index) == JobState::Pending && this->isReady(index)) {
+      this->startJob(index);
+      hooks.append(jobs_.at(index).file);
+    }
+  }
+
+  if (hooks.isEmpty() && running_count_ == 0 && !this->isDone()) {
+    // Required jobs form a cycle, break it by running the first pending job.
+    const int index = states_.indexOf(JobState::Pending);
+    qWarning() << "Dependency cycle found in hook:" << jobs_.at(index).name;
+    this->startJob(index);
+    hooks.append(jobs_.at(index).file);
+  }
+  return hooks;
+}
+
+void HookScheduler::finishHook(const QString& hook) {
+  for (int index = 0; index < jobs_.length(); ++index) {
+    if (jobs_.at(index).file == hook &&
+        states_.at(index) == JobState::Running) {
+      states_[index] = JobState::Finished;
+      running_count_ --;
+      finished_count_ ++;
+      for (const QString& resource : jobs_.at(index).exclusive) {
+        busy_resources_.removeOne(resource);
+      }
+      return;
+    }
+  }
+  qWarning() << "HookScheduler::finishHook() hook is not running:" << hook;
+}
+
+bool HookScheduler::isReady(int index) const {
+  for (int dep : deps_.at(index)) {
+    if (states_.at(dep) != JobState::Finished) {
+      return false;
+    }
+  }
+  for (const QString& resource : jobs_.at(index).exclusive) {
+    if (busy_resources_.contains(resource)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void HookScheduler::startJob(int index) {
+  states_[index] = JobState::Running;
+  running_count_ ++;
+  busy_resources_.append(jobs_.at(index).exclusive);
+}
+
+}  // namespace installer
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_SERVICE_BACKEND_HOOK_SCHEDULER_H
+#define INSTALLER_SERVICE_BACKEND_HOOK_SCHEDULER_H
+
+#include <QList>
+#include <QStringList>
+#include <QVector>
+
+namespace installer {
+
+// A hook job and its header block.
+struct HookJob {
+  // Absolute path to hook file.
+  QString file;
+
+  // Filename without extension, like "53_setup_user".
+  QString name;
+
+  // Names of jobs which shall be finished before this one starts.
+  QStringList required_jobs;
+
+  // Names of resources used exclusively by this job, like "dpkg". Jobs with
+  // the same resource never run at the same time.
+  QStringList exclusive;
+
+  // Hook without header block runs alone, after all jobs before it in
+  // filename order and before all jobs after it.
+  bool has_header = false;
+
+  // Job is killed if it does not finish in |timeout| seconds, 0 means
+  // default value in settings. It does not change how job is scheduled.
+  int timeout = 0;
+};
+
+// Parse header block in leading comment lines of hook script |content| into
+// |job|, like:
+//   # requires: 53_setup_user 54_prepare_customize_user
+//   # exclusive: dpkg
+//   # timeout: 600
+// Names are separated by spaces or commas. Returns true if requires or
+// exclusive is found.
+bool ParseHookHeader(const QString& content, HookJob& job);
+
+// Decides which hook jobs can run now, based on their header blocks.
+// Jobs are started in filename order once their required jobs are finished
+// and their exclusive resources are free, up to |max_jobs| at a time.
+// If no job has header block, all jobs run one by one in filename order.
+class HookScheduler {
+ public:
+  // |hooks| are absolute paths sorted by filename.
+  HookScheduler(const QStringList& hooks, int max_jobs);
+
+  // Mark jobs which can be started now as running and returns their paths.
+  QStringList takeReadyHooks();
+
+  // Mark running |hook| as finished.
+  void finishHook(const QString& hook);
+
+  int finishedCount() const { return finished_count_; }
+  int runningCount() const { return running_count_; }
+
+  // Returns true if all jobs are finished.
+  bool isDone() const { return finished_count_ == jobs_.length(); }
+
+ private:
+  enum class JobState {
+    Pending,
+    Running,
+    Finished,
+  };
+
+  // Returns true if job at |index| can be started now.
+  bool isReady(int index) const;
+
+  // Mark job at |index| as running.
+  void startJob(int index);
+
+  QList<HookJob> jobs_;
+  QVector<JobState> states_;
+  // Index of jobs required by each job.
+  QVector<QVector<int>> deps_;
+  // Exclusive resources held by running jobs.
+  QStringList busy_resources_;
+  int max_jobs_;
+  int running_count_ = 0;
+  int finished_count_ = 0;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_SERVICE_BACKEND_HOOK_SCHEDULER_H
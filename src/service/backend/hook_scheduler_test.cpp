@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "service/backend/hook_scheduler.h"
+
+#include "base/file_util.h"
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+const char kHooksDir[] = "/tmp/hook-scheduler-test";
+
+// Write hook |name| with |header| into test folder, returns its path.
+QString WriteHook(const QString& name, const QString& header) {
+  const QString path = QString("%1/%2.job").arg(kHooksDir).arg(name);
+  EXPECT_TRUE(CreateParentDirs(path));
+  EXPECT_TRUE(WriteTextFile(path, "#!/bin/bash\n#\n" + header +
+                                  "\n# Comment\n\nreturn 0\n"));
+  return path;
+}
+
+TEST(HookSchedulerTest, ParseHookHeader) {
+  HookJob job;
+  EXPECT_TRUE(ParseHookHeader("#!/bin/bash\n"
+                              "# requires: 53_setup_user, 54_customize.job\n"
+                              "# exclusive: dpkg\n"
+                              "\n"
+                              "# exclusive: apt\n"
+                              "echo '# requires: 99_print_info'\n",
+                              job));
+  EXPECT_TRUE(job.has_header);
+  EXPECT_EQ(job.required_jobs,
+            QStringList({ "53_setup_user", "54_customize" }));
+  EXPECT_EQ(job.exclusive, QStringList({ "dpkg", "apt" }));
+  EXPECT_EQ(job.timeout, 0);
+
+  HookJob timeout_job;
+  EXPECT_FALSE(ParseHookHeader("#!/bin/bash
+# timeout: 600
+return 0
+",
+                               timeout_job));
+  EXPECT_FALSE(timeout_job.has_header);
+  EXPECT_EQ(timeout_job.timeout, 600);
+
+  HookJob plain_job;
+  EXPECT_FALSE(ParseHookHeader("#!/bin/bash\n# Comment\nreturn 0\n",
+                               plain_job));
+  EXPECT_FALSE(plain_job.has_header);
+}
+
+TEST(HookSchedulerTest, RunInFilenameOrder) {
+  const QStringList hooks = {
+    WriteHook("00_first", ""),
+    WriteHook("01_second", ""),
+  };
+  HookScheduler scheduler(hooks, 4);
+  EXPECT_EQ(scheduler.takeReadyHooks(), QStringList({ hooks.at(0) }));
+  EXPECT_TRUE(scheduler.takeReadyHooks().isEmpty());
+  scheduler.finishHook(hooks.at(0));
+  EXPECT_EQ(scheduler.takeReadyHooks(), QStringList({ hooks.at(1) }));
+  scheduler.finishHook(hooks.at(1));
+  EXPECT_TRUE(scheduler.isDone());
+}
+
+TEST(HookSchedulerTest, RunInParallel) {
+  const QStringList hooks = {
+    WriteHook("10_barrier", ""),
+    WriteHook("11_font_cache", "# requires:"),
+    WriteHook("12_gtk_modules", "# exclusive: dpkg"),
+    WriteHook("13_drivers", "# exclusive: dpkg"),
+    WriteHook("14_lightdm", "# requires: 11_font_cache"),
+    WriteHook("15_barrier", ""),
+  };
+  HookScheduler scheduler(hooks, 4);
+  EXPECT_EQ(scheduler.takeReadyHooks(), QStringList({ hooks.at(0) }));
+  scheduler.finishHook(hooks.at(0));
+
+  // 13 waits for dpkg, 14 waits for 11.
+  EXPECT_EQ(scheduler.takeReadyHooks(),
+            QStringList({ hooks.at(1), hooks.at(2) }));
+  scheduler.finishHook(hooks.at(2));
+  EXPECT_EQ(scheduler.takeReadyHooks(), QStringList({ hooks.at(3) }));
+  scheduler.finishHook(hooks.at(1));
+  EXPECT_EQ(scheduler.takeReadyHooks(), QStringList({ hooks.at(4) }));
+  EXPECT_EQ(scheduler.runningCount(), 2);
+
+  // Barrier waits for all jobs before it.
+  scheduler.finishHook(hooks.at(4));
+  EXPECT_TRUE(scheduler.takeReadyHooks().isEmpty());
+  scheduler.finishHook(hooks.at(3));
+  EXPECT_EQ(scheduler.takeReadyHooks(), QStringList({ hooks.at(5) }));
+  scheduler.finishHook(hooks.at(5));
+  EXPECT_TRUE(scheduler.isDone());
+  EXPECT_EQ(scheduler.finishedCount(), hooks.length());
+}
+
+}  // namespace
+}  // namespace installer
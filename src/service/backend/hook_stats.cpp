@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "service/backend/hook_stats.h"
+
+#include <algorithm>
+#include <QStringList>
+
+namespace installer {
+
+namespace {
+
+const qint64 kMebibyte = 1024 * 1024;
+
+// Width of job name column.
+const int kNameWidth = 40;
+const int kValueWidth = 10;
+
+QString FormatSeconds(qint64 ms) {
+  if (ms < 0) {
+    return "-";
+  }
+  return QString::number(ms / 1000.0, 'f', 1);
+}
+
+QString FormatMebibytes(qint64 bytes) {
+  if (bytes < 0) {
+    return "-";
+  }
+  return QString::number(double(bytes) / kMebibyte, 'f', 1);
+}
+
+QString FormatRow(const QStringList& values) {
+  QString row = values.first().leftJustified(kNameWidth);
+  for (int i = 1; i < values.length(); ++i) {
+    row += values.at(i).rightJustified(kValueWidth);
+  }
+  return row;
+}
+
+void AddValue(qint64& sum, qint64 value) {
+  if (value >= 0) {
+    sum = (sum < 0) ? value : sum + value;
+  }
+}
+
+}  // namespace
+
+QString FormatHookStatsTable(const QList<HookStatsItem>& items) {
+  QList<HookStatsItem> sorted_items(items);
+  std::stable_sort(sorted_items.begin(), sorted_items.end(),
+                   [](const HookStatsItem& a, const HookStatsItem& b) {
+                     return a.second.wall_ms > b.second.wall_ms;
+                   });
+
+  QStringList lines;
+  lines.append(FormatRow({"job", "wall(s)", "cpu(s)", "read(M)", "write(M)",
+                          "peak(M)"}));
+  for (const HookStatsItem& item : sorted_items) {
+    const HookStats& stats = item.second;
+    QString name = item.first;
+    if (stats.timed_out) {
+      name += " [timeout]";
+    }
+    lines.append(FormatRow({name,
+                            FormatSeconds(stats.wall_ms),
+                            FormatSeconds(stats.cpu_ms),
+                            FormatMebibytes(stats.read_bytes),
+                            FormatMebibytes(stats.write_bytes),
+                            FormatMebibytes(stats.peak_memory)}));
+  }
+  return lines.join('\n');
+}
+
+HookStats SumHookStats(const QList<HookStatsItem>& items) {
+  HookStats sum;
+  for (const HookStatsItem& item : items) {
+    const HookStats& stats = item.second;
+    sum.wall_ms += stats.wall_ms;
+    AddValue(sum.cpu_ms, stats.cpu_ms);
+    AddValue(sum.read_bytes, stats.read_bytes);
+    AddValue(sum.write_bytes, stats.write_bytes);
+    // Peak memory of jobs is not accumulative.
+    sum.peak_memory = qMax(sum.peak_memory, stats.peak_memory);
+    sum.timed_out = sum.timed_out || stats.timed_out;
+  }
+  return sum;
+}
+
+}  // namespace installer
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_SERVICE_BACKEND_HOOK_STATS_H
+#define INSTALLER_SERVICE_BACKEND_HOOK_STATS_H
+
+#include <QList>
+#include <QPair>
+#include <QString>
+
+namespace installer {
+
+// Resources used by a hook job and all of its child processes.
+// Values are -1 if they are not available.
+struct HookStats {
+  qint64 wall_ms = 0;
+  // User and system cpu time.
+  qint64 cpu_ms = -1;
+  // Bytes read from and written to block devices.
+  qint64 read_bytes = -1;
+  qint64 write_bytes = -1;
+  // Peak memory usage, only available with cgroup v2.
+  qint64 peak_memory = -1;
+  // Job is killed by watchdog.
+  bool timed_out = false;
+};
+
+typedef QPair<QString, HookStats> HookStatsItem;
+
+// Format |items| as a table, one line per job, sorted by wall time. Items
+// are pairs of job name and its stats.
+QString FormatHookStatsTable(const QList<HookStatsItem>& items);
+
+// Add up stats of all |items|. Values not available in any item are ignored.
+HookStats SumHookStats(const QList<HookStatsItem>& items);
+
+}  // namespace installer
+
+#endif  // INSTALLER_SERVICE_BACKEND_HOOK_STATS_H
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "service/backend/hook_stats.h"
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+QList<HookStatsItem> GetTestItems() {
+  HookStats fast;
+  fast.wall_ms = 500;
+  fast.cpu_ms = 100;
+  fast.read_bytes = 1024 * 1024;
+  fast.write_bytes = 0;
+
+  HookStats slow;
+  slow.wall_ms = 120000;
+  slow.cpu_ms = 90000;
+  slow.read_bytes = 3 * 1024 * 1024;
+  slow.write_bytes = 512 * 1024 * 1024;
+  slow.peak_memory = 256 * 1024 * 1024;
+
+  HookStats hung;
+  hung.wall_ms = 60000;
+  hung.timed_out = true;
+
+  return { {"00_fast.job", fast}, {"21_slow.job", slow},
+           {"23_hung.job", hung} };
+}
+
+TEST(HookStatsTest, FormatHookStatsTable) {
+  const QStringList lines =
+      FormatHookStatsTable(GetTestItems()).split('\n');
+  ASSERT_EQ(lines.length(), 4);
+  EXPECT_TRUE(lines.at(0).startsWith("job"));
+  // Sorted by wall time.
+  EXPECT_TRUE(lines.at(1).startsWith("21_slow.job"));
+  EXPECT_EQ(lines.at(1).split(' ', QString::SkipEmptyParts),
+            QStringList({"21_slow.job", "120.0", "90.0", "3.0", "512.0",
+                         "256.0"}));
+  EXPECT_TRUE(lines.at(2).startsWith("23_hung.job [timeout]"));
+  EXPECT_TRUE(lines.at(2).endsWith("-"));
+  EXPECT_TRUE(lines.at(3).startsWith("00_fast.job"));
+}
+
+TEST(HookStatsTest, SumHookStats) {
+  const HookStats sum = SumHookStats(GetTestItems());
+  EXPECT_EQ(sum.wall_ms, 180500);
+  EXPECT_EQ(sum.cpu_ms, 90100);
+  EXPECT_EQ(sum.read_bytes, 4 * 1024 * 1024);
+  EXPECT_EQ(sum.peak_memory, 256 * 1024 * 1024);
+  EXPECT_TRUE(sum.timed_out);
+
+  EXPECT_EQ(SumHookStats({}).cpu_ms, -1);
+}
+
+}  // namespace
+}  // namespace installer
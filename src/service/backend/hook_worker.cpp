@@ -21,6 +21,11 @@
 
 #include "base/command.h"
 #include "base/file_util.h"
+#include "base/trace.h"
+#include "service/backend/hook_runner.h"
+#include "service/backend/hook_scheduler.h"
+#include "service/settings_manager.h"
+#include "service/settings_name.h"
 
 namespace installer {
 
@@ -29,23 +34,80 @@ namespace {
 // Absolute path to hook_manager.sh
 const char kHookManagerFile[] = BUILTIN_HOOKS_DIR "/hook_manager.sh";
 
-// Runs a specific hook at |hook|.
-bool RunHook(const QString& hook) {
-  const QStringList args = {kHookManagerFile, hook};
-  return RunScriptFile(args);
+// Runs a specific hook at |hook| in a new hook_manager.sh process, used if
+// hook runner session cannot be started. |hook_id| is exported as DI_HOOK_ID.
+bool RunHook(const QString& hook, int hook_id, int timeout_ms,
+             HookStats& stats) {
+  CommandOptions options;
+  options.capture_output = false;
+  options.timeout_ms = timeout_ms;
+  const CommandResult result = RunCmd("env", {
+      QString("DI_HOOK_ID=%1").arg(hook_id),
+      "/bin/bash", kHookManagerFile, hook,
+  }, options);
+  stats.wall_ms = result.wall_ms;
+  stats.cpu_ms = result.cpu_ms;
+  stats.timed_out = result.timed_out;
+  return result.ok;
+}
+
+// Returns true if |hook| runs in chroot env.
+bool IsChrootHook(const QString& hook) {
+  return hook.contains("/in_chroot/");
 }
 
 }  // namespace
 
-HookWorker::HookWorker(QObject* parent) : QObject(parent) {
+HookWorker::HookWorker(QObject* parent)
+    : QObject(parent),
+      host_runner_(new HookRunner(false)),
+      chroot_runner_(new HookRunner(true)),
+      default_timeout_(GetSettingsInt(kHooksJobTimeout)) {
   this->setObjectName("hook_worker");
   connect(this, &HookWorker::runHook,
           this, &HookWorker::handleRunHook);
+  connect(this, &HookWorker::stopRunners,
+          this, &HookWorker::handleStopRunners);
+}
+
+HookWorker::~HookWorker() {
+  delete host_runner_;
+  host_runner_ = nullptr;
+  delete chroot_runner_;
+  chroot_runner_ = nullptr;
+}
+
+void HookWorker::handleRunHook(const QString& hook, int hook_id) {
+  HookRunner* runner = IsChrootHook(hook) ? chroot_runner_ : host_runner_;
+  ScopedTrace trace("hook", GetFileName(hook), {{"file", hook}});
+
+  HookJob job;
+  ParseHookHeader(ReadFile(hook), job);
+  const int timeout = (job.timeout > 0) ? job.timeout : default_timeout_;
+  const int timeout_ms = (timeout > 0) ? timeout * 1000 : -1;
+
+  HookStats stats;
+  bool ok;
+  if (runner->isRunning() || runner->start()) {
+    ok = runner->runHook(hook, hook_id, timeout_ms, stats);
+  } else {
+    trace.addArg("runner", "hook_manager.sh");
+    ok = RunHook(hook, hook_id, timeout_ms, stats);
+  }
+  trace.addArg("ok", ok);
+  trace.addArg("cpu_ms", stats.cpu_ms);
+  trace.addArg("read_bytes", stats.read_bytes);
+  trace.addArg("write_bytes", stats.write_bytes);
+  trace.addArg("peak_memory", stats.peak_memory);
+  if (stats.timed_out) {
+    trace.addArg("timed_out", true);
+  }
+  emit this->hookFinished(hook, ok, stats);
 }
 
-void HookWorker::handleRunHook(const QString& hook) {
-  const bool ok = RunHook(hook);
-  emit this->hookFinished(ok);
+void HookWorker::handleStopRunners() {
+  host_runner_->stop();
+  chroot_runner_->stop();
 }
 
 }  // namespace installer
\ No newline at end of file
@@ -20,25 +20,49 @@
 
 #include <QObject>
 
+#include "service/backend/hook_stats.h"
+
 namespace installer {
 
+class HookRunner;
+
 // Run hook script in background thread.
+// Hooks are run in hook runner sessions, one on host and one in chroot env,
+// which are started when running first hook. See HookRunner.
+// Hooks are killed if they run longer than timeout in their header or in
+// settings.
 class HookWorker : public QObject {
   Q_OBJECT
 
  public:
   explicit HookWorker(QObject* parent = nullptr);
+  ~HookWorker();
 
  signals:
-  // Notify this worker to run another |hook|.
+  // Notify this worker to run another |hook|, whose progress reports are
+  // tagged with |hook_id|, see ProgressModel::hookId().
   // Emit this signal only after receiving hooksFinished() signal.
-  void runHook(const QString& hook);
+  void runHook(const QString& hook, int hook_id);
+
+  // Emitted when current |hook| finished with result |ok|. |stats| are
+  // resources used by |hook|.
+  void hookFinished(const QString& hook, bool ok, const HookStats& stats);
+
+  // Notify this worker to quit its hook runner sessions, which are started
+  // again when running next hook.
+  void stopRunners();
+
+ private:
+  HookRunner* host_runner_ = nullptr;
+  HookRunner* chroot_runner_ = nullptr;
 
-  // Emitted when current hook finished with result |ok|.
-  void hookFinished(bool ok);
+  // Timeout of hooks without timeout in header, in seconds, 0 means no
+  // limit.
+  int default_timeout_;
 
  private slots:
-  void handleRunHook(const QString& hook);
+  void handleRunHook(const QString& hook, int hook_id);
+  void handleStopRunners();
 };
 
 }  // namespace installer
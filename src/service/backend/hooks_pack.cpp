@@ -17,11 +17,15 @@
 
 #include "service/backend/hooks_pack.h"
 
+#include <errno.h>
+#include <string.h>
+#include <sys/mount.h>
 #include <QDebug>
 #include <QDir>
+#include <QDirIterator>
 
-#include "base/command.h"
 #include "base/file_util.h"
+#include "base/trace.h"
 #include "service/settings_manager.h"
 
 namespace installer {
@@ -35,36 +39,27 @@ const char kAfterChrootDir[] = "after_chroot";
 const char kTargetHooksDir[] = "/tmp/installer";
 const char kChrootTargetHooksDir[] = "/target/tmp/installer";
 
-bool AddExecutable(const QString& path, bool recursive) {
-  if (recursive) {
-    return SpawnCmd("/bin/chmod", {"-R", "a+x", path});
-  } else {
-    return SpawnCmd("/bin/chmod", {"a+x", path});
+// Add executable permissions to all files in |folder|, like `chmod -R a+x`.
+bool AddExecutable(const QString& folder) {
+  const QFile::Permissions exe_perms =
+      QFile::ExeOwner | QFile::ExeGroup | QFile::ExeOther;
+  QDirIterator iter(folder, QDir::Files | QDir::NoDotAndDotDot,
+                    QDirIterator::Subdirectories);
+  while (iter.hasNext()) {
+    const QString path = iter.next();
+    if (!QFile::setPermissions(path, QFile::permissions(path) | exe_perms)) {
+      qCritical() << "Failed to add executable permissions:" << path;
+      return false;
+    }
   }
+  return true;
 }
 
 // Returns a list of sorted hook scripts with |hook_type|.
 QStringList ListHooks(HookType hook_type) {
   // Absolute file path to hooks.
   QStringList hooks;
-  QString folder_name;
-  switch (hook_type) {
-    case HookType::BeforeChroot: {
-      folder_name = kBeforeChrootDir;
-      break;
-    }
-
-    case HookType::InChroot: {
-      folder_name = kInChrootDir;
-      break;
-    }
-
-    case HookType::AfterChroot: {
-      folder_name = kAfterChrootDir;
-      break;
-    }
-  }
-
+  const QString folder_name = GetHookTypeName(hook_type);
   const QStringList name_filter = { "*.job" };
   const QDir::Filters dir_filter = QDir::Files | QDir::NoDotAndDotDot;
   QDir builtin_dir(QDir(kTargetHooksDir).absoluteFilePath(folder_name));
@@ -76,12 +71,25 @@ QStringList ListHooks(HookType hook_type) {
   return hooks;
 }
 
-bool RemoveFolderRecursively(const QString& path) {
-  return SpawnCmd("/bin/rm", {"-r", "-f", path});
-}
-
 }  // namespace
 
+QString GetHookTypeName(HookType type) {
+  switch (type) {
+    case HookType::BeforeChroot: {
+      return kBeforeChrootDir;
+    }
+
+    case HookType::InChroot: {
+      return kInChrootDir;
+    }
+
+    case HookType::AfterChroot: {
+      return kAfterChrootDir;
+    }
+  }
+  return QString();
+}
+
 void HooksPack::init(HookType type, int progress_begin, int progress_end,
                      HooksPack* next) {
   this->type = type;
@@ -89,12 +97,13 @@ void HooksPack::init(HookType type, int progress_begin, int progress_end,
   this->progress_end = progress_end;
   this->next = next;
   this->hooks = ListHooks(type);
-  this->current_hook = -1;
 }
 
 bool CopyHooks() {
+  ScopedTrace trace("hooks", "copy_hooks");
   // First, remove old folder.
-  if (!RemoveFolderRecursively(kTargetHooksDir)) {
+  QDir target_dir(kTargetHooksDir);
+  if (target_dir.exists() && !target_dir.removeRecursively()) {
     qCritical() << "Failed to remove hooks folder:" << kTargetHooksDir;
     return false;
   }
@@ -113,7 +122,7 @@ bool CopyHooks() {
   }
 
   // Add executable permissions
-  if (!AddExecutable(kTargetHooksDir, true)) {
+  if (!AddExecutable(kTargetHooksDir)) {
     qCritical() << "Failed to add executable permissions to hooks";
     return false;
   }
@@ -121,24 +130,27 @@ bool CopyHooks() {
   return true;
 }
 
-bool ChrootCopyHooks() {
-  // Remove old folders.
-  if (!RemoveFolderRecursively(kChrootTargetHooksDir)) {
-    qCritical() << "Failed to remove hooks folder:"
-                << kChrootTargetHooksDir;
+bool ChrootBindHooks() {
+  ScopedTrace trace("hooks", "chroot_bind_hooks");
+  if (!CreateDirs(kChrootTargetHooksDir)) {
+    qCritical() << "Failed to create hooks folder:" << kChrootTargetHooksDir;
     return false;
   }
 
-  if (!CopyFolder(kTargetHooksDir, kChrootTargetHooksDir)) {
-    qCritical() << "Failed to copy hooks to:" << kChrootTargetHooksDir;
+  // Hooks in chroot env and on host share the same files, it is unmounted
+  // with other folders in /target by 90_unmount.job.
+  if (mount(kTargetHooksDir, kChrootTargetHooksDir, nullptr, MS_BIND,
+            nullptr) != 0) {
+    qCritical() << "Failed to bind hooks folder to:" << kChrootTargetHooksDir
+                << strerror(errno);
     return false;
   }
 
-  // Add executable permissions
-  if (!AddExecutable(kChrootTargetHooksDir, true)) {
-    qCritical() << "Failed to add executable permissions to hooks:"
-                << kChrootTargetHooksDir;
-    return false;
+  // Flags of bind mount can only be changed by remounting it.
+  if (mount(nullptr, kChrootTargetHooksDir, nullptr,
+            MS_BIND | MS_REMOUNT | MS_RDONLY, nullptr) != 0) {
+    qWarning() << "Failed to make hooks folder read-only:"
+               << kChrootTargetHooksDir << strerror(errno);
   }
 
   return true;
@@ -29,23 +29,27 @@ enum class HookType {
   AfterChroot,
 };
 
+// Returns name of |type|, which is also name of its hooks folder.
+QString GetHookTypeName(HookType type);
+
 struct HooksPack {
   void init(HookType type, int progress_begin, int progress_end,
             HooksPack* next);
 
   HookType type;
   QStringList hooks;
-  int current_hook;
   int progress_begin;
   int progress_end;
   HooksPack* next = nullptr;
 };
 
-// Copy hooks from system and oem folder to /tmp/installer
+// Copy hooks from system and oem folder to /tmp/installer, and add
+// executable permissions to them.
 bool CopyHooks();
 
-// Copy hooks from /tmp/installer to /target/tmp/installer
-bool ChrootCopyHooks();
+// Bind mount /tmp/installer to /target/tmp/installer read-only, so that hooks
+// in chroot env are always the same as on host.
+bool ChrootBindHooks();
 
 }  // namespace installer
 
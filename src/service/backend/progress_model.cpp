@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "service/backend/progress_model.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "base/file_util.h"
+
+namespace installer {
+
+namespace {
+
+// Category of hook events in trace, see HookWorker.
+const char kHookTraceCategory[] = "hook";
+
+// Expected duration of hooks not found in profile.
+const double kDefaultHookSeconds = 2.0;
+// Hooks finished immediately still take a little progress.
+const double kMinHookSeconds = 0.1;
+
+// Remaining time is estimated by speed of this machine only after this ratio
+// of work is done.
+const double kMinEstimateRatio = 0.05;
+
+// Parse |content| of profile file. Trace file is an unterminated JSON array.
+QJsonDocument ParseProfile(const QString& content) {
+  QJsonDocument doc = QJsonDocument::fromJson(content.toUtf8());
+  if (doc.isNull()) {
+    QString array = content.trimmed();
+    if (array.startsWith('[') && !array.endsWith(']')) {
+      if (array.endsWith(',')) {
+        array.chop(1);
+      }
+      array.append(']');
+      doc = QJsonDocument::fromJson(array.toUtf8());
+    }
+  }
+  return doc;
+}
+
+}  // namespace
+
+ProgressModel::ProgressModel()
+    : progress_begin_(0),
+      progress_end_(100) {
+}
+
+bool ProgressModel::loadProfile(const QString& file) {
+  if (!QFile::exists(file)) {
+    return false;
+  }
+  const QJsonDocument doc = ParseProfile(ReadFile(file));
+  bool ok = false;
+  if (doc.isObject()) {
+    const QJsonObject object = doc.object();
+    for (auto iter = object.constBegin(); iter != object.constEnd(); ++iter) {
+      const double seconds = iter.value().toDouble(-1);
+      if (seconds >= 0) {
+        durations_.insert(iter.key(), qMax(seconds, kMinHookSeconds));
+        ok = true;
+      }
+    }
+  } else if (doc.isArray()) {
+    // Average duration of each hook, in case of hooks run more than once.
+    QHash<QString, double> sums;
+    QHash<QString, int> counts;
+    for (const QJsonValue& value : doc.array()) {
+      const QJsonObject event = value.toObject();
+      if (event.value("cat").toString() == kHookTraceCategory &&
+          event.value("ph").toString() == "X") {
+        const QString name = event.value("name").toString();
+        // Duration in trace is in microseconds.
+        sums[name] += event.value("dur").toDouble() / 1000000.0;
+        counts[name] += 1;
+      }
+    }
+    for (auto iter = sums.constBegin(); iter != sums.constEnd(); ++iter) {
+      const double seconds = iter.value() / counts.value(iter.key());
+      durations_.insert(iter.key(), qMax(seconds, kMinHookSeconds));
+      ok = true;
+    }
+  }
+
+  if (!ok) {
+    qWarning() << "Invalid hooks profile:" << file;
+  }
+  return ok;
+}
+
+double ProgressModel::expectedSeconds(const QString& hook) const {
+  return durations_.value(GetFileName(hook), kDefaultHookSeconds);
+}
+
+void ProgressModel::addHooks(const QStringList& hooks, int progress_begin,
+                             int progress_end) {
+  if (items_.isEmpty()) {
+    progress_begin_ = progress_begin;
+  }
+  progress_end_ = progress_end;
+  for (const QString& hook : hooks) {
+    Item item;
+    item.hook = hook;
+    if (this->hasProfile()) {
+      item.weight = this->expectedSeconds(hook);
+    } else {
+      item.weight = double(progress_end - progress_begin) / hooks.length();
+    }
+    item.fraction = 0;
+    item.running = false;
+    indexes_.insert(hook, items_.length());
+    items_.append(item);
+  }
+}
+
+int ProgressModel::hookId(const QString& hook) const {
+  return indexes_.value(hook, -1) + 1;
+}
+
+void ProgressModel::startHook(const QString& hook) {
+  if (!timer_.isValid()) {
+    timer_.start();
+  }
+  const int index = indexes_.value(hook, -1);
+  if (index != -1) {
+    items_[index].running = true;
+  }
+}
+
+void ProgressModel::finishHook(const QString& hook) {
+  const int index = indexes_.value(hook, -1);
+  if (index != -1) {
+    items_[index].running = false;
+    items_[index].fraction = 1;
+  }
+}
+
+void ProgressModel::reportProgress(int hook_id, int percent) {
+  int index = hook_id - 1;
+  if (hook_id == 0) {
+    for (int i = 0; i < items_.length(); ++i) {
+      if (items_.at(i).running &&
+          (index == -1 || items_.at(i).weight > items_.at(index).weight)) {
+        index = i;
+      }
+    }
+  }
+  if (index >= 0 && index < items_.length() && items_.at(index).running) {
+    Item& item = items_[index];
+    // Progress of a hook never goes backward.
+    item.fraction = qBound(item.fraction, percent / 100.0, 1.0);
+  }
+}
+
+int ProgressModel::progress() const {
+  double total;
+  const double done = this->doneWeight(total);
+  if (total <= 0) {
+    return progress_begin_;
+  }
+  return progress_begin_ +
+      int((progress_end_ - progress_begin_) * done / total);
+}
+
+int ProgressModel::remainingSeconds() const {
+  if (!timer_.isValid()) {
+    return -1;
+  }
+  return this->remainingSeconds(timer_.elapsed());
+}
+
+int ProgressModel::remainingSeconds(qint64 elapsed_ms) const {
+  double total;
+  const double done = this->doneWeight(total);
+  if (total <= 0) {
+    return -1;
+  }
+  const double ratio = done / total;
+  if (ratio >= 1) {
+    return 0;
+  }
+  if (ratio < kMinEstimateRatio) {
+    // Too early to measure speed of this machine, use expected durations.
+    if (!this->hasProfile()) {
+      return -1;
+    }
+    return int(total - done + 0.5);
+  }
+  return int(elapsed_ms / 1000.0 * (1 - ratio) / ratio + 0.5);
+}
+
+double ProgressModel::doneWeight(double& total) const {
+  total = 0;
+  double done = 0;
+  for (const Item& item : items_) {
+    total += item.weight;
+    done += item.weight * item.fraction;
+  }
+  return done;
+}
+
+}  // namespace installer
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_SERVICE_BACKEND_PROGRESS_MODEL_H
+#define INSTALLER_SERVICE_BACKEND_PROGRESS_MODEL_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QStringList>
+
+namespace installer {
+
+// Estimates overall progress and remaining time of hooks, weighting each hook
+// by its expected duration.
+// Expected durations are read from profile files, in seconds, keyed by
+// filename of hooks, like "21_extract_base_filesystem.job". A profile file
+// is either a JSON object, like:
+//   { "21_extract_base_filesystem.job": 300, "99_update_initramfs.job": 40 }
+// or a trace file of a previous installation, see base/trace.h, in which
+// durations of hooks are learned from "hook" events.
+// If no profile is loaded, hooks of each stage share its progress range
+// equally.
+// Inside a hook, progress reported by itself is interpolated.
+class ProgressModel {
+ public:
+  ProgressModel();
+
+  // Merge expected durations in |file| into profile, entries in later files
+  // replace earlier ones. Returns false if |file| is not a valid profile.
+  bool loadProfile(const QString& file);
+
+  // Returns true if any expected duration is loaded.
+  bool hasProfile() const { return !durations_.isEmpty(); }
+
+  // Expected duration of |hook| in seconds, or default value if it is not
+  // found in profile.
+  double expectedSeconds(const QString& hook) const;
+
+  // Add |hooks| of a stage, which takes [progress_begin, progress_end] of
+  // overall progress if no profile is loaded. Profile shall be loaded
+  // before hooks are added.
+  void addHooks(const QStringList& hooks, int progress_begin,
+                int progress_end);
+
+  // Returns id of |hook|, or 0 if it is not added. The id is exported to
+  // hook as DI_HOOK_ID, and progress reported by it is tagged with this id.
+  int hookId(const QString& hook) const;
+
+  void startHook(const QString& hook);
+  void finishHook(const QString& hook);
+
+  // Progress of hook |hook_id| reported by itself, 0-100. If |hook_id| is 0,
+  // which means the reporter is unknown, it is applied to the running hook
+  // expected to take longest.
+  void reportProgress(int hook_id, int percent);
+
+  // Overall progress, in range of all stages added.
+  int progress() const;
+
+  // Estimated remaining time in seconds, or -1 if unknown yet.
+  int remainingSeconds() const;
+
+  // Estimated remaining time, when first hook was started |elapsed_ms| ago.
+  int remainingSeconds(qint64 elapsed_ms) const;
+
+ private:
+  struct Item {
+    QString hook;
+    // Expected duration in seconds, or share of progress range.
+    double weight;
+    // 0-1.
+    double fraction;
+    bool running;
+  };
+
+  // Returns weighted sum of done fractions of all hooks, and sets |total| to
+  // sum of all weights.
+  double doneWeight(double& total) const;
+
+  // Expected durations in seconds, keyed by filename of hooks.
+  QHash<QString, double> durations_;
+
+  QList<Item> items_;
+  // Maps hook path to index in |items_|.
+  QHash<QString, int> indexes_;
+
+  int progress_begin_;
+  int progress_end_;
+
+  // Started with first hook.
+  QElapsedTimer timer_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_SERVICE_BACKEND_PROGRESS_MODEL_H
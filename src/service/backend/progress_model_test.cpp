@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "service/backend/progress_model.h"
+
+#include "base/file_util.h"
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+TEST(ProgressModelTest, EqualShares) {
+  ProgressModel model;
+  model.addHooks({"/a/00_a.job", "/a/01_b.job"}, 0, 60);
+  model.addHooks({"/b/00_c.job"}, 60, 100);
+  EXPECT_FALSE(model.hasProfile());
+  EXPECT_EQ(model.progress(), 0);
+  EXPECT_EQ(model.remainingSeconds(), -1);
+
+  model.startHook("/a/00_a.job");
+  model.reportProgress(model.hookId("/a/00_a.job"), 50);
+  EXPECT_EQ(model.progress(), 15);
+  model.finishHook("/a/00_a.job");
+  model.startHook("/a/01_b.job");
+  model.finishHook("/a/01_b.job");
+  EXPECT_EQ(model.progress(), 60);
+  // 60% of work is done in 30s.
+  EXPECT_EQ(model.remainingSeconds(30000), 20);
+}
+
+TEST(ProgressModelTest, LoadProfile) {
+  const QString profile_file = "/tmp/progress-model-test.json";
+  ASSERT_TRUE(WriteTextFile(profile_file,
+                            "{ \"00_short.job\": 10, \"01_long.job\": 90 }"));
+  const QString trace_file = "/tmp/progress-model-test.trace.json";
+  ASSERT_TRUE(WriteTextFile(trace_file,
+      "[\n"
+      "{\"cat\":\"hook\",\"ph\":\"X\",\"name\":\"02_learned.job\","
+      "\"dur\":100000000},\n"
+      "{\"cat\":\"command\",\"ph\":\"X\",\"name\":\"mkfs.ext4\","
+      "\"dur\":5000000},\n"));
+
+  ProgressModel model;
+  EXPECT_TRUE(model.loadProfile(profile_file));
+  EXPECT_TRUE(model.loadProfile(trace_file));
+  EXPECT_FALSE(model.loadProfile("/tmp/progress-model-test-not-found"));
+  EXPECT_DOUBLE_EQ(model.expectedSeconds("/a/01_long.job"), 90);
+  EXPECT_DOUBLE_EQ(model.expectedSeconds("/a/02_learned.job"), 100);
+
+  model.addHooks({"/a/00_short.job", "/a/01_long.job"}, 0, 50);
+  model.addHooks({"/b/02_learned.job"}, 50, 100);
+  model.startHook("/a/00_short.job");
+  // Expected durations are used before speed of this machine is known.
+  EXPECT_EQ(model.remainingSeconds(0), 200);
+  model.finishHook("/a/00_short.job");
+  EXPECT_EQ(model.progress(), 5);
+
+  // Progress of unknown reporter is applied to the longest running hook.
+  model.startHook("/a/01_long.job");
+  model.startHook("/b/02_learned.job");
+  model.reportProgress(0, 50);
+  EXPECT_EQ(model.progress(), 30);
+  model.reportProgress(0, 20);
+  EXPECT_EQ(model.progress(), 30);
+}
+
+TEST(ProgressModelTest, ReportProgressOfHook) {
+  ProgressModel model;
+  model.addHooks({"/a/00_a.job", "/a/01_b.job"}, 0, 100);
+  EXPECT_EQ(model.hookId("/a/00_a.job"), 1);
+  EXPECT_EQ(model.hookId("/a/01_b.job"), 2);
+  EXPECT_EQ(model.hookId("/a/02_c.job"), 0);
+
+  // Hooks running in parallel only advance their own share.
+  model.startHook("/a/00_a.job");
+  model.startHook("/a/01_b.job");
+  model.reportProgress(model.hookId("/a/01_b.job"), 100);
+  EXPECT_EQ(model.progress(), 50);
+  model.reportProgress(model.hookId("/a/00_a.job"), 50);
+  EXPECT_EQ(model.progress(), 75);
+
+  // Reports of hooks not running, or with invalid id, are ignored.
+  model.finishHook("/a/01_b.job");
+  model.reportProgress(model.hookId("/a/01_b.job"), 10);
+  model.reportProgress(3, 100);
+  EXPECT_EQ(model.progress(), 75);
+}
+
+}  // namespace
+}  // namespace installer
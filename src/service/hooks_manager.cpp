@@ -19,13 +19,21 @@
 
 #include <QDebug>
 #include <QDir>
+#include <QSocketNotifier>
 #include <QThread>
 #include <QTimer>
 
 #include "base/file_util.h"
+#include "base/progress_bus.h"
 #include "base/thread_util.h"
+#include "base/trace.h"
+#include "service/backend/hook_cgroup.h"
 #include "service/backend/hooks_pack.h"
+#include "service/backend/hook_scheduler.h"
 #include "service/backend/hook_worker.h"
+#include "service/backend/progress_model.h"
+#include "service/settings_manager.h"
+#include "service/settings_name.h"
 
 namespace installer {
 
@@ -37,10 +45,19 @@ const int kInChrootEndVal = 85;
 const int kAfterChrootStartVal = kInChrootEndVal;
 const int kAfterChrootEndVal = 100;
 
+// Category of hooks events in trace.
+const char kTraceCategory[] = "hooks";
+
 const char kUnsquashfsProgressFile[] = "/dev/shm/unsquashfs_progress";
 // Interval to read unsquashfs progress file, 5000ms.
 const int kReadUnsquashfsInterval = 5000;
 
+// Number of hooks running at the same time.
+int GetMaxHookJobs() {
+  const int max_jobs = GetSettingsInt(kHooksMaxJobs);
+  return (max_jobs > 0) ? max_jobs : qMax(QThread::idealThreadCount(), 1);
+}
+
 int ReadProgressValue(const QString& file) {
   if (QFile::exists(file)) {
     const QString val(ReadFile(file));
@@ -55,25 +72,43 @@ int ReadProgressValue(const QString& file) {
 
 HooksManager::HooksManager(QObject* parent)
     : QObject(parent),
-      hook_worker_(new HookWorker()),
-      hook_worker_thread_(new QThread(this)),
       unsquashfs_timer_(new QTimer(this)) {
   this->setObjectName("hooks_manager");
-
-  hook_worker_->moveToThread(hook_worker_thread_);
+  qRegisterMetaType<HookStats>("HookStats");
+
+  const int max_jobs = GetMaxHookJobs();
+  for (int i = 0; i < max_jobs; ++i) {
+    HookWorker* worker = new HookWorker();
+    QThread* thread = new QThread(this);
+    worker->moveToThread(thread);
+    hook_workers_.append(worker);
+    hook_worker_threads_.append(thread);
+  }
+  idle_workers_ = hook_workers_;
   this->initConnections();
 
-  hook_worker_thread_->start();
+  for (QThread* thread : hook_worker_threads_) {
+    thread->start();
+  }
 }
 
 HooksManager::~HooksManager() {
-  QuitThread(hook_worker_thread_);
+  for (QThread* thread : hook_worker_threads_) {
+    QuitThread(thread);
+  }
 
+  delete hook_scheduler_;
+  hook_scheduler_ = nullptr;
   while (hooks_pack_ != nullptr) {
     HooksPack* next_pack = hooks_pack_->next;
     delete hooks_pack_;
     hooks_pack_ = next_pack;
   }
+
+  delete progress_bus_;
+  progress_bus_ = nullptr;
+  delete progress_model_;
+  progress_model_ = nullptr;
 }
 
 void HooksManager::initConnections() {
@@ -85,22 +120,34 @@ void HooksManager::initConnections() {
           this, &HooksManager::onHooksManagerFinished);
   connect(this, &HooksManager::errorOccurred,
           this, &HooksManager::onHooksManagerFinished);
-  connect(hook_worker_, &HookWorker::hookFinished,
-          this, &HooksManager::onHookFinished);
 
-  // Delete worker object on thread finished.
-  connect(hook_worker_thread_, &QThread::finished,
-          hook_worker_, &HookWorker::deleteLater);
+  for (int i = 0; i < hook_workers_.length(); ++i) {
+    HookWorker* worker = hook_workers_.at(i);
+    connect(worker, &HookWorker::hookFinished,
+            this, &HooksManager::onHookFinished);
+    // Delete worker object on thread finished.
+    connect(hook_worker_threads_.at(i), &QThread::finished,
+            worker, &HookWorker::deleteLater);
+  }
 }
 
-void HooksManager::runNextHook() {
-  hooks_pack_->current_hook ++;
-  if (hooks_pack_->current_hook >= hooks_pack_->hooks.length()) {
+void HooksManager::runReadyHooks() {
+  if (hook_scheduler_->isDone()) {
     // Clear environment of current hooks pack.
     if (hooks_pack_->type == HookType::BeforeChroot) {
       unsquashfs_timer_->stop();
     }
-
+    // Resources used by all hooks in this pack.
+    const HookStats pack_stats =
+        SumHookStats(hook_stats_.mid(pack_stats_begin_));
+    pack_stats_begin_ = hook_stats_.length();
+    TraceEnd(kTraceCategory, GetHookTypeName(hooks_pack_->type),
+             {{"cpu_ms", pack_stats.cpu_ms},
+              {"read_bytes", pack_stats.read_bytes},
+              {"write_bytes", pack_stats.write_bytes}});
+
+    delete hook_scheduler_;
+    hook_scheduler_ = nullptr;
     HooksPack* next_hooks_pack = hooks_pack_->next;
     delete hooks_pack_;
     hooks_pack_ = next_hooks_pack;
@@ -113,21 +160,18 @@ void HooksManager::runNextHook() {
       // Run next hooks pack if it is not nullptr
       this->runHooksPack();
     }
-  } else {
-    // Update progress, except before-chroot.
-    if (hooks_pack_->type != HookType::BeforeChroot) {
-      const int progress = hooks_pack_->progress_begin +
-          int((hooks_pack_->progress_end - hooks_pack_->progress_begin) *
-              hooks_pack_->current_hook * 1.0 / hooks_pack_->hooks.length());
-      qDebug() << "processUpdate():" << progress;
-      emit this->processUpdate(progress);
-    }
+    return;
+  }
 
-    // Run next hook in current hooks pack.
-    const QString hook = hooks_pack_->hooks.at(hooks_pack_->current_hook);
+  // Scheduler never returns more hooks than workers.
+  for (const QString& hook : hook_scheduler_->takeReadyHooks()) {
+    HookWorker* worker = idle_workers_.takeFirst();
     qDebug() << "run hook:" << GetFileName(hook);
-    emit hook_worker_->runHook(hook);
+    progress_model_->startHook(hook);
+    emit worker->runHook(hook, progress_model_->hookId(hook));
   }
+
+  this->emitHooksProgress();
 }
 
 void HooksManager::runHooksPack() {
@@ -138,32 +182,95 @@ void HooksManager::runHooksPack() {
     return;
   }
 
+  // Start new hook runner sessions for each hooks pack. Session in chroot
+  // env shall be stopped before after_chroot hooks unmount /target.
+  for (HookWorker* worker : hook_workers_) {
+    emit worker->stopRunners();
+  }
+
   if (hooks_pack_->type == HookType::BeforeChroot) {
     // Setup filesystem watch of unsquashfs progress file.
     this->monitorProgressFiles();
   } else if (hooks_pack_->type == HookType::InChroot) {
-    if (!ChrootCopyHooks()) {
-      qCritical() << "Failed to copy hooks into /target";
+    if (!ChrootBindHooks()) {
+      qCritical() << "Failed to bind hooks into /target";
       emit this->errorOccurred();
       return;
     }
   }
 
-  // Run hooks one by one.
-  hooks_pack_->current_hook = -1;
-  this->runNextHook();
+  // Hooks without dependencies declared run one by one.
+  hook_scheduler_ = new HookScheduler(hooks_pack_->hooks,
+                                      hook_workers_.length());
+  TraceBegin(kTraceCategory, GetHookTypeName(hooks_pack_->type),
+             {{"hooks", hooks_pack_->hooks.length()},
+              {"workers", hook_workers_.length()}});
+  this->runReadyHooks();
 }
 
 void HooksManager::monitorProgressFiles() {
   qDebug() << "monitorProgressFiles()";
   // Remove old progress files first.
   QFile::remove(kUnsquashfsProgressFile);
-  unsquashfs_timer_->start();
+  if (progress_bus_ == nullptr) {
+    // Poll progress file only if progress bus is not available.
+    unsquashfs_timer_->start();
+  }
+}
+
+void HooksManager::initProgressBus() {
+  if (progress_bus_ != nullptr) {
+    return;
+  }
+  ProgressBus* bus = new ProgressBus();
+  if (!bus->create() || bus->eventFd() == -1) {
+    qWarning() << "Failed to create progress bus, poll progress file instead";
+    delete bus;
+    return;
+  }
+  progress_bus_ = bus;
+  progress_notifier_ = new QSocketNotifier(progress_bus_->eventFd(),
+                                           QSocketNotifier::Read, this);
+  connect(progress_notifier_, &QSocketNotifier::activated,
+          this, &HooksManager::handleProgressBusActivated);
+}
+
+void HooksManager::emitHooksProgress() {
+  this->emitProgress(progress_model_->progress());
+
+  const int seconds = progress_model_->remainingSeconds();
+  if (seconds != last_remaining_seconds_) {
+    last_remaining_seconds_ = seconds;
+    emit this->remainingTimeUpdate(seconds);
+  }
+}
+
+void HooksManager::emitProgress(int progress) {
+  if (progress != last_progress_) {
+    last_progress_ = progress;
+    qDebug() << "processUpdate():" << progress;
+    emit this->processUpdate(progress);
+  }
+}
+
+void HooksManager::printHookStats() {
+  if (hook_stats_.isEmpty()) {
+    return;
+  }
+  qDebug() << "Resources used by hooks:";
+  for (const QString& line : FormatHookStatsTable(hook_stats_).split('\n')) {
+    qDebug().noquote() << line;
+  }
 }
 
 void HooksManager::handleRunHooks() {
   qDebug() << "handleRunHooks()";
   unsquashfs_timer_->setInterval(kReadUnsquashfsInterval);
+  // Created before any hook runs, so that it is inherited by all hooks.
+  this->initProgressBus();
+  if (!InitHookCgroups()) {
+    qDebug() << "Resources used by hooks are collected by hook runner";
+  }
 
   // First copy hooks from system and oem folder into the same folder.
   if (!CopyHooks()) {
@@ -183,6 +290,17 @@ void HooksManager::handleRunHooks() {
   after_chroot->init(HookType::AfterChroot, kAfterChrootStartVal,
                      kAfterChrootEndVal, nullptr);
 
+  // Expected durations are loaded before hooks are added.
+  progress_model_ = new ProgressModel();
+  for (const QString& file : GetHooksProfileFiles()) {
+    qDebug() << "Load hooks profile:" << file;
+    progress_model_->loadProfile(file);
+  }
+  for (HooksPack* pack = before_chroot; pack != nullptr; pack = pack->next) {
+    progress_model_->addHooks(pack->hooks, pack->progress_begin,
+                              pack->progress_end);
+  }
+
   hooks_pack_ = before_chroot;
   this->runHooksPack();
 }
@@ -190,17 +308,42 @@ void HooksManager::handleRunHooks() {
 void HooksManager::handleReadUnsquashfsTimeout() {
   // Read progress value and notify UI thread.
   const int val = ReadProgressValue(kUnsquashfsProgressFile);
-  const int progress = kBeforeChrootStartVal +
-      (kBeforeChrootEndVal - kBeforeChrootStartVal) * val / 100;
   if (hooks_pack_ && hooks_pack_->type == HookType::BeforeChroot) {
-    emit this->processUpdate(progress);
+    // Progress of unsquashfs is reported by extract-base-filesystem hook.
+    progress_model_->reportProgress(0, val);
+    this->emitHooksProgress();
   } else {
     unsquashfs_timer_->stop();
   }
 }
 
+void HooksManager::handleProgressBusActivated() {
+  progress_bus_->clearEvent();
+  ProgressSnapshot snapshot;
+  if (hooks_pack_ == nullptr || hook_scheduler_ == nullptr ||
+      !progress_bus_->read(snapshot)) {
+    return;
+  }
+
+  // Both unsquashfs and installer_progress report progress of the hook
+  // running them, tagged with its id.
+  if (snapshot.phase != ProgressPhase::None &&
+      snapshot.counter > hook_progress_counter_) {
+    progress_model_->reportProgress(int(snapshot.hook_id), snapshot.percent);
+    this->emitHooksProgress();
+  }
+}
+
 void HooksManager::onHooksManagerFinished() {
-  // Release hooks pack
+  if (hook_scheduler_ != nullptr && hooks_pack_ != nullptr) {
+    // Current hooks pack is aborted.
+    TraceEnd(kTraceCategory, GetHookTypeName(hooks_pack_->type),
+             {{"aborted", true}});
+  }
+
+  // Release hooks pack. Results of hooks still running are ignored.
+  delete hook_scheduler_;
+  hook_scheduler_ = nullptr;
   while (hooks_pack_) {
     HooksPack* next_hooks_pack = hooks_pack_->next;
     delete hooks_pack_;
@@ -211,17 +354,48 @@ void HooksManager::onHooksManagerFinished() {
   if (unsquashfs_timer_->isActive()) {
     unsquashfs_timer_->stop();
   }
+  if (progress_notifier_ != nullptr) {
+    progress_notifier_->setEnabled(false);
+  }
+
+  for (HookWorker* worker : hook_workers_) {
+    emit worker->stopRunners();
+  }
+
+  this->printHookStats();
 }
 
-void HooksManager::onHookFinished(bool ok) {
+void HooksManager::onHookFinished(const QString& hook, bool ok,
+                                  const HookStats& stats) {
+  HookWorker* worker = qobject_cast<HookWorker*>(this->sender());
+  if (worker != nullptr) {
+    idle_workers_.append(worker);
+  }
+  if (hook_scheduler_ == nullptr) {
+    // Installation is aborted by another hook.
+    return;
+  }
+  hook_stats_.append(HookStatsItem(GetFileName(hook), stats));
+
   if (!ok) {
-    const QString hook = hooks_pack_->hooks.at(hooks_pack_->current_hook);
-    qCritical() << "Hook failed:" << GetFileName(hook);
+    if (stats.timed_out) {
+      qCritical() << "Hook timed out:" << GetFileName(hook);
+    } else {
+      qCritical() << "Hook failed:" << GetFileName(hook);
+    }
     emit this->errorOccurred();
     return;
   }
 
-  this->runNextHook();
+  // Ignore progress reported by finished hook.
+  ProgressSnapshot snapshot;
+  if (progress_bus_ != nullptr && progress_bus_->read(snapshot)) {
+    hook_progress_counter_ = snapshot.counter;
+  }
+
+  progress_model_->finishHook(hook);
+  hook_scheduler_->finishHook(hook);
+  this->runReadyHooks();
 }
 
 }  // namespace installer
@@ -18,7 +18,12 @@
 #ifndef INSTALLER_SERVICE_HOOKS_MANAGER_H
 #define INSTALLER_SERVICE_HOOKS_MANAGER_H
 
+#include <stdint.h>
+#include <QList>
 #include <QObject>
+
+#include "service/backend/hook_stats.h"
+class QSocketNotifier;
 class QThread;
 class QTimer;
 
@@ -28,10 +33,14 @@ namespace installer {
 const int kBeforeChrootStartVal = 5;
 
 class HooksPack;
+class HookScheduler;
 class HookWorker;
+class ProgressBus;
+class ProgressModel;
 
 // HookManager is used to do:
-//   * run hook jobs one by one;
+//   * run hook jobs in parallel, based on their dependencies, see
+//     HookScheduler;
 //   * load oem hooks;
 //   * manage chroot environment;
 //   * manage installation process;
@@ -51,42 +60,89 @@ class HooksManager : public QObject {
   // Emitted when installation process finished successfully.
   void finished();
 
-  // Installation process is split into four stages:
+  // Installation process goes from 5 to 100. Each hook takes a part of it
+  // in proportion to its expected duration, see ProgressModel. If no hooks
+  // profile is found, it is split into three stages instead:
   //   * before_chroot: 5-60
-  //   * in_chroot: 60-80
-  //   * after_chroot: 80-100
+  //   * in_chroot: 60-85
+  //   * after_chroot: 85-100
   void processUpdate(int process);
 
+  // Emitted when estimated remaining time of installation is changed.
+  // |seconds| is -1 if it is unknown yet.
+  void remainingTimeUpdate(int seconds);
+
   // Emit this signal in other objects to run hooks in background thread.
   void runHooks();
 
  private:
   void initConnections();
 
-  void runNextHook();
+  // Run hooks ready in current hooks pack on idle workers, or switch to
+  // next hooks pack if all hooks are finished.
+  void runReadyHooks();
 
   // Run hook scripts with |hook_type|.
   void runHooksPack();
 
   HooksPack* hooks_pack_ = nullptr;
-  HookWorker* hook_worker_ = nullptr;
-  QThread* hook_worker_thread_ = nullptr;
+  // Schedules hooks in current hooks pack.
+  HookScheduler* hook_scheduler_ = nullptr;
+
+  // Each worker runs one hook at a time in its own thread.
+  QList<HookWorker*> hook_workers_;
+  QList<QThread*> hook_worker_threads_;
+  QList<HookWorker*> idle_workers_;
 
   // Monitors unsquashfs progress file changing.
   void monitorProgressFiles();
 
-  // This timer is used to read progress file each second.
+  // This timer is used to read progress file each second, only if progress
+  // bus is not available.
   QTimer* unsquashfs_timer_ = nullptr;
 
+  // Create progress bus, which is inherited by hooks.
+  void initProgressBus();
+
+  // Emit progress and remaining time estimated by |progress_model_|.
+  void emitHooksProgress();
+
+  // Emit |progress| if it is changed.
+  void emitProgress(int progress);
+
+  // Print resources used by each finished hook into log.
+  void printHookStats();
+
+  // Progress reported by unsquashfs and hooks.
+  ProgressBus* progress_bus_ = nullptr;
+  QSocketNotifier* progress_notifier_ = nullptr;
+  // Weights hooks by their expected durations.
+  ProgressModel* progress_model_ = nullptr;
+  // Progress on bus not newer than this counter is ignored, as it is
+  // reported by finished hooks.
+  uint64_t hook_progress_counter_ = 0;
+  // Last value of processUpdate().
+  int last_progress_ = -1;
+  // Last value of remainingTimeUpdate().
+  int last_remaining_seconds_ = -1;
+
+  // Resources used by finished hooks, keyed by hook filename.
+  QList<HookStatsItem> hook_stats_;
+  // Number of items in |hook_stats_| before current hooks pack.
+  int pack_stats_begin_ = 0;
+
  private slots:
   void handleRunHooks();
   void handleReadUnsquashfsTimeout();
 
+  // Read progress published on progress bus.
+  void handleProgressBusActivated();
+
   // Handles any errors.
   void onHooksManagerFinished();
 
-  // Run next hook when current hook has finished.
-  void onHookFinished(bool ok);
+  // Run next hooks when |hook| has finished.
+  void onHookFinished(const QString& hook, bool ok, const HookStats& stats);
 };
 
 }  // namespace installer
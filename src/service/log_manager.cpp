@@ -20,6 +20,7 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -29,6 +30,8 @@
 #include <QFileInfo>
 #include <QtGlobal>
 
+#include "base/trace.h"
+
 namespace installer {
 
 namespace {
@@ -36,6 +39,10 @@ namespace {
 // Application-wide log filepath.
 QString g_log_file;
 
+// Suffix of trace file, which replaces ".log" in log filepath.
+const char kLogFileSuffix[] = ".log";
+const char kTraceFileSuffix[] = ".trace.json";
+
 void BackupLogFile() {
   QFile file(g_log_file);
   if (file.exists()) {
@@ -123,4 +130,13 @@ bool RedirectLog(const QString& log_file) {
   return ok;
 }
 
+bool StartLogTrace(const QString& log_file) {
+  QString trace_file(log_file);
+  if (trace_file.endsWith(kLogFileSuffix)) {
+    trace_file.chop(int(strlen(kLogFileSuffix)));
+  }
+  trace_file.append(kTraceFileSuffix);
+  return StartTrace(trace_file);
+}
+
 }  // namespace installer
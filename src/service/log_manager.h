@@ -28,6 +28,10 @@ QString GetLogFilepath();
 // Redirect stdout and stderr to |log_file|.
 bool RedirectLog(const QString& log_file);
 
+// Record timeline of installation in a trace file next to |log_file|, like
+// /var/log/deepin-installer.trace.json. See base/trace.h.
+bool StartLogTrace(const QString& log_file);
+
 }  // namespace installer
 
 
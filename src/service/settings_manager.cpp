@@ -221,6 +221,22 @@ QString GetOemHooksDir() {
   return GetOemDir().absoluteFilePath("hooks");
 }
 
+QStringList GetHooksProfileFiles() {
+  QStringList files;
+  const QStringList candidates = {
+      RESOURCES_DIR "/hooks_profile.json",
+      GetOemDir().absoluteFilePath("hooks_profile.json"),
+      // Trace file of a previous installation, see base/trace.h.
+      GetOemDir().absoluteFilePath("hooks_profile.trace.json"),
+  };
+  for (const QString& file : candidates) {
+    if (QFile::exists(file)) {
+      files.append(file);
+    }
+  }
+  return files;
+}
+
 QString GetReservedUsernameFile() {
   const QString oem_file = GetOemDir().absoluteFilePath("reserved_usernames");
   if (QFile::exists(oem_file)) {
@@ -62,6 +62,11 @@ QString GetDefaultAvatar();
 // Get absolute path to oem hooks folder.
 QString GetOemHooksDir();
 
+// Returns absolute path to hooks profile files, which contain expected
+// duration of hooks, in order of builtin file, oem file and oem trace file.
+// Files not found are excluded.
+QStringList GetHooksProfileFiles();
+
 // Returns absolute path to reserved_usernames file.
 QString GetReservedUsernameFile();
 
@@ -151,6 +151,9 @@ const char kInstallFailedFeedbackServer[] = "install_failed_feedback_server";
 const char kInstallFailedQRErrMsgLen[] = "install_failed_qr_err_msg_len";
 const char kInstallFailedErrMsgLen[] = "install_failed_err_msg_len";
 
+// Hooks
+const char kHooksMaxJobs[] = "hooks_max_jobs";
+const char kHooksJobTimeout[] = "hooks_job_timeout";
 // Misc
 const char kScreenDefaultBrightness[] = "screen_default_brightness";
 
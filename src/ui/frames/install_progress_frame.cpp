@@ -60,6 +60,7 @@ InstallProgressFrame::InstallProgressFrame(QWidget* parent)
     : QFrame(parent),
       failed_(true),
       progress_(0),
+      remaining_seconds_(-1),
       hooks_manager_(new HooksManager()),
       hooks_manager_thread_(new QThread(this)),
       simulation_timer_(new QTimer(this)) {
@@ -128,6 +129,7 @@ void InstallProgressFrame::changeEvent(QEvent* event) {
     comment_label_->setText(
         tr("You can experience the incredible pleasure of deepin after "
            "the time for just a cup of coffee"));
+    this->updateRemainingLabel();
   } else {
     QFrame::changeEvent(event);
   }
@@ -140,6 +142,8 @@ void InstallProgressFrame::initConnections() {
           this, &InstallProgressFrame::onHooksFinished);
   connect(hooks_manager_, &HooksManager::processUpdate,
           this, &InstallProgressFrame::onProgressUpdate);
+  connect(hooks_manager_, &HooksManager::remainingTimeUpdate,
+          this, &InstallProgressFrame::onRemainingTimeUpdate);
 
   connect(hooks_manager_thread_, &QThread::finished,
           hooks_manager_, &HooksManager::deleteLater);
@@ -184,6 +188,9 @@ void InstallProgressFrame::initUI() {
   progress_bar_->setOrientation(Qt::Horizontal);
   progress_bar_->setValue(0);
 
+  remaining_label_ = new CommentLabel(QString());
+  remaining_label_->setObjectName("remaining_label");
+
   QVBoxLayout* layout = new QVBoxLayout();
   layout->setContentsMargins(0, 0, 0, 0);
   layout->setSpacing(0);
@@ -197,6 +204,8 @@ void InstallProgressFrame::initUI() {
   layout->addWidget(tooltip_frame, 0, Qt::AlignHCenter);
   layout->addSpacing(5);
   layout->addWidget(progress_bar_, 0, Qt::AlignCenter);
+  layout->addSpacing(5);
+  layout->addWidget(remaining_label_, 0, Qt::AlignCenter);
   layout->addStretch();
 
   this->setLayout(layout);
@@ -231,6 +240,18 @@ void InstallProgressFrame::updateProgressBar(int progress) {
   progress_bar_->repaint();
 }
 
+void InstallProgressFrame::updateRemainingLabel() {
+  if (remaining_seconds_ < 0) {
+    remaining_label_->clear();
+  } else if (remaining_seconds_ < 60) {
+    remaining_label_->setText(tr("Less than a minute remaining"));
+  } else {
+    const int minutes = int(ceil(remaining_seconds_ / 60.0));
+    remaining_label_->setText(
+        tr("About %n minute(s) remaining", "", minutes));
+  }
+}
+
 void InstallProgressFrame::onHooksErrorOccurred() {
   failed_ = true;
   slide_frame_->stopSlide();
@@ -254,6 +275,11 @@ void InstallProgressFrame::onProgressUpdate(int progress) {
   progress_animation_->start();
 }
 
+void InstallProgressFrame::onRemainingTimeUpdate(int seconds) {
+  remaining_seconds_ = seconds;
+  this->updateRemainingLabel();
+}
+
 void InstallProgressFrame::onRetainingTimerTimeout() {
   slide_frame_->stopSlide();
   emit this->finished();
@@ -75,11 +75,17 @@ class InstallProgressFrame : public QFrame {
   // Update value of progress bar to |progress| and update tooltip position.
   void updateProgressBar(int progress);
 
+  // Update text of |remaining_label_| based on |remaining_seconds_|.
+  void updateRemainingLabel();
+
   bool failed_;
 
   // Progress value.
   int progress_;
 
+  // Estimated remaining time in seconds, -1 if unknown.
+  int remaining_seconds_;
+
   HooksManager* hooks_manager_ = nullptr;
   QThread* hooks_manager_thread_ = nullptr;
 
@@ -88,6 +94,7 @@ class InstallProgressFrame : public QFrame {
   InstallProgressSlideFrame* slide_frame_ = nullptr;
   QLabel* tooltip_label_ = nullptr;
   QProgressBar* progress_bar_ = nullptr;
+  CommentLabel* remaining_label_ = nullptr;
 
   QPropertyAnimation* progress_animation_ = nullptr;
 
@@ -102,6 +109,8 @@ class InstallProgressFrame : public QFrame {
 
   void onProgressUpdate(int progress);
 
+  void onRemainingTimeUpdate(int seconds);
+
   void onRetainingTimerTimeout();
 
   void onSimulationTimerTimeout();
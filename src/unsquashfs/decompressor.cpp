@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/decompressor.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <lzma.h>
+#include <zlib.h>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace installer {
+
+namespace {
+
+// zlib stream, used by gzip compression.
+class GzipDecompressor : public Decompressor {
+ public:
+  GzipDecompressor() {
+    memset(&stream_, 0, sizeof(stream_));
+    ok_ = (inflateInit(&stream_) == Z_OK);
+  }
+
+  ~GzipDecompressor() override {
+    if (ok_) {
+      inflateEnd(&stream_);
+    }
+  }
+
+  long decompress(const char* src, size_t src_len,
+                  char* dest, size_t dest_len) override {
+    if (!ok_ || inflateReset(&stream_) != Z_OK) {
+      return -1;
+    }
+    stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(src));
+    stream_.avail_in = static_cast<uInt>(src_len);
+    stream_.next_out = reinterpret_cast<Bytef*>(dest);
+    stream_.avail_out = static_cast<uInt>(dest_len);
+    if (inflate(&stream_, Z_FINISH) != Z_STREAM_END) {
+      return -1;
+    }
+    return static_cast<long>(dest_len - stream_.avail_out);
+  }
+
+ private:
+  z_stream stream_;
+  bool ok_;
+};
+
+// liblzma stream, used by both xz and legacy lzma compression.
+class LzmaDecompressor : public Decompressor {
+ public:
+  explicit LzmaDecompressor(bool is_xz) : is_xz_(is_xz) {
+    stream_ = LZMA_STREAM_INIT;
+  }
+
+  ~LzmaDecompressor() override {
+    lzma_end(&stream_);
+  }
+
+  long decompress(const char* src, size_t src_len,
+                  char* dest, size_t dest_len) override {
+    // Internal buffers are reused if decoder is initialized again.
+    const lzma_ret init_ret = is_xz_ ?
+        lzma_stream_decoder(&stream_, UINT64_MAX, 0) :
+        lzma_alone_decoder(&stream_, UINT64_MAX);
+    if (init_ret != LZMA_OK) {
+      return -1;
+    }
+    stream_.next_in = reinterpret_cast<const uint8_t*>(src);
+    stream_.avail_in = src_len;
+    stream_.next_out = reinterpret_cast<uint8_t*>(dest);
+    stream_.avail_out = dest_len;
+    const lzma_ret ret = lzma_code(&stream_, LZMA_FINISH);
+    if (ret != LZMA_STREAM_END) {
+      return -1;
+    }
+    return static_cast<long>(dest_len - stream_.avail_out);
+  }
+
+ private:
+  bool is_xz_;
+  lzma_stream stream_;
+};
+
+#ifdef HAVE_LZ4
+class Lz4Decompressor : public Decompressor {
+ public:
+  long decompress(const char* src, size_t src_len,
+                  char* dest, size_t dest_len) override {
+    const int ret = LZ4_decompress_safe(src, dest, static_cast<int>(src_len),
+                                        static_cast<int>(dest_len));
+    return (ret < 0) ? -1 : ret;
+  }
+};
+#endif
+
+#ifdef HAVE_ZSTD
+class ZstdDecompressor : public Decompressor {
+ public:
+  ZstdDecompressor() : context_(ZSTD_createDCtx()) {
+  }
+
+  ~ZstdDecompressor() override {
+    ZSTD_freeDCtx(context_);
+  }
+
+  long decompress(const char* src, size_t src_len,
+                  char* dest, size_t dest_len) override {
+    if (context_ == nullptr) {
+      return -1;
+    }
+    const size_t ret = ZSTD_decompressDCtx(context_, dest, dest_len,
+                                           src, src_len);
+    return ZSTD_isError(ret) ? -1 : static_cast<long>(ret);
+  }
+
+ private:
+  ZSTD_DCtx* context_;
+};
+#endif
+
+}  // namespace
+
+// static
+std::unique_ptr<Decompressor> Decompressor::Create(CompressionType type) {
+  switch (type) {
+    case CompressionType::Gzip: {
+      return std::unique_ptr<Decompressor>(new GzipDecompressor());
+    }
+    case CompressionType::Lzma: {
+      return std::unique_ptr<Decompressor>(new LzmaDecompressor(false));
+    }
+    case CompressionType::Xz: {
+      return std::unique_ptr<Decompressor>(new LzmaDecompressor(true));
+    }
+#ifdef HAVE_LZ4
+    case CompressionType::Lz4: {
+      return std::unique_ptr<Decompressor>(new Lz4Decompressor());
+    }
+#endif
+#ifdef HAVE_ZSTD
+    case CompressionType::Zstd: {
+      return std::unique_ptr<Decompressor>(new ZstdDecompressor());
+    }
+#endif
+    default: {
+      // lzo is not supported.
+      return nullptr;
+    }
+  }
+}
+
+// static
+const char* Decompressor::GetName(CompressionType type) {
+  switch (type) {
+    case CompressionType::Gzip: return "gzip";
+    case CompressionType::Lzma: return "lzma";
+    case CompressionType::Lzo: return "lzo";
+    case CompressionType::Xz: return "xz";
+    case CompressionType::Lz4: return "lz4";
+    case CompressionType::Zstd: return "zstd";
+    default: return "unknown";
+  }
+}
+
+}  // namespace installer
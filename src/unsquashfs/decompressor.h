@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_DECOMPRESSOR_H
+#define INSTALLER_UNSQUASHFS_DECOMPRESSOR_H
+
+#include <stddef.h>
+#include <memory>
+
+namespace installer {
+
+// Compression algorithms defined in squashfs 4.0 superblock.
+enum class CompressionType {
+  Gzip = 1,
+  Lzma = 2,
+  Lzo = 3,
+  Xz = 4,
+  Lz4 = 5,
+  Zstd = 6,
+};
+
+// Decompress squashfs data blocks and metadata blocks.
+// Objects of this class are not thread safe, each thread shall create
+// its own decompressor object, so that internal buffers are reused.
+class Decompressor {
+ public:
+  virtual ~Decompressor() {}
+
+  // Decompress |src_len| bytes at |src| into |dest|, which is |dest_len|
+  // bytes long. Returns number of bytes decompressed, or -1 if failed.
+  virtual long decompress(const char* src, size_t src_len,
+                          char* dest, size_t dest_len) = 0;
+
+  // Returns a new decompressor of |type|, or nullptr if |type| is not
+  // supported.
+  static std::unique_ptr<Decompressor> Create(CompressionType type);
+
+  // Returns name of compression |type|, like "xz".
+  static const char* GetName(CompressionType type);
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_DECOMPRESSOR_H
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/device_queues.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+namespace installer {
+
+DeviceQueues::DeviceQueues(int jobs, int max_pending)
+    : jobs_(jobs),
+      max_pending_(max_pending),
+      fifo_(false) {
+}
+
+DeviceQueues::~DeviceQueues() {
+  this->wait();
+}
+
+void DeviceQueues::submit(dev_t dev, WorkStealingPool::Task task) {
+  WorkStealingPool* pool = nullptr;
+  const auto iter = devices_.find(dev);
+  if (iter != devices_.end()) {
+    pool = iter->second;
+  } else {
+    std::unique_ptr<WorkStealingPool>& disk_pool = pools_[GetDiskName(dev)];
+    if (!disk_pool) {
+      disk_pool.reset(new WorkStealingPool(jobs_, max_pending_));
+      disk_pool->setFifo(fifo_);
+    }
+    pool = disk_pool.get();
+    devices_.emplace(dev, pool);
+  }
+  pool->submit(std::move(task));
+}
+
+void DeviceQueues::wait() {
+  for (auto& item : pools_) {
+    item.second->wait();
+  }
+}
+
+// static
+std::string DeviceQueues::GetDiskName(dev_t dev) {
+  char sys_path[64];
+  snprintf(sys_path, sizeof(sys_path), "/sys/dev/block/%u:%u",
+           major(dev), minor(dev));
+  char real_path[PATH_MAX];
+  if (realpath(sys_path, real_path) == nullptr) {
+    return std::string(sys_path + sizeof("/sys/dev/block/") - 1);
+  }
+
+  std::string path(real_path);
+  // Partition folder is placed in folder of its disk.
+  if (access((path + "/partition").c_str(), F_OK) == 0) {
+    path.resize(path.rfind('/'));
+  }
+  return path.substr(path.rfind('/') + 1);
+}
+
+}  // namespace installer
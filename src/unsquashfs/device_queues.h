@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_DEVICE_QUEUES_H
+#define INSTALLER_UNSQUASHFS_DEVICE_QUEUES_H
+
+#include <sys/types.h>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "unsquashfs/work_stealing_pool.h"
+
+namespace installer {
+
+// Writer queues of target disks. When target folders are on different disks,
+// like / and /home on two NVMe drives, files on each disk are written by its
+// own WorkStealingPool, so that all disks are written at the same time and
+// a slow disk does not hold back others.
+// Devices are mapped to their whole disks through sysfs, so partitions of the
+// same disk share one queue. Devices not found in sysfs, like tmpfs, have
+// their own queues.
+// Pools are created when the first task of their disk is submitted. Tasks
+// shall be submitted in one thread.
+class DeviceQueues {
+ public:
+  // Each queue has |jobs| worker threads and at most |max_pending| tasks
+  // not finished.
+  DeviceQueues(int jobs, int max_pending);
+  ~DeviceQueues();
+
+  DeviceQueues(const DeviceQueues&) = delete;
+  DeviceQueues& operator=(const DeviceQueues&) = delete;
+
+  // Run tasks of each queue roughly in submission order, shall be called
+  // before submitting any task.
+  void setFifo(bool fifo) { fifo_ = fifo; }
+
+  // Append |task| to queue of disk on which device |dev| is located.
+  // Blocks only if queue of that disk is full.
+  void submit(dev_t dev, WorkStealingPool::Task task);
+
+  // Block current thread until tasks of all queues are finished.
+  void wait();
+
+  // Number of queues created.
+  size_t size() const { return pools_.size(); }
+
+  // Get name of whole disk of block device |dev|, like "nvme0n1" of
+  // partition "nvme0n1p2". Returns "major:minor" of |dev| if it is not
+  // found in sysfs.
+  static std::string GetDiskName(dev_t dev);
+
+ private:
+  const int jobs_;
+  const int max_pending_;
+  bool fifo_;
+
+  // Pools of disks, by disk name.
+  std::map<std::string, std::unique_ptr<WorkStealingPool>> pools_;
+  // Cache of pool of each device.
+  std::map<dev_t, WorkStealingPool*> devices_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_DEVICE_QUEUES_H
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/device_queues.h"
+
+#include <sys/sysmacros.h>
+#include <atomic>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+TEST(DeviceQueuesTest, GetDiskName) {
+  // Device numbers not found in sysfs.
+  EXPECT_EQ(DeviceQueues::GetDiskName(makedev(0, 4242)), "0:4242");
+}
+
+TEST(DeviceQueuesTest, Submit) {
+  std::atomic<int> count(0);
+  DeviceQueues queues(2, 4);
+  for (int i = 0; i < 100; ++i) {
+    queues.submit(makedev(0, 4242 + (i % 2)), [&count](int) {
+      count ++;
+    });
+  }
+  queues.wait();
+  EXPECT_EQ(count.load(), 100);
+  EXPECT_EQ(queues.size(), 2u);
+}
+
+}  // namespace
+}  // namespace installer
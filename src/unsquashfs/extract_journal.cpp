@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/extract_journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+namespace installer {
+
+namespace {
+
+// Size of buffer to read journal file.
+const size_t kReadBufferSize = 64 * 1024;
+
+// Write |len| bytes in |buf| to |fd|, retrying on partial write.
+bool WriteAll(int fd, const char* buf, size_t len) {
+  while (len > 0) {
+    const ssize_t ret = write(fd, buf, len);
+    if (ret < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    buf += ret;
+    len -= size_t(ret);
+  }
+  return true;
+}
+
+}  // namespace
+
+ExtractJournal::ExtractJournal() : fd_(-1) {
+}
+
+ExtractJournal::~ExtractJournal() {
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
+
+bool ExtractJournal::open(const std::string& path, const std::string& id,
+                          bool resume) {
+  path_ = path;
+  records_.clear();
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC,
+               S_IRUSR | S_IWUSR);
+  if (fd_ == -1) {
+    fprintf(stderr, "ExtractJournal failed to open %s: %s\n",
+            path.c_str(), strerror(errno));
+    return false;
+  }
+
+  if (resume && this->load(id)) {
+    return true;
+  }
+
+  // Start a new journal.
+  records_.clear();
+  if (ftruncate(fd_, 0) != 0 ||
+      !WriteAll(fd_, id.c_str(), id.size() + 1)) {
+    fprintf(stderr, "ExtractJournal failed to write %s: %s\n",
+            path.c_str(), strerror(errno));
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  return true;
+}
+
+bool ExtractJournal::contains(const std::string& key) const {
+  return records_.find(key) != records_.end();
+}
+
+void ExtractJournal::append(const std::string& key) {
+  if (fd_ == -1) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Key with its terminating '\0' is written at once, O_APPEND makes sure
+  // it is not interleaved with other records.
+  if (!WriteAll(fd_, key.c_str(), key.size() + 1)) {
+    fprintf(stderr, "ExtractJournal failed to append %s: %s\n",
+            key.c_str(), strerror(errno));
+  }
+}
+
+void ExtractJournal::remove() {
+  if (fd_ != -1) {
+    close(fd_);
+    fd_ = -1;
+  }
+  if (!path_.empty()) {
+    // Keep modification time of parent folder, which might be updated by
+    // extractor already.
+    const size_t pos = path_.rfind('/');
+    const std::string parent = (pos == std::string::npos) ? "." :
+                               path_.substr(0, std::max(pos, size_t(1)));
+    struct stat parent_stat;
+    const bool has_stat = (stat(parent.c_str(), &parent_stat) == 0);
+    unlink(path_.c_str());
+    if (has_stat) {
+      const struct timespec times[2] = {
+          parent_stat.st_atim, parent_stat.st_mtim,
+      };
+      utimensat(AT_FDCWD, parent.c_str(), times, 0);
+    }
+  }
+  records_.clear();
+}
+
+bool ExtractJournal::load(const std::string& id) {
+  std::vector<char> buf(kReadBufferSize);
+  std::string record;
+  bool id_checked = false;
+  ssize_t len;
+  off_t pos = 0;
+  while ((len = pread(fd_, buf.data(), buf.size(), pos)) > 0) {
+    pos += len;
+    for (ssize_t i = 0; i < len; ++i) {
+      if (buf[size_t(i)] != '\0') {
+        record.push_back(buf[size_t(i)]);
+        continue;
+      }
+      if (!id_checked) {
+        if (record != id) {
+          fprintf(stderr, "ExtractJournal source images changed, "
+                  "ignore %s\n", path_.c_str());
+          return false;
+        }
+        id_checked = true;
+      } else {
+        records_.insert(record);
+      }
+      record.clear();
+    }
+  }
+  // Last record is incomplete if it is not terminated, ignore it.
+  return id_checked;
+}
+
+}  // namespace installer
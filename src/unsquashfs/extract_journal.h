@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_EXTRACT_JOURNAL_H
+#define INSTALLER_UNSQUASHFS_EXTRACT_JOURNAL_H
+
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+namespace installer {
+
+// Append-only journal of completely extracted files, so that an interrupted
+// extraction can be resumed without extracting those files again.
+// Journal file starts with an id record of source images, followed by one
+// record per file. Records are terminated with '\0', as file names might
+// contain new line characters.
+// Records are not synced to disk, as the journal only protects against
+// failures of extraction process, not system crash. Resumed extraction shall
+// still check target files before skipping them.
+class ExtractJournal {
+ public:
+  ExtractJournal();
+  ~ExtractJournal();
+
+  ExtractJournal(const ExtractJournal&) = delete;
+  ExtractJournal& operator=(const ExtractJournal&) = delete;
+
+  // Open journal file at |path| for source images identified by |id|.
+  // If |resume| is true and existing journal has the same |id|, records in
+  // it are loaded and new records are appended to it. Otherwise journal is
+  // truncated.
+  bool open(const std::string& path, const std::string& id, bool resume);
+
+  // Number of records loaded from existing journal.
+  size_t loadedCount() const { return records_.size(); }
+
+  // Returns true if |key| is loaded from existing journal.
+  bool contains(const std::string& key) const;
+
+  // Append |key| to journal. This method is thread safe.
+  void append(const std::string& key);
+
+  // Close and delete journal file, called after all files are extracted.
+  void remove();
+
+ private:
+  // Load records from |fd_|, returns false if its id does not match |id|.
+  bool load(const std::string& id);
+
+  std::string path_;
+  int fd_;
+  std::unordered_set<std::string> records_;
+
+  // Protects |fd_| in append().
+  std::mutex mutex_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_EXTRACT_JOURNAL_H
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/extract_journal.h"
+
+#include <unistd.h>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+const char kJournalFile[] = "/tmp/installer-extract-journal-test.journal";
+
+TEST(ExtractJournalTest, Resume) {
+  const std::string path(kJournalFile);
+  {
+    ExtractJournal journal;
+    ASSERT_TRUE(journal.open(path, "image 1", false));
+    EXPECT_EQ(journal.loadedCount(), 0u);
+    journal.append("0:1");
+    journal.append("0:usr/bin/ls");
+  }
+
+  ExtractJournal journal;
+  ASSERT_TRUE(journal.open(path, "image 1", true));
+  EXPECT_EQ(journal.loadedCount(), 2u);
+  EXPECT_TRUE(journal.contains("0:1"));
+  EXPECT_TRUE(journal.contains("0:usr/bin/ls"));
+  EXPECT_FALSE(journal.contains("0:2"));
+
+  journal.remove();
+  EXPECT_NE(access(path.c_str(), F_OK), 0);
+}
+
+TEST(ExtractJournalTest, ImagesChanged) {
+  const std::string path(kJournalFile);
+  {
+    ExtractJournal journal;
+    ASSERT_TRUE(journal.open(path, "image 1", false));
+    journal.append("0:1");
+  }
+
+  ExtractJournal journal;
+  ASSERT_TRUE(journal.open(path, "image 2", true));
+  EXPECT_EQ(journal.loadedCount(), 0u);
+  EXPECT_FALSE(journal.contains("0:1"));
+  journal.remove();
+}
+
+TEST(ExtractJournalTest, NoResume) {
+  const std::string path(kJournalFile);
+  {
+    ExtractJournal journal;
+    ASSERT_TRUE(journal.open(path, "image 1", false));
+    journal.append("0:1");
+  }
+
+  ExtractJournal journal;
+  ASSERT_TRUE(journal.open(path, "image 1", false));
+  EXPECT_EQ(journal.loadedCount(), 0u);
+  journal.remove();
+}
+
+}  // namespace
+}  // namespace installer
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/extract_progress.h"
+
+#include <algorithm>
+
+namespace installer {
+
+namespace {
+
+// Throughput is sampled every second.
+const double kSampleInterval = 1.0;
+
+// Weight of newest sample in exponential moving average of throughput.
+const double kSmoothFactor = 0.3;
+
+}  // namespace
+
+const uint64_t ExtractProgress::kInodeBytes;
+
+ExtractProgress::ExtractProgress()
+    : done_bytes_(0),
+      done_weight_(0),
+      total_bytes_(0),
+      total_weight_(0),
+      count_content_(true),
+      start_time_(std::chrono::steady_clock::now()),
+      sample_time_(start_time_),
+      sample_bytes_(0),
+      sample_weight_(0),
+      bytes_per_second_(0),
+      weight_per_second_(0),
+      last_percent_(-1) {
+}
+
+void ExtractProgress::setTotal(uint64_t total_bytes, uint64_t total_inodes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  total_bytes_ = total_bytes;
+  total_weight_ = total_bytes + total_inodes * kInodeBytes;
+  count_content_ = (total_bytes > 0);
+  start_time_ = std::chrono::steady_clock::now();
+  sample_time_ = start_time_;
+}
+
+void ExtractProgress::addInode(uint64_t bytes) {
+  done_bytes_ += bytes;
+  done_weight_ += (count_content_ ? bytes : 0) + kInodeBytes;
+  this->update(false);
+}
+
+void ExtractProgress::addBytes(uint64_t bytes) {
+  done_bytes_ += bytes;
+  if (count_content_) {
+    done_weight_ += bytes;
+  }
+  this->update(false);
+}
+
+void ExtractProgress::finish() {
+  done_bytes_ = std::max(done_bytes_.load(), total_bytes_);
+  done_weight_ = std::max(done_weight_.load(), total_weight_);
+  this->update(true);
+}
+
+ProgressStatus ExtractProgress::status() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return this->currentStatus();
+}
+
+void ExtractProgress::update(bool force) {
+  std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+  if (force) {
+    lock.lock();
+  } else if (!lock.try_lock()) {
+    // Another thread is updating progress.
+    return;
+  }
+
+  const std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+  const ProgressStatus status = this->currentStatus();
+  const uint64_t done_weight = std::min(done_weight_.load(), total_weight_);
+  const double elapsed =
+      std::chrono::duration<double>(now - sample_time_).count();
+  bool changed = false;
+  if (elapsed >= kSampleInterval || (force && elapsed > 0)) {
+    const double rate = (status.done_bytes - sample_bytes_) / elapsed;
+    const double weight_rate = (done_weight - sample_weight_) / elapsed;
+    if (sample_time_ == start_time_) {
+      bytes_per_second_ = rate;
+      weight_per_second_ = weight_rate;
+    } else {
+      bytes_per_second_ = kSmoothFactor * rate +
+                          (1 - kSmoothFactor) * bytes_per_second_;
+      weight_per_second_ = kSmoothFactor * weight_rate +
+                           (1 - kSmoothFactor) * weight_per_second_;
+    }
+    sample_time_ = now;
+    sample_bytes_ = status.done_bytes;
+    sample_weight_ = done_weight;
+    changed = true;
+  }
+
+  if (status.percent != last_percent_) {
+    last_percent_ = status.percent;
+    changed = true;
+  }
+
+  if (!changed && !force) {
+    return;
+  }
+  if (callback_) {
+    // Throughput might be updated above.
+    callback_(this->currentStatus());
+  }
+}
+
+ProgressStatus ExtractProgress::currentStatus() const {
+  ProgressStatus status;
+  status.done_bytes = done_bytes_.load();
+  if (count_content_) {
+    status.done_bytes = std::min(status.done_bytes, total_bytes_);
+  }
+  status.total_bytes = total_bytes_;
+  const uint64_t done_weight = std::min(done_weight_.load(), total_weight_);
+  if (total_weight_ > 0) {
+    status.percent = int(done_weight * 100 / total_weight_);
+  }
+  status.bytes_per_second = bytes_per_second_;
+  if (weight_per_second_ > 0) {
+    status.eta_seconds = int((total_weight_ - done_weight) /
+                             weight_per_second_);
+  }
+  return status;
+}
+
+}  // namespace installer
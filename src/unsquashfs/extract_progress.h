@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_EXTRACT_PROGRESS_H
+#define INSTALLER_UNSQUASHFS_EXTRACT_PROGRESS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+namespace installer {
+
+// Snapshot of extraction progress.
+struct ProgressStatus {
+  // Content bytes, |total_bytes| is 0 if content size is unknown.
+  uint64_t done_bytes = 0;
+  uint64_t total_bytes = 0;
+  // 0-100, weighted by content bytes and inodes.
+  int percent = 0;
+  // Smoothed throughput of content, in bytes per second.
+  double bytes_per_second = 0;
+  // Estimated remaining time in seconds, or -1 if unknown yet.
+  int eta_seconds = -1;
+};
+
+// Tracks extraction progress by bytes, and estimates throughput and
+// remaining time. Percent and remaining time are weighted by content bytes
+// plus kInodeBytes for every inode, so that progress still moves forward
+// when extracting lots of small files and folders. Reported bytes and
+// throughput only count real content.
+// This class is thread safe.
+class ExtractProgress {
+ public:
+  typedef std::function<void(const ProgressStatus& status)> Callback;
+
+  // Weight of each inode besides its content, in bytes.
+  static const uint64_t kInodeBytes = 4096;
+
+  ExtractProgress();
+
+  // |callback| is called when percent value changes or throughput is
+  // updated. It might be called in any thread, but never concurrently.
+  void setCallback(const Callback& callback) { callback_ = callback; }
+
+  // Set total size of |total_inodes| inodes with |total_bytes| of content.
+  // If |total_bytes| is 0, which means content size is unknown, percent is
+  // weighted by inodes only.
+  void setTotal(uint64_t total_bytes, uint64_t total_inodes);
+
+  // Mark one inode with |bytes| of content as extracted.
+  void addInode(uint64_t bytes);
+
+  // Mark |bytes| of content in a large file as extracted, without inode.
+  void addBytes(uint64_t bytes);
+
+  // Report 100% and final throughput.
+  void finish();
+
+  ProgressStatus status();
+
+ private:
+  // Update throughput and notify callback, if |force| is false, only update
+  // when percent changes or sample interval elapsed.
+  void update(bool force);
+
+  // Returns current status, |mutex_| shall be locked.
+  ProgressStatus currentStatus() const;
+
+  Callback callback_;
+  // Content bytes extracted.
+  std::atomic<uint64_t> done_bytes_;
+  // Content bytes and inodes extracted, weighted by kInodeBytes.
+  std::atomic<uint64_t> done_weight_;
+  uint64_t total_bytes_;
+  uint64_t total_weight_;
+  // Whether content bytes are counted in weight.
+  bool count_content_;
+
+  // Protects following fields.
+  std::mutex mutex_;
+  std::chrono::steady_clock::time_point start_time_;
+  std::chrono::steady_clock::time_point sample_time_;
+  uint64_t sample_bytes_;
+  uint64_t sample_weight_;
+  double bytes_per_second_;
+  // Smoothed throughput of weight, used to estimate remaining time.
+  double weight_per_second_;
+  int last_percent_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_EXTRACT_PROGRESS_H
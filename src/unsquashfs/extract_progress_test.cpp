@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/extract_progress.h"
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+TEST(ExtractProgressTest, WeightedByBytes) {
+  ExtractProgress progress;
+  int last_percent = -1;
+  progress.setCallback([&](const ProgressStatus& status) {
+    last_percent = status.percent;
+  });
+  // One large file and three empty inodes.
+  const uint64_t kLargeFile = 96 * ExtractProgress::kInodeBytes;
+  progress.setTotal(kLargeFile, 4);
+
+  progress.addInode(0);
+  progress.addInode(0);
+  progress.addInode(0);
+  EXPECT_EQ(last_percent, 3);
+  // Inodes are not counted in reported bytes.
+  EXPECT_EQ(progress.status().done_bytes, 0u);
+  EXPECT_EQ(progress.status().total_bytes, kLargeFile);
+
+  progress.addBytes(kLargeFile / 2);
+  EXPECT_EQ(progress.status().percent, 51);
+  EXPECT_EQ(progress.status().done_bytes, kLargeFile / 2);
+
+  progress.addInode(kLargeFile / 2);
+  EXPECT_EQ(progress.status().percent, 100);
+  EXPECT_EQ(progress.status().done_bytes, progress.status().total_bytes);
+}
+
+TEST(ExtractProgressTest, UnknownContentSize) {
+  ExtractProgress progress;
+  progress.setTotal(0, 4);
+  progress.addInode(1024 * 1024);
+  EXPECT_EQ(progress.status().percent, 25);
+  progress.addBytes(1024 * 1024);
+  EXPECT_EQ(progress.status().percent, 25);
+  EXPECT_EQ(progress.status().done_bytes, 2u * 1024 * 1024);
+  EXPECT_EQ(progress.status().total_bytes, 0u);
+}
+
+TEST(ExtractProgressTest, Finish) {
+  ExtractProgress progress;
+  ProgressStatus last_status;
+  progress.setCallback([&](const ProgressStatus& status) {
+    last_status = status;
+  });
+  progress.setTotal(1024 * 1024, 10);
+  progress.addInode(1024);
+  progress.finish();
+  EXPECT_EQ(last_status.percent, 100);
+  EXPECT_EQ(last_status.done_bytes, last_status.total_bytes);
+  EXPECT_EQ(last_status.total_bytes, 1024u * 1024);
+  EXPECT_GE(last_status.bytes_per_second, 0);
+}
+
+}  // namespace
+}  // namespace installer
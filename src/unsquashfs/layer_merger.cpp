@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/layer_merger.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+namespace installer {
+
+namespace {
+
+// Prefix of aufs whiteout, ".wh.<name>" removes <name> in lower layers.
+const char kWhiteoutPrefix[] = ".wh.";
+const size_t kWhiteoutPrefixLen = sizeof(kWhiteoutPrefix) - 1;
+
+// Prefix of aufs internal files, like ".wh..wh..opq" and ".wh..wh.plnk".
+const char kWhiteoutMetaPrefix[] = ".wh..wh.";
+
+// aufs opaque marker, hides all entries of lower layers in its folder.
+const char kOpaqueMarker[] = ".wh..wh..opq";
+
+// overlayfs opaque folder xattr.
+const char kOpaqueXAttr[] = "trusted.overlay.opaque";
+
+// Prefix of overlayfs private xattrs.
+const char kOverlayXAttrPrefix[] = "trusted.overlay.";
+
+// Returns base name of |path|.
+const char* BaseName(const std::string& path) {
+  const size_t pos = path.rfind('/');
+  return path.c_str() + (pos == std::string::npos ? 0 : pos + 1);
+}
+
+// Returns parent folder of |path|, empty for top level entries.
+std::string DirName(const std::string& path) {
+  const size_t pos = path.rfind('/');
+  return (pos == std::string::npos) ? std::string() : path.substr(0, pos);
+}
+
+}  // namespace
+
+LayerMerger::LayerMerger() : top_layer_(0) {
+}
+
+bool LayerMerger::addLayer(SquashfsReader& reader, int layer) {
+  return reader.walk([&](SquashfsEntry& entry) {
+    XAttrList xattrs;
+    if (S_ISDIR(entry.mode) && entry.xattr != kSquashfsNoXAttr) {
+      reader.readXAttrs(entry, xattrs);
+    }
+    this->addEntry(layer, entry, xattrs);
+    return true;
+  });
+}
+
+void LayerMerger::addEntry(int layer, const SquashfsEntry& entry,
+                           const XAttrList& xattrs) {
+  top_layer_ = std::max(top_layer_, layer);
+  if (entry.path.empty()) {
+    // Root folder always exists.
+    return;
+  }
+
+  const char* name = BaseName(entry.path);
+  if (strcmp(name, kOpaqueMarker) == 0) {
+    this->addNode(DirName(entry.path), layer, NodeType::OpaqueFolder);
+  } else if (strncmp(name, kWhiteoutMetaPrefix,
+                     sizeof(kWhiteoutMetaPrefix) - 1) == 0) {
+    // Ignore other aufs internal files.
+  } else if (strncmp(name, kWhiteoutPrefix, kWhiteoutPrefixLen) == 0) {
+    std::string path = DirName(entry.path);
+    if (!path.empty()) {
+      path.push_back('/');
+    }
+    path.append(name + kWhiteoutPrefixLen);
+    this->addNode(path, layer, NodeType::Whiteout);
+  } else if (S_ISCHR(entry.mode) && entry.rdev == 0) {
+    this->addNode(entry.path, layer, NodeType::Whiteout);
+  } else if (S_ISDIR(entry.mode)) {
+    NodeType type = NodeType::Folder;
+    for (const XAttr& xattr : xattrs) {
+      if (xattr.first == kOpaqueXAttr && xattr.second == "y") {
+        type = NodeType::OpaqueFolder;
+      }
+    }
+    this->addNode(entry.path, layer, type);
+  } else {
+    this->addNode(entry.path, layer, NodeType::File);
+  }
+}
+
+LayerMerger::Action LayerMerger::resolve(int layer,
+                                         const SquashfsEntry& entry) const {
+  if (entry.path.empty()) {
+    // Root folder, its metadata is taken from top layer.
+    return (layer == top_layer_) ? Action::Extract :
+                                   Action::ExtractWithoutMetadata;
+  }
+  if (layer > 0 && IsWhiteout(entry)) {
+    return Action::Skip;
+  }
+
+  // Check parent folders first, from top level.
+  size_t pos = 0;
+  while ((pos = entry.path.find('/', pos)) != std::string::npos) {
+    const auto iter = nodes_.find(entry.path.substr(0, pos));
+    if (iter != nodes_.end()) {
+      for (const Node& node : iter->second) {
+        // Parent folder is replaced by a file, removed, or hides entries in
+        // lower layers.
+        if (node.layer > layer && node.type != NodeType::Folder) {
+          return Action::Skip;
+        }
+      }
+    }
+    pos ++;
+  }
+
+  const auto iter = nodes_.find(entry.path);
+  if (iter == nodes_.end()) {
+    return Action::Extract;
+  }
+  Action action = Action::Extract;
+  for (const Node& node : iter->second) {
+    if (node.layer <= layer) {
+      continue;
+    }
+    if (node.type == NodeType::File || node.type == NodeType::Whiteout ||
+        !S_ISDIR(entry.mode)) {
+      return Action::Skip;
+    }
+    // Folders are merged.
+    action = Action::ExtractWithoutMetadata;
+  }
+  return action;
+}
+
+// static
+bool LayerMerger::IsWhiteout(const SquashfsEntry& entry) {
+  if (S_ISCHR(entry.mode) && entry.rdev == 0) {
+    return true;
+  }
+  // Also matches files in aufs internal folders, like ".wh..wh.plnk".
+  const std::string& path = entry.path;
+  return path.compare(0, kWhiteoutPrefixLen, kWhiteoutPrefix) == 0 ||
+         path.find(std::string("/") + kWhiteoutPrefix) != std::string::npos;
+}
+
+// static
+bool LayerMerger::IsOverlayXAttr(const std::string& name) {
+  return name.compare(0, sizeof(kOverlayXAttrPrefix) - 1,
+                      kOverlayXAttrPrefix) == 0;
+}
+
+void LayerMerger::addNode(const std::string& path, int layer,
+                          NodeType type) {
+  std::vector<Node>& nodes = nodes_[path];
+  for (Node& node : nodes) {
+    if (node.layer == layer) {
+      // Folder with opaque marker or whiteout in the same layer hides
+      // entries of lower layers.
+      if (type != NodeType::Folder) {
+        node.type = type;
+      }
+      return;
+    }
+  }
+  nodes.push_back({layer, type});
+}
+
+}  // namespace installer
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_LAYER_MERGER_H
+#define INSTALLER_UNSQUASHFS_LAYER_MERGER_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "unsquashfs/squashfs_reader.h"
+
+namespace installer {
+
+// Resolves precedence of stacked squashfs images (layers), like overlayfs.
+// Layer 0 is the bottom one, files in upper layers replace files at the same
+// path in lower layers. Whiteouts in upper layers remove lower files, both
+// overlayfs style (character device 0:0, "trusted.overlay.opaque" xattr)
+// and aufs style (".wh.<name>", ".wh..wh..opq") are supported.
+// Only upper layers are indexed in memory, as they are usually small.
+class LayerMerger {
+ public:
+  enum class Action {
+    // Extract this entry.
+    Extract,
+    // Create this folder, but its metadata is taken from upper layer.
+    ExtractWithoutMetadata,
+    // Replaced or removed by upper layer, or is a whiteout itself.
+    Skip,
+  };
+
+  LayerMerger();
+
+  // Index all entries of |reader| as layer |layer|, which shall be greater
+  // than 0.
+  bool addLayer(SquashfsReader& reader, int layer);
+
+  // Index |entry| of layer |layer|. |xattrs| is only checked for folders.
+  void addEntry(int layer, const SquashfsEntry& entry,
+                const XAttrList& xattrs);
+
+  // Get action of |entry| in layer |layer|.
+  Action resolve(int layer, const SquashfsEntry& entry) const;
+
+  // Returns true if |entry| is a whiteout, opaque marker or aufs internal
+  // file of upper layers.
+  static bool IsWhiteout(const SquashfsEntry& entry);
+
+  // Returns true if |name| is an overlayfs private xattr, which shall not be
+  // copied to target.
+  static bool IsOverlayXAttr(const std::string& name);
+
+ private:
+  enum class NodeType {
+    Folder,
+    // Folder hiding all entries of lower layers in it.
+    OpaqueFolder,
+    File,
+    Whiteout,
+  };
+
+  struct Node {
+    int layer;
+    NodeType type;
+  };
+
+  void addNode(const std::string& path, int layer, NodeType type);
+
+  // Nodes at each path, of all indexed layers.
+  std::unordered_map<std::string, std::vector<Node>> nodes_;
+
+  // Index of top most layer.
+  int top_layer_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_LAYER_MERGER_H
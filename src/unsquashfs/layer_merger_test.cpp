@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/layer_merger.h"
+
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+typedef LayerMerger::Action Action;
+
+SquashfsEntry Entry(const std::string& path, mode_t mode, dev_t rdev = 0) {
+  SquashfsEntry entry;
+  entry.path = path;
+  entry.mode = mode;
+  entry.rdev = rdev;
+  return entry;
+}
+
+SquashfsEntry Dir(const std::string& path) {
+  return Entry(path, S_IFDIR | 0755);
+}
+
+SquashfsEntry File(const std::string& path) {
+  return Entry(path, S_IFREG | 0644);
+}
+
+// overlayfs whiteout, character device 0:0.
+SquashfsEntry Whiteout(const std::string& path) {
+  return Entry(path, S_IFCHR, makedev(0, 0));
+}
+
+TEST(LayerMergerTest, Root) {
+  LayerMerger merger;
+  merger.addEntry(1, Dir(""), XAttrList());
+  merger.addEntry(2, Dir(""), XAttrList());
+  EXPECT_EQ(merger.resolve(0, Dir("")), Action::ExtractWithoutMetadata);
+  EXPECT_EQ(merger.resolve(1, Dir("")), Action::ExtractWithoutMetadata);
+  EXPECT_EQ(merger.resolve(2, Dir("")), Action::Extract);
+}
+
+TEST(LayerMergerTest, OverlayWhiteout) {
+  LayerMerger merger;
+  merger.addEntry(1, Dir("etc"), XAttrList());
+  merger.addEntry(1, Whiteout("etc/removed"), XAttrList());
+  merger.addEntry(1, Whiteout("etc/removed_dir"), XAttrList());
+  merger.addEntry(1, Entry("etc/null", S_IFCHR | 0666, makedev(1, 3)),
+                  XAttrList());
+
+  EXPECT_EQ(merger.resolve(0, File("etc/removed")), Action::Skip);
+  EXPECT_EQ(merger.resolve(0, Dir("etc/removed_dir")), Action::Skip);
+  EXPECT_EQ(merger.resolve(0, File("etc/removed_dir/a")), Action::Skip);
+  EXPECT_EQ(merger.resolve(0, File("etc/kept")), Action::Extract);
+  EXPECT_EQ(merger.resolve(0, Dir("etc")), Action::ExtractWithoutMetadata);
+  EXPECT_EQ(merger.resolve(1, Dir("etc")), Action::Extract);
+
+  // Whiteouts themselves are not extracted.
+  EXPECT_EQ(merger.resolve(1, Whiteout("etc/removed")), Action::Skip);
+  // Other character devices are normal files.
+  EXPECT_EQ(merger.resolve(0, File("etc/null")), Action::Skip);
+  EXPECT_EQ(merger.resolve(1, Entry("etc/null", S_IFCHR | 0666,
+                                    makedev(1, 3))),
+            Action::Extract);
+  // Whiteout in bottom layer is a real device file.
+  EXPECT_EQ(merger.resolve(0, Whiteout("dev/zero")), Action::Extract);
+}
+
+TEST(LayerMergerTest, OverlayOpaque) {
+  LayerMerger merger;
+  merger.addEntry(1, Dir("usr"), XAttrList());
+  merger.addEntry(1, Dir("usr/share"), {{"trusted.overlay.opaque", "y"}});
+  merger.addEntry(1, File("usr/share/new"), XAttrList());
+  merger.addEntry(1, Dir("opt"), {{"trusted.overlay.opaque", "n"}});
+  merger.addEntry(1, Dir("var"), {{"user.overlay.opaque", "y"}});
+
+  EXPECT_EQ(merger.resolve(0, File("usr/share/old")), Action::Skip);
+  EXPECT_EQ(merger.resolve(0, Dir("usr/share/old_dir")), Action::Skip);
+  EXPECT_EQ(merger.resolve(0, File("usr/share/new")), Action::Skip);
+  EXPECT_EQ(merger.resolve(0, File("usr/lib")), Action::Extract);
+  EXPECT_EQ(merger.resolve(1, File("usr/share/new")), Action::Extract);
+
+  // Only "y" in trusted namespace marks an opaque folder.
+  EXPECT_EQ(merger.resolve(0, File("opt/a")), Action::Extract);
+  EXPECT_EQ(merger.resolve(0, File("var/a")), Action::Extract);
+
+  EXPECT_TRUE(LayerMerger::IsOverlayXAttr("trusted.overlay.opaque"));
+  EXPECT_FALSE(LayerMerger::IsOverlayXAttr("user.overlay.opaque"));
+}
+
+TEST(LayerMergerTest, AufsWhiteout) {
+  LayerMerger merger;
+  merger.addEntry(1, Dir("etc"), XAttrList());
+  merger.addEntry(1, File("etc/.wh.removed"), XAttrList());
+  merger.addEntry(1, Dir("var"), XAttrList());
+  merger.addEntry(1, File("var/.wh..wh..opq"), XAttrList());
+  merger.addEntry(1, File("var/new"), XAttrList());
+  merger.addEntry(1, Dir(".wh..wh.plnk"), XAttrList());
+  merger.addEntry(1, File(".wh..wh.plnk/123.456"), XAttrList());
+  merger.addEntry(1, File(".wh.top"), XAttrList());
+
+  EXPECT_EQ(merger.resolve(0, File("etc/removed")), Action::Skip);
+  EXPECT_EQ(merger.resolve(0, File("etc/kept")), Action::Extract);
+  EXPECT_EQ(merger.resolve(0, File("top")), Action::Skip);
+  EXPECT_EQ(merger.resolve(0, File("var/old")), Action::Skip);
+  EXPECT_EQ(merger.resolve(0, Dir("var")), Action::ExtractWithoutMetadata);
+  EXPECT_EQ(merger.resolve(1, File("var/new")), Action::Extract);
+
+  // aufs internal files are not extracted.
+  EXPECT_EQ(merger.resolve(1, File("etc/.wh.removed")), Action::Skip);
+  EXPECT_EQ(merger.resolve(1, File("var/.wh..wh..opq")), Action::Skip);
+  EXPECT_EQ(merger.resolve(1, Dir(".wh..wh.plnk")), Action::Skip);
+  EXPECT_EQ(merger.resolve(1, File(".wh..wh.plnk/123.456")), Action::Skip);
+  EXPECT_EQ(merger.resolve(0, File("plnk")), Action::Extract);
+}
+
+TEST(LayerMergerTest, Precedence) {
+  LayerMerger merger;
+  // Removed in layer 1, and added back in layer 2.
+  merger.addEntry(1, Whiteout("a"), XAttrList());
+  merger.addEntry(2, File("a"), XAttrList());
+  // Folder replaced by a file.
+  merger.addEntry(1, File("b"), XAttrList());
+  // Opaque folder in layer 1, merged with layer 2.
+  merger.addEntry(1, Dir("c"), {{"trusted.overlay.opaque", "y"}});
+  merger.addEntry(1, File("c/x"), XAttrList());
+  merger.addEntry(2, Dir("c"), XAttrList());
+  merger.addEntry(2, File("c/y"), XAttrList());
+
+  EXPECT_EQ(merger.resolve(0, File("a")), Action::Skip);
+  EXPECT_EQ(merger.resolve(1, Whiteout("a")), Action::Skip);
+  EXPECT_EQ(merger.resolve(2, File("a")), Action::Extract);
+
+  EXPECT_EQ(merger.resolve(0, Dir("b")), Action::Skip);
+  EXPECT_EQ(merger.resolve(0, File("b/child")), Action::Skip);
+  EXPECT_EQ(merger.resolve(1, File("b")), Action::Extract);
+
+  EXPECT_EQ(merger.resolve(0, File("c/old")), Action::Skip);
+  EXPECT_EQ(merger.resolve(1, File("c/x")), Action::Extract);
+  EXPECT_EQ(merger.resolve(1, Dir("c")), Action::ExtractWithoutMetadata);
+  EXPECT_EQ(merger.resolve(2, Dir("c")), Action::Extract);
+  EXPECT_EQ(merger.resolve(2, File("c/y")), Action::Extract);
+}
+
+TEST(LayerMergerTest, AddLayer) {
+  // "dir" in test image has "trusted.overlay.opaque" xattr.
+  SquashfsReader reader;
+  ASSERT_TRUE(reader.open(UNSQUASHFS_TESTDATA_DIR "/test.squashfs"));
+  LayerMerger merger;
+  ASSERT_TRUE(merger.addLayer(reader, 1));
+
+  EXPECT_EQ(merger.resolve(0, File("dir/old")), Action::Skip);
+  EXPECT_EQ(merger.resolve(0, File("regular")), Action::Skip);
+  EXPECT_EQ(merger.resolve(0, File("other")), Action::Extract);
+  EXPECT_EQ(merger.resolve(1, File("regular")), Action::Extract);
+  EXPECT_EQ(merger.resolve(1, Dir("")), Action::Extract);
+}
+
+}  // namespace
+}  // namespace installer
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/manifest.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+#include "unsquashfs/sha256.h"
+
+namespace installer {
+
+const char kManifestHeader[] = "# deepin-installer-unsquashfs manifest 1";
+const char kManifestNoHash[] = "-";
+
+namespace {
+
+// Size of buffer to read file content.
+const size_t kReadBufferSize = 128 * 1024;
+
+std::string EscapePath(const std::string& path) {
+  std::string result;
+  for (char c : path) {
+    if (c == '\\') {
+      result.append("\\\\");
+    } else if (c == '\n') {
+      result.append("\\n");
+    } else {
+      result.push_back(c);
+    }
+  }
+  return result;
+}
+
+bool UnescapePath(const std::string& escaped, std::string& path) {
+  path.clear();
+  for (size_t i = 0; i < escaped.size(); ++i) {
+    if (escaped[i] != '\\') {
+      path.push_back(escaped[i]);
+    } else if (i + 1 < escaped.size() && escaped[i + 1] == '\\') {
+      path.push_back('\\');
+      i ++;
+    } else if (i + 1 < escaped.size() && escaped[i + 1] == 'n') {
+      path.push_back('\n');
+      i ++;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Hash content of regular file |file|.
+bool HashFile(const std::string& file, std::string& hash) {
+  const int fd = open(file.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  std::vector<char> buf(kReadBufferSize);
+  Sha256 sha256;
+  ssize_t len;
+  while ((len = read(fd, buf.data(), buf.size())) != 0) {
+    if (len < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      close(fd);
+      return false;
+    }
+    sha256.update(buf.data(), size_t(len));
+  }
+  close(fd);
+  hash = sha256.finish();
+  return true;
+}
+
+// Attributes of overlay filesystem, like "trusted.overlay.opaque", are
+// dropped when stacked images are extracted.
+const char kOverlayXAttrPrefix[] = "trusted.overlay.";
+
+// Hash extended attributes of |file|, sorted by their names.
+std::string HashXAttrs(const std::string& file) {
+  std::vector<char> list(XATTR_LIST_MAX);
+  const ssize_t list_len = llistxattr(file.c_str(), list.data(), list.size());
+  if (list_len <= 0) {
+    return kManifestNoHash;
+  }
+  std::vector<std::string> names;
+  for (ssize_t pos = 0; pos < list_len;
+       pos += ssize_t(strlen(&list[size_t(pos)])) + 1) {
+    const char* name = &list[size_t(pos)];
+    if (strncmp(name, kOverlayXAttrPrefix,
+                sizeof(kOverlayXAttrPrefix) - 1) != 0) {
+      names.emplace_back(name);
+    }
+  }
+  if (names.empty()) {
+    return kManifestNoHash;
+  }
+  std::sort(names.begin(), names.end());
+
+  std::vector<char> value(XATTR_SIZE_MAX);
+  Sha256 sha256;
+  for (const std::string& name : names) {
+    const ssize_t value_len = lgetxattr(file.c_str(), name.c_str(),
+                                        value.data(), value.size());
+    if (value_len < 0) {
+      continue;
+    }
+    sha256.update(name.c_str(), name.size() + 1);
+    sha256.update(value.data(), size_t(value_len));
+    sha256.update("", 1);
+  }
+  return sha256.finish();
+}
+
+}  // namespace
+
+std::string FormatManifestEntry(const ManifestEntry& entry) {
+  std::ostringstream stream;
+  stream << (entry.hash.empty() ? kManifestNoHash : entry.hash) << ' '
+         << entry.size << ' '
+         << std::oct << entry.mode << std::dec << ' '
+         << entry.uid << ' '
+         << entry.gid << ' '
+         << (entry.xattr_hash.empty() ? kManifestNoHash : entry.xattr_hash)
+         << ' ' << EscapePath(entry.path);
+  return stream.str();
+}
+
+bool ParseManifestEntry(const std::string& line, ManifestEntry& entry) {
+  std::istringstream stream(line);
+  stream >> entry.hash >> entry.size >> std::oct >> entry.mode >> std::dec
+         >> entry.uid >> entry.gid >> entry.xattr_hash;
+  // Exactly one space before path, which might start with spaces.
+  if (!stream || stream.get() != ' ') {
+    return false;
+  }
+  std::string escaped;
+  std::getline(stream, escaped);
+  return !escaped.empty() && UnescapePath(escaped, entry.path);
+}
+
+bool ReadManifestEntry(const std::string& root, const std::string& path,
+                       ManifestEntry& entry) {
+  const std::string file = (path == ".") ? root : root + "/" + path;
+  struct stat st;
+  if (lstat(file.c_str(), &st) != 0) {
+    return false;
+  }
+  entry.path = path;
+  entry.mode = st.st_mode;
+  entry.uid = st.st_uid;
+  entry.gid = st.st_gid;
+  entry.size = 0;
+  entry.hash = kManifestNoHash;
+  if (S_ISREG(st.st_mode)) {
+    entry.size = uint64_t(st.st_size);
+    if (!HashFile(file, entry.hash)) {
+      return false;
+    }
+  } else if (S_ISLNK(st.st_mode)) {
+    char target[PATH_MAX];
+    const ssize_t len = readlink(file.c_str(), target, sizeof(target));
+    if (len < 0) {
+      return false;
+    }
+    entry.hash = Sha256::Digest(std::string(target, size_t(len)));
+  }
+  entry.xattr_hash = HashXAttrs(file);
+  return true;
+}
+
+std::string CompareManifestEntry(const ManifestEntry& expected,
+                                 const ManifestEntry& actual) {
+  if (expected.mode != actual.mode) {
+    return "mode";
+  }
+  if (expected.uid != actual.uid || expected.gid != actual.gid) {
+    return "owner";
+  }
+  if (expected.size != actual.size) {
+    return "size";
+  }
+  if (expected.hash != actual.hash) {
+    return "hash";
+  }
+  if (expected.xattr_hash != actual.xattr_hash) {
+    return "xattr";
+  }
+  return std::string();
+}
+
+}  // namespace installer
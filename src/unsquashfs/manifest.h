@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_MANIFEST_H
+#define INSTALLER_UNSQUASHFS_MANIFEST_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+
+namespace installer {
+
+// Attributes of a file in manifest, which is generated when building ISO and
+// used to verify extracted files.
+struct ManifestEntry {
+  // Relative path, "." for root folder.
+  std::string path;
+  // File type and permissions, like st_mode in struct stat.
+  mode_t mode = 0;
+  uid_t uid = 0;
+  gid_t gid = 0;
+  // Size of regular file, 0 for other types.
+  uint64_t size = 0;
+  // SHA-256 of content of regular file or target of symbolic link, or
+  // kManifestNoHash for other types.
+  std::string hash;
+  // SHA-256 of extended attributes except those of overlay filesystem, or
+  // kManifestNoHash if not set.
+  std::string xattr_hash;
+};
+
+// First line of manifest file.
+extern const char kManifestHeader[];
+
+// Placeholder of empty hash field.
+extern const char kManifestNoHash[];
+
+// Format |entry| as a line in manifest, without trailing new line:
+//   <hash> <size> <mode> <uid> <gid> <xattr_hash> <path>
+// |mode| is in octal, new line and backslash in |path| are escaped.
+std::string FormatManifestEntry(const ManifestEntry& entry);
+
+// Parse a |line| formatted by FormatManifestEntry().
+bool ParseManifestEntry(const std::string& line, ManifestEntry& entry);
+
+// Read attributes of |path| in folder |root| into |entry|, hashing its
+// content. Returns false if |path| cannot be read.
+bool ReadManifestEntry(const std::string& root, const std::string& path,
+                       ManifestEntry& entry);
+
+// Compare |actual| attributes with |expected| ones. Returns name of first
+// field not matched, or an empty string if all fields are matched.
+std::string CompareManifestEntry(const ManifestEntry& expected,
+                                 const ManifestEntry& actual);
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_MANIFEST_H
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/manifest.h"
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+#include "unsquashfs/sha256.h"
+
+namespace installer {
+namespace {
+
+TEST(ManifestTest, FormatAndParse) {
+  ManifestEntry entry;
+  entry.path = " usr/share/a b\\c\nd";
+  entry.mode = S_IFREG | 04755;
+  entry.uid = 1000;
+  entry.gid = 100;
+  entry.size = 3;
+  entry.hash = Sha256::Digest("abc");
+  entry.xattr_hash = kManifestNoHash;
+
+  const std::string line = FormatManifestEntry(entry);
+  EXPECT_EQ(line.find('\n'), std::string::npos);
+  EXPECT_EQ(line.find(" 3 104755 1000 100 - "), entry.hash.size());
+
+  ManifestEntry parsed;
+  ASSERT_TRUE(ParseManifestEntry(line, parsed));
+  EXPECT_EQ(parsed.path, entry.path);
+  EXPECT_TRUE(CompareManifestEntry(entry, parsed).empty());
+
+  EXPECT_FALSE(ParseManifestEntry("- 0 40755 0 0 -", parsed));
+  EXPECT_FALSE(ParseManifestEntry("- 0 40755 0 0 - bad\\escape", parsed));
+}
+
+TEST(ManifestTest, ReadManifestEntry) {
+  const std::string root = "/tmp";
+  const std::string name = "installer-manifest-test.txt";
+  FILE* file = fopen((root + "/" + name).c_str(), "w");
+  ASSERT_NE(file, nullptr);
+  fputs("abc", file);
+  fclose(file);
+
+  ManifestEntry expected;
+  ASSERT_TRUE(ReadManifestEntry(root, name, expected));
+  EXPECT_TRUE(S_ISREG(expected.mode));
+  EXPECT_EQ(expected.size, 3u);
+  EXPECT_EQ(expected.hash, Sha256::Digest("abc"));
+
+  file = fopen((root + "/" + name).c_str(), "w");
+  ASSERT_NE(file, nullptr);
+  fputs("abd", file);
+  fclose(file);
+  ManifestEntry actual;
+  ASSERT_TRUE(ReadManifestEntry(root, name, actual));
+  EXPECT_EQ(CompareManifestEntry(expected, actual), "hash");
+
+  unlink((root + "/" + name).c_str());
+  EXPECT_FALSE(ReadManifestEntry(root, name, actual));
+}
+
+}  // namespace
+}  // namespace installer
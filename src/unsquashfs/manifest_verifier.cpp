@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/manifest_verifier.h"
+
+#include <stdio.h>
+#include <fstream>
+#include <vector>
+
+#include "unsquashfs/work_stealing_pool.h"
+
+namespace installer {
+
+namespace {
+
+// Maximum number of pending verify tasks per worker thread.
+const int kMaxPendingTasksPerJob = 256;
+
+// Path of root folder in manifest.
+const char kRootPath[] = ".";
+
+// Escape |str| as JSON string, without quotes.
+std::string EscapeJson(const std::string& str) {
+  std::string result;
+  for (unsigned char c : str) {
+    if (c == '"' || c == '\\') {
+      result.push_back('\\');
+      result.push_back(char(c));
+    } else if (c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      result.append(buf);
+    } else {
+      result.push_back(char(c));
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+ManifestVerifier::ManifestVerifier(const std::string& dest_dir, int jobs)
+    : dest_dir_(dest_dir),
+      pool_(new WorkStealingPool(jobs, jobs * kMaxPendingTasksPerJob)),
+      next_worker_(0),
+      checked_(0),
+      failed_(0) {
+}
+
+ManifestVerifier::~ManifestVerifier() {
+}
+
+bool ManifestVerifier::load(int layer, const std::string& manifest_file) {
+  std::ifstream stream(manifest_file);
+  std::string line;
+  if (!std::getline(stream, line) || line != kManifestHeader) {
+    fprintf(stderr, "ManifestVerifier invalid manifest: %s\n",
+            manifest_file.c_str());
+    return false;
+  }
+  Manifest manifest;
+  while (std::getline(stream, line)) {
+    Item item;
+    if (!ParseManifestEntry(line, item.entry)) {
+      fprintf(stderr, "ManifestVerifier invalid line in %s: %s\n",
+              manifest_file.c_str(), line.c_str());
+      return false;
+    }
+    const std::string path = item.entry.path;
+    manifest.emplace(path, std::move(item));
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  manifests_[layer].swap(manifest);
+  return true;
+}
+
+void ManifestVerifier::submit(int layer, const std::string& path) {
+  const std::string manifest_path = path.empty() ? kRootPath : path;
+  ManifestEntry entry;
+  bool unexpected;
+  if (!this->takeItem(layer, manifest_path, entry, unexpected)) {
+    if (unexpected) {
+      this->report("unexpected", manifest_path, std::string());
+    }
+    return;
+  }
+  const int index = int(next_worker_++ % unsigned(pool_->size()));
+  pool_->submitTo(index, [this, entry](int) {
+    this->verify(entry);
+  });
+}
+
+void ManifestVerifier::skip(int layer, const std::string& path) {
+  ManifestEntry entry;
+  bool unexpected;
+  this->takeItem(layer, path.empty() ? kRootPath : path, entry, unexpected);
+}
+
+bool ManifestVerifier::finish() {
+  std::vector<ManifestEntry> remaining;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& manifest : manifests_) {
+      for (auto& iter : manifest.second) {
+        if (!iter.second.handled) {
+          iter.second.handled = true;
+          remaining.push_back(iter.second.entry);
+        }
+      }
+    }
+  }
+  for (const ManifestEntry& entry : remaining) {
+    pool_->submit([this, entry](int) {
+      this->verify(entry);
+    });
+  }
+  pool_->wait();
+
+  fprintf(stderr, "{\"verify\":\"summary\",\"checked\":%zu,\"failed\":%zu}\n",
+          checked_.load(), failed_.load());
+  return failed_ == 0;
+}
+
+bool ManifestVerifier::takeItem(int layer, const std::string& path,
+                                ManifestEntry& entry, bool& unexpected) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  unexpected = false;
+  const auto manifest = manifests_.find(layer);
+  if (manifest == manifests_.end()) {
+    return false;
+  }
+  const auto iter = manifest->second.find(path);
+  if (iter == manifest->second.end()) {
+    unexpected = true;
+    return false;
+  }
+  if (iter->second.handled) {
+    return false;
+  }
+  iter->second.handled = true;
+  entry = iter->second.entry;
+  return true;
+}
+
+void ManifestVerifier::verify(const ManifestEntry& expected) {
+  checked_ ++;
+  ManifestEntry actual;
+  if (!ReadManifestEntry(dest_dir_, expected.path, actual)) {
+    this->report("missing", expected.path, std::string());
+    return;
+  }
+  const std::string field = CompareManifestEntry(expected, actual);
+  if (!field.empty()) {
+    this->report("mismatch", expected.path, field);
+  }
+}
+
+void ManifestVerifier::report(const char* kind, const std::string& path,
+                              const std::string& field) {
+  failed_ ++;
+  std::lock_guard<std::mutex> lock(report_mutex_);
+  if (field.empty()) {
+    fprintf(stderr, "{\"verify\":\"%s\",\"path\":\"%s\"}\n",
+            kind, EscapeJson(path).c_str());
+  } else {
+    fprintf(stderr, "{\"verify\":\"%s\",\"path\":\"%s\",\"field\":\"%s\"}\n",
+            kind, EscapeJson(path).c_str(), field.c_str());
+  }
+}
+
+}  // namespace installer
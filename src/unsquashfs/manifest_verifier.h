@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_MANIFEST_VERIFIER_H
+#define INSTALLER_UNSQUASHFS_MANIFEST_VERIFIER_H
+
+#include <stddef.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "unsquashfs/manifest.h"
+
+namespace installer {
+
+class WorkStealingPool;
+
+// Verify extracted files against manifests of images, in its own worker
+// threads, so that files are hashed while later files are still being
+// extracted.
+// Each layer of stacked images has its own manifest. Problems are reported
+// to stderr, one JSON object per line, like:
+//   {"verify":"mismatch","path":"usr/bin/ls","field":"hash"}
+class ManifestVerifier {
+ public:
+  // Verify files in |dest_dir| with |jobs| threads.
+  ManifestVerifier(const std::string& dest_dir, int jobs);
+  ~ManifestVerifier();
+
+  ManifestVerifier(const ManifestVerifier&) = delete;
+  ManifestVerifier& operator=(const ManifestVerifier&) = delete;
+
+  // Load manifest of |layer| from |manifest_file|.
+  bool load(int layer, const std::string& manifest_file);
+
+  // Verify |path| extracted from |layer| asynchronously. Empty |path| means
+  // root folder. This method is thread safe.
+  void submit(int layer, const std::string& path);
+
+  // Mark |path| in |layer| as not extracted, as it is replaced or removed by
+  // upper layers. This method is thread safe.
+  void skip(int layer, const std::string& path);
+
+  // Verify remaining files in manifests which are neither submitted nor
+  // skipped, and wait for all files to be verified. Returns false if any
+  // file is missing or mismatched.
+  bool finish();
+
+ private:
+  struct Item {
+    ManifestEntry entry;
+    // Submitted or skipped.
+    bool handled = false;
+  };
+  typedef std::unordered_map<std::string, Item> Manifest;
+
+  // Find item of |path| in |layer| and mark it as handled. Returns false if
+  // it is not found or is handled already. |unexpected| is set to true if
+  // |layer| has manifest but |path| is not in it.
+  bool takeItem(int layer, const std::string& path, ManifestEntry& entry,
+                bool& unexpected);
+
+  // Compare |expected| with actual file in worker thread.
+  void verify(const ManifestEntry& expected);
+
+  void report(const char* kind, const std::string& path,
+              const std::string& field);
+
+  std::string dest_dir_;
+  std::unique_ptr<WorkStealingPool> pool_;
+  // Next worker to submit task to, as submit() is called in many threads.
+  std::atomic<unsigned int> next_worker_;
+
+  // Protects |manifests_|.
+  std::mutex mutex_;
+  std::map<int, Manifest> manifests_;
+
+  std::atomic<size_t> checked_;
+  std::atomic<size_t> failed_;
+  // Serializes report lines.
+  std::mutex report_mutex_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_MANIFEST_VERIFIER_H
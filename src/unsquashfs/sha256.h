@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_SHA256_H
+#define INSTALLER_UNSQUASHFS_SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace installer {
+
+// SHA-256 message digest, used to verify extracted files.
+class Sha256 {
+ public:
+  Sha256();
+
+  void update(const void* data, size_t len);
+  void update(const std::string& data) {
+    this->update(data.data(), data.size());
+  }
+
+  // Returns hex digest. No more data shall be added after calling this.
+  std::string finish();
+
+  // Returns hex digest of |data|.
+  static std::string Digest(const std::string& data);
+
+ private:
+  // Process one 64 bytes block in |buffer_|.
+  void transform(const uint8_t* block);
+
+  uint32_t state_[8];
+  uint8_t buffer_[64];
+  size_t buffer_len_;
+  uint64_t total_len_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_SHA256_H
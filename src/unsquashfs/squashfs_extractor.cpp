@@ -0,0 +1,631 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/squashfs_extractor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "unsquashfs/extract_journal.h"
+#include "unsquashfs/extract_progress.h"
+#include "unsquashfs/layer_merger.h"
+#include "unsquashfs/manifest_verifier.h"
+#include "unsquashfs/device_queues.h"
+#include "unsquashfs/writeback_throttle.h"
+
+namespace installer {
+
+namespace {
+
+// Maximum number of pending tasks per worker thread.
+const int kMaxPendingTasksPerJob = 256;
+
+// Large files are split into chunks of this many data blocks.
+const size_t kBlocksPerChunk = 64;
+
+// Remove |dest_file| if it exists and is not a folder.
+void RemoveDestFile(const char* dest_file) {
+  struct stat dest_stat;
+  if (lstat(dest_file, &dest_stat) == 0 && !S_ISDIR(dest_stat.st_mode)) {
+    unlink(dest_file);
+  }
+}
+
+// Returns true if |dest_file| already has extended attribute |xattr|.
+bool HasXAttr(const char* dest_file, const XAttr& xattr) {
+  std::vector<char> value(xattr.second.size() + 1);
+  const ssize_t len = lgetxattr(dest_file, xattr.first.c_str(), value.data(),
+                                value.size());
+  return len == ssize_t(xattr.second.size()) &&
+         memcmp(value.data(), xattr.second.data(), xattr.second.size()) == 0;
+}
+
+}  // namespace
+
+struct SquashfsExtractor::FileTask {
+  // Image in which this file is stored, and its index in layers.
+  SquashfsReader* reader = nullptr;
+  int layer = 0;
+  SquashfsEntry entry;
+  std::string dest_file;
+  // Position range of data blocks in image, used in media order mode.
+  uint64_t data_start = 0;
+  uint64_t data_end = 0;
+  int fd = -1;
+  // Number of chunks not written yet.
+  std::atomic<size_t> remaining_chunks;
+  // Set if any chunk failed to be read, file is not recorded in journal.
+  std::atomic<bool> read_failed{false};
+  // Compare content of existing file before extracting it, in update mode.
+  bool check_content = false;
+  // Device of parent folder in target, selects writer queue.
+  dev_t dev = 0;
+};
+
+SquashfsExtractor::SquashfsExtractor(SquashfsReader& reader,
+                                     const ExtractOptions& options)
+    : layers_(1, &reader),
+      options_(options),
+      progress_(nullptr),
+      throttle_(nullptr),
+      journal_(nullptr),
+      verifier_(nullptr),
+      failed_(false),
+      unchanged_files_(0) {
+}
+
+SquashfsExtractor::~SquashfsExtractor() {
+}
+
+bool SquashfsExtractor::extract() {
+  if (mkdir(options_.dest_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "SquashfsExtractor failed to create dest dir: %s\n",
+            options_.dest_dir.c_str());
+    return false;
+  }
+
+  if (options_.jobs > 1) {
+    queues_.reset(new DeviceQueues(options_.jobs,
+                                   options_.jobs * kMaxPendingTasksPerJob));
+    // Keep files in submission order, which is media order.
+    queues_->setFifo(options_.media_order);
+  }
+
+  bool ok = true;
+  if (layers_.size() > 1) {
+    // Index upper layers first.
+    merger_.reset(new LayerMerger());
+    for (size_t layer = 1; ok && layer < layers_.size(); ++layer) {
+      ok = merger_->addLayer(*layers_[layer], int(layer));
+    }
+    if (!ok) {
+      fprintf(stderr, "SquashfsExtractor failed to index layers\n");
+    }
+  }
+
+  for (size_t layer = 0; ok && layer < layers_.size(); ++layer) {
+    // Inode numbers are unique only in the same image.
+    hard_links_.clear();
+    ok = layers_[layer]->walk([this, layer](SquashfsEntry& entry) {
+      return this->handleEntry(int(layer), entry);
+    });
+    if (ok && !pending_files_.empty()) {
+      ok = this->submitPendingFiles();
+    }
+    pending_files_.clear();
+  }
+
+  if (queues_) {
+    // Wait for worker threads to extract remaining files.
+    queues_->wait();
+    queues_.reset();
+  }
+  dir_devices_.clear();
+
+  // Targets of hard links are created now.
+  for (const HardLink& link : pending_links_) {
+    if (!ok) {
+      break;
+    }
+    ok = this->createHardLink(link.target, link.dest_file);
+    this->verifyPath(link.layer, link.path);
+  }
+  pending_links_.clear();
+  for (const auto& link : unverified_links_) {
+    this->verifyPath(link.first, link.second);
+  }
+  unverified_links_.clear();
+
+  // Update metadata of folders in reverse order, so that children folders
+  // are handled before their parents.
+  for (auto iter = dir_entries_.rbegin(); iter != dir_entries_.rend();
+       ++iter) {
+    this->applyMetadata(layers_[size_t(iter->first)], iter->second,
+                        this->destPath(iter->second));
+    this->verifyPath(iter->first, iter->second.path);
+  }
+  dir_entries_.clear();
+  merger_.reset();
+
+  if (progress_ != nullptr) {
+    progress_->finish();
+  }
+
+  return ok && !failed_;
+}
+
+bool SquashfsExtractor::handleEntry(int layer, SquashfsEntry& entry) {
+  if (failed_) {
+    // Stop tree walking if any worker thread failed.
+    return false;
+  }
+
+  SquashfsReader* reader = layers_[size_t(layer)];
+  LayerMerger::Action action = LayerMerger::Action::Extract;
+  if (merger_) {
+    action = merger_->resolve(layer, entry);
+  }
+  if (action == LayerMerger::Action::Skip) {
+    if (verifier_ != nullptr) {
+      verifier_->skip(layer, entry.path);
+    }
+    // Still counted in progress, as totals include all layers.
+    this->updateProgress(S_ISREG(entry.mode) ? entry.file_size : 0);
+    return true;
+  }
+
+  const std::string dest_file = this->destPath(entry);
+  if (S_ISDIR(entry.mode)) {
+    if (!this->createDir(dest_file)) {
+      return false;
+    }
+    struct stat dest_stat;
+    if (queues_ && lstat(dest_file.c_str(), &dest_stat) == 0) {
+      // Another disk may be mounted at this folder.
+      dir_devices_[entry.path] = dest_stat.st_dev;
+    }
+    if (action == LayerMerger::Action::Extract) {
+      dir_entries_.emplace_back(layer, entry);
+    } else if (verifier_ != nullptr) {
+      // Metadata is taken from upper layer.
+      verifier_->skip(layer, entry.path);
+    }
+    this->updateProgress(0);
+    return true;
+  }
+
+  if (S_ISREG(entry.mode)) {
+    const bool has_links = (entry.nlink > 1);
+    if (has_links) {
+      const auto iter = hard_links_.find(entry.inode_number);
+      if (iter != hard_links_.end()) {
+        // Inode is counted only once in progress.
+        if (options_.media_order) {
+          pending_links_.push_back({layer, entry.path, iter->second,
+                                    dest_file});
+          return true;
+        }
+        if (verifier_ != nullptr) {
+          unverified_links_.emplace_back(layer, entry.path);
+        }
+        return this->createHardLink(iter->second, dest_file);
+      }
+      hard_links_.emplace(entry.inode_number, dest_file);
+    }
+
+    if (journal_ != nullptr && this->isExtracted(layer, entry, dest_file)) {
+      // Extracted by previous run.
+      this->verifyPath(layer, entry.path);
+      this->updateProgress(entry.file_size);
+      return true;
+    }
+
+    std::shared_ptr<FileTask> task = std::make_shared<FileTask>();
+    task->reader = reader;
+    task->layer = layer;
+    task->entry = std::move(entry);
+    task->dest_file = dest_file;
+    if (queues_) {
+      const size_t slash = task->entry.path.rfind('/');
+      const auto iter = dir_devices_.find(
+          slash == std::string::npos ? std::string() :
+                                       task->entry.path.substr(0, slash));
+      if (iter != dir_devices_.end()) {
+        task->dev = iter->second;
+      }
+    }
+    struct stat dest_stat;
+    if (options_.update && lstat(dest_file.c_str(), &dest_stat) == 0 &&
+        S_ISREG(dest_stat.st_mode) &&
+        uint64_t(dest_stat.st_size) == task->entry.file_size) {
+      if (!options_.update_checksum) {
+        if (dest_stat.st_mtime == time_t(task->entry.mtime)) {
+          this->keepFile(*task);
+          return true;
+        }
+      } else if (has_links || !queues_) {
+        // Links to this file are created right after it, so its content is
+        // compared here.
+        if (this->isSameFile(*task)) {
+          this->keepFile(*task);
+          return true;
+        }
+      } else {
+        // Compared in worker threads.
+        task->check_content = true;
+      }
+    }
+    if (options_.media_order) {
+      // Extracted after tree walking.
+      reader->dataRange(task->entry, task->data_start, task->data_end);
+      pending_files_.push_back(task);
+      return true;
+    }
+    return this->submitFile(task);
+  }
+
+  const bool ok = this->createSpecialFile(entry, dest_file);
+  if (ok) {
+    this->applyMetadata(reader, entry, dest_file);
+    this->verifyPath(layer, entry.path);
+  }
+  this->updateProgress(0);
+  return ok;
+}
+
+bool SquashfsExtractor::submitFile(const std::shared_ptr<FileTask>& task) {
+  if (!queues_) {
+    this->extractFile(task);
+  } else if ((task->entry.block_list.size() <= kBlocksPerChunk &&
+              task->entry.nlink <= 1) || task->check_content) {
+    queues_->submit(task->dev, [this, task](int) {
+      this->extractFile(task);
+    });
+  } else {
+    // Create large file or file with hard links here, so that its links
+    // can be created before its content is written. Then write its chunks
+    // in worker threads.
+    if (!this->createFile(*task)) {
+      return false;
+    }
+    const size_t num_blocks = task->entry.block_list.size();
+    // File with only fragment has one chunk too.
+    const size_t num_chunks = std::max(
+        size_t(1), (num_blocks + kBlocksPerChunk - 1) / kBlocksPerChunk);
+    task->remaining_chunks = num_chunks;
+    for (size_t i = 0; i < num_chunks; ++i) {
+      const size_t first_block = i * kBlocksPerChunk;
+      const size_t last_block = std::min(num_blocks,
+                                         first_block + kBlocksPerChunk);
+      queues_->submit(task->dev, [this, task, first_block, last_block](int) {
+        this->extractChunk(task, first_block, last_block);
+      });
+    }
+  }
+  return !failed_;
+}
+
+bool SquashfsExtractor::submitPendingFiles() {
+  // Stable sort keeps tree order of files without content.
+  std::stable_sort(pending_files_.begin(), pending_files_.end(),
+                   [](const std::shared_ptr<FileTask>& a,
+                      const std::shared_ptr<FileTask>& b) {
+    return a->data_start < b->data_start;
+  });
+
+  // End of image range requested by readahead.
+  uint64_t readahead_end = 0;
+  const uint64_t window = options_.readahead_window;
+  for (const std::shared_ptr<FileTask>& task : pending_files_) {
+    if (window > 0 && task->data_end > readahead_end) {
+      const uint64_t start = std::max(task->data_start, readahead_end);
+      readahead_end = std::max(task->data_end, task->data_start + window);
+      task->reader->readAhead(start, readahead_end - start);
+    }
+    if (!this->submitFile(task)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SquashfsExtractor::createDir(const std::string& dest_file) {
+  if (mkdir(dest_file.c_str(), S_IRWXU) == 0) {
+    return true;
+  }
+  if (errno == EEXIST) {
+    struct stat dest_stat;
+    if (lstat(dest_file.c_str(), &dest_stat) == 0 &&
+        S_ISDIR(dest_stat.st_mode)) {
+      return true;
+    }
+    // Replace existing file with folder.
+    unlink(dest_file.c_str());
+    if (mkdir(dest_file.c_str(), S_IRWXU) == 0) {
+      return true;
+    }
+  }
+  fprintf(stderr, "SquashfsExtractor failed to create folder %s: %s\n",
+          dest_file.c_str(), strerror(errno));
+  return false;
+}
+
+bool SquashfsExtractor::createHardLink(const std::string& target,
+                                       const std::string& dest_file) {
+  struct stat target_stat, dest_stat;
+  if (options_.update && lstat(target.c_str(), &target_stat) == 0 &&
+      lstat(dest_file.c_str(), &dest_stat) == 0 &&
+      target_stat.st_dev == dest_stat.st_dev &&
+      target_stat.st_ino == dest_stat.st_ino) {
+    // Already linked.
+    return true;
+  }
+  RemoveDestFile(dest_file.c_str());
+  if (link(target.c_str(), dest_file.c_str()) != 0) {
+    fprintf(stderr, "SquashfsExtractor failed to link %s to %s: %s\n",
+            dest_file.c_str(), target.c_str(), strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool SquashfsExtractor::createSpecialFile(const SquashfsEntry& entry,
+                                          const std::string& dest_file) {
+  if (options_.update && this->isSameSpecialFile(entry, dest_file)) {
+    return true;
+  }
+  RemoveDestFile(dest_file.c_str());
+  const char* dest = dest_file.c_str();
+  int ret;
+  if (S_ISLNK(entry.mode)) {
+    ret = symlink(entry.symlink.c_str(), dest);
+  } else if (S_ISCHR(entry.mode) || S_ISBLK(entry.mode)) {
+    ret = mknod(dest, entry.mode, entry.rdev);
+  } else if (S_ISFIFO(entry.mode) || S_ISSOCK(entry.mode)) {
+    ret = mknod(dest, entry.mode, 0);
+  } else {
+    fprintf(stderr, "SquashfsExtractor unknown file mode: %o\n", entry.mode);
+    return false;
+  }
+  if (ret != 0) {
+    const int saved_errno = errno;
+    fprintf(stderr, "SquashfsExtractor failed to create %s: %s\n",
+            dest, strerror(saved_errno));
+    return (saved_errno == EEXIST);
+  }
+  return true;
+}
+
+bool SquashfsExtractor::isSameSpecialFile(
+    const SquashfsEntry& entry, const std::string& dest_file) const {
+  struct stat dest_stat;
+  if (lstat(dest_file.c_str(), &dest_stat) != 0 ||
+      (dest_stat.st_mode & S_IFMT) != (entry.mode & S_IFMT)) {
+    return false;
+  }
+  if (S_ISLNK(entry.mode)) {
+    std::vector<char> target(entry.symlink.size() + 1);
+    const ssize_t len = readlink(dest_file.c_str(), target.data(),
+                                 target.size());
+    return len == ssize_t(entry.symlink.size()) &&
+           entry.symlink.compare(0, std::string::npos, target.data(),
+                                 size_t(len)) == 0;
+  }
+  if (S_ISCHR(entry.mode) || S_ISBLK(entry.mode)) {
+    return dest_stat.st_rdev == entry.rdev;
+  }
+  return true;
+}
+
+bool SquashfsExtractor::isSameFile(const FileTask& task) const {
+  const int fd = open(task.dest_file.c_str(),
+                      O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  const bool same = task.reader->sameContent(task.entry, fd);
+  close(fd);
+  return same;
+}
+
+void SquashfsExtractor::keepFile(const FileTask& task) {
+  this->applyMetadata(task.reader, task.entry, task.dest_file);
+  if (journal_ != nullptr) {
+    journal_->append(JournalKey(task.layer, task.entry));
+  }
+  ++unchanged_files_;
+  this->verifyPath(task.layer, task.entry.path);
+  this->updateProgress(task.entry.file_size);
+}
+
+bool SquashfsExtractor::isExtracted(int layer, const SquashfsEntry& entry,
+                                    const std::string& dest_file) const {
+  if (!journal_->contains(JournalKey(layer, entry))) {
+    return false;
+  }
+  // Modification time is updated after content is written.
+  struct stat dest_stat;
+  return lstat(dest_file.c_str(), &dest_stat) == 0 &&
+         S_ISREG(dest_stat.st_mode) &&
+         uint64_t(dest_stat.st_size) == entry.file_size &&
+         dest_stat.st_mtime == time_t(entry.mtime);
+}
+
+bool SquashfsExtractor::createFile(FileTask& task) {
+  const char* dest_file = task.dest_file.c_str();
+  RemoveDestFile(dest_file);
+  task.fd = open(dest_file, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (task.fd == -1) {
+    fprintf(stderr, "SquashfsExtractor failed to create %s: %s\n",
+            dest_file, strerror(errno));
+    return false;
+  }
+  // Sparse blocks and skipped zero blocks are left as holes.
+  if (ftruncate(task.fd, off_t(task.entry.file_size)) != 0) {
+    fprintf(stderr, "SquashfsExtractor failed to truncate %s: %s\n",
+            dest_file, strerror(errno));
+    close(task.fd);
+    task.fd = -1;
+    return false;
+  }
+  return true;
+}
+
+void SquashfsExtractor::extractFile(const std::shared_ptr<FileTask>& task) {
+  if (task->check_content && this->isSameFile(*task)) {
+    this->keepFile(*task);
+    return;
+  }
+  if (!this->createFile(*task)) {
+    failed_ = true;
+    return;
+  }
+  task->remaining_chunks = 1;
+  this->extractChunk(task, 0, task->entry.block_list.size());
+}
+
+void SquashfsExtractor::extractChunk(const std::shared_ptr<FileTask>& task,
+                                     size_t first_block, size_t last_block) {
+  if (!task->reader->readFileRange(task->entry, first_block, last_block,
+                                   task->fd, options_.skip_zero_blocks)) {
+    // Skip read error, squashfs file might have some defects. Same as
+    // sendfile() error in mount mode.
+    fprintf(stderr, "SquashfsExtractor skip %s\n", task->dest_file.c_str());
+    task->read_failed = true;
+  }
+
+  // Content size of this chunk, including fragment tail of last chunk.
+  const uint64_t block_size = task->reader->blockSize();
+  const uint64_t chunk_start = first_block * block_size;
+  uint64_t chunk_bytes = 0;
+  if (last_block == task->entry.block_list.size()) {
+    chunk_bytes = task->entry.file_size - chunk_start;
+  } else {
+    chunk_bytes = (last_block - first_block) * block_size;
+  }
+  if (throttle_ != nullptr) {
+    throttle_->addRange(task->fd, off_t(chunk_start), size_t(chunk_bytes));
+  }
+
+  if (--task->remaining_chunks == 0) {
+    if (throttle_ != nullptr) {
+      throttle_->finishFile(task->fd);
+    }
+    close(task->fd);
+    task->fd = -1;
+    this->applyMetadata(task->reader, task->entry, task->dest_file);
+    if (journal_ != nullptr && !task->read_failed) {
+      journal_->append(JournalKey(task->layer, task->entry));
+    }
+    this->verifyPath(task->layer, task->entry.path);
+    this->updateProgress(chunk_bytes);
+  } else if (progress_ != nullptr) {
+    progress_->addBytes(chunk_bytes);
+  }
+}
+
+void SquashfsExtractor::applyMetadata(SquashfsReader* reader,
+                                      const SquashfsEntry& entry,
+                                      const std::string& dest_file) {
+  const char* dest = dest_file.c_str();
+  // In update mode, metadata of existing file is compared with |entry|.
+  struct stat dest_stat;
+  const bool compare = options_.update && lstat(dest, &dest_stat) == 0;
+  const bool same_owner = compare && dest_stat.st_uid == entry.uid &&
+                          dest_stat.st_gid == entry.gid;
+  // Update ownership first, or chmod() might ignore SUID/SGID or sticky flag.
+  if (!same_owner && lchown(dest, entry.uid, entry.gid) != 0) {
+    fprintf(stderr, "SquashfsExtractor lchown() failed: %s, %s\n",
+            dest, strerror(errno));
+  }
+  const bool same_mode = same_owner &&
+      (dest_stat.st_mode & 07777) == (entry.mode & 07777);
+  if (!S_ISLNK(entry.mode) && !same_mode) {
+    if (chmod(dest, entry.mode & 07777) != 0) {
+      fprintf(stderr, "SquashfsExtractor chmod() failed: %s, %s\n",
+              dest, strerror(errno));
+    }
+  }
+
+  if (entry.xattr != kSquashfsNoXAttr) {
+    XAttrList xattrs;
+    if (!reader->readXAttrs(entry, xattrs)) {
+      fprintf(stderr, "SquashfsExtractor failed to read xattrs: %s\n", dest);
+    }
+    for (const XAttr& xattr : xattrs) {
+      if (merger_ && LayerMerger::IsOverlayXAttr(xattr.first)) {
+        continue;
+      }
+      if (compare && HasXAttr(dest, xattr)) {
+        continue;
+      }
+      if (lsetxattr(dest, xattr.first.c_str(), xattr.second.data(),
+                    xattr.second.size(), 0) != 0) {
+        // Do not exit when failed to copy file capacities.
+        fprintf(stderr, "SquashfsExtractor lsetxattr() failed: %s, %s, %s\n",
+                dest, xattr.first.c_str(), strerror(errno));
+      }
+    }
+  }
+
+  if (compare && dest_stat.st_mtim.tv_sec == time_t(entry.mtime) &&
+      dest_stat.st_mtim.tv_nsec == 0) {
+    return;
+  }
+  const struct timespec times[2] = {
+      { time_t(entry.mtime), 0 },
+      { time_t(entry.mtime), 0 },
+  };
+  if (utimensat(AT_FDCWD, dest, times, AT_SYMLINK_NOFOLLOW) != 0) {
+    fprintf(stderr, "SquashfsExtractor utimensat() failed: %s, %s\n",
+            dest, strerror(errno));
+  }
+}
+
+void SquashfsExtractor::updateProgress(uint64_t bytes) {
+  if (progress_ != nullptr) {
+    progress_->addInode(bytes);
+  }
+}
+
+void SquashfsExtractor::verifyPath(int layer, const std::string& path) {
+  if (verifier_ != nullptr) {
+    verifier_->submit(layer, path);
+  }
+}
+
+std::string SquashfsExtractor::destPath(const SquashfsEntry& entry) const {
+  if (entry.path.empty()) {
+    return options_.dest_dir;
+  }
+  return options_.dest_dir + "/" + entry.path;
+}
+
+// static
+std::string SquashfsExtractor::JournalKey(int layer,
+                                          const SquashfsEntry& entry) {
+  return std::to_string(layer) + ":" + std::to_string(entry.inode_number);
+}
+
+}  // namespace installer
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_SQUASHFS_EXTRACTOR_H
+#define INSTALLER_UNSQUASHFS_SQUASHFS_EXTRACTOR_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "unsquashfs/squashfs_reader.h"
+
+namespace installer {
+
+class DeviceQueues;
+class ExtractJournal;
+class ExtractProgress;
+class LayerMerger;
+class ManifestVerifier;
+class WritebackThrottle;
+
+struct ExtractOptions {
+  // Absolute path to target folder.
+  std::string dest_dir;
+
+  // Number of threads to extract regular files.
+  int jobs = 1;
+
+  // Do not write data blocks full of zero, leaving holes in target files.
+  // Sparse blocks in image are always kept as holes.
+  bool skip_zero_blocks = false;
+
+  // Extract regular files in order of their data blocks in image, instead
+  // of tree walking order, so that image is read sequentially. This is much
+  // faster on optical discs and slow USB sticks. Folders are still created
+  // before files in them, and hard links are created after all files.
+  bool media_order = false;
+
+  // In media order mode, keep this many bytes of image after current file
+  // in page cache with readahead. 0 disables readahead.
+  uint64_t readahead_window = 0;
+
+  // Keep existing files in target folder which are identical to entries in
+  // image, and update only their metadata differing from image. Regular
+  // files are compared by size and modification time, or by content if
+  // |update_checksum| is true.
+  bool update = false;
+  bool update_checksum = false;
+};
+
+// Extract squashfs image read by SquashfsReader into target folder.
+// Folders, symbolic links and special files are created in tree walking
+// thread, in which folders are always created before their children.
+// Regular files are extracted in worker threads, large files are split into
+// chunks so that their data blocks are decompressed in parallel too.
+// If target folders are on different disks, each disk has its own worker
+// threads, see DeviceQueues.
+// Metadata of folders is applied after all files are extracted.
+// Regular files with more than one link are extracted only once, and their
+// other paths are created as hard links.
+// More images can be stacked over the first one with addLayer(), their
+// precedence and whiteouts are resolved by LayerMerger before extraction, so
+// that each file in target folder is written only once.
+// Completely extracted regular files are recorded in ExtractJournal if it is
+// set. Files recorded in journal by previous extraction are skipped if their
+// size and modification time in target folder are not changed.
+// If ManifestVerifier is set, each file is submitted to it once its content
+// and metadata are written.
+// In update mode, files already identical in target folder are not written
+// again, which saves most disk writes when reinstalling over an existing
+// system.
+class SquashfsExtractor {
+ public:
+  SquashfsExtractor(SquashfsReader& reader, const ExtractOptions& options);
+  ~SquashfsExtractor();
+
+  SquashfsExtractor(const SquashfsExtractor&) = delete;
+  SquashfsExtractor& operator=(const SquashfsExtractor&) = delete;
+
+  // Report extracted bytes to |progress|, which shall be alive during
+  // extraction. Its total size shall be set before calling extract().
+  void setProgress(ExtractProgress* progress) { progress_ = progress; }
+
+  // Limit dirty pages of extracted files with |throttle|, which shall be
+  // alive during extraction.
+  void setThrottle(WritebackThrottle* throttle) { throttle_ = throttle; }
+
+  // Record extracted files in |journal|, and skip files already recorded in
+  // it. |journal| shall be alive during extraction.
+  void setJournal(ExtractJournal* journal) { journal_ = journal; }
+
+  // Verify extracted files with |verifier|, which shall be alive during
+  // extraction. ManifestVerifier::finish() is not called by extractor.
+  void setVerifier(ManifestVerifier* verifier) { verifier_ = verifier; }
+
+  // Stack |reader| over previous images. It shall be alive during
+  // extraction.
+  void addLayer(SquashfsReader& reader) { layers_.push_back(&reader); }
+
+  // Extract all files. Returns false if any file failed to be created.
+  bool extract();
+
+  // Number of regular files kept unchanged in update mode.
+  uint64_t unchangedFiles() const { return unchanged_files_; }
+
+ private:
+  struct FileTask;
+
+  // Hard link collected in media order mode.
+  struct HardLink {
+    int layer;
+    // Relative path in image.
+    std::string path;
+    std::string target;
+    std::string dest_file;
+  };
+
+  // Tree walk handler of |layer|.
+  bool handleEntry(int layer, SquashfsEntry& entry);
+
+  // Create folder at |dest_file|, replacing existing non-folder file.
+  bool createDir(const std::string& dest_file);
+
+  // Create |dest_file| as hard link of |target|, which is extracted before.
+  bool createHardLink(const std::string& target,
+                      const std::string& dest_file);
+
+  // Create symbolic link, device file, fifo or socket.
+  bool createSpecialFile(const SquashfsEntry& entry,
+                         const std::string& dest_file);
+
+  // Returns true if symbolic link or special file |dest_file| is the same as
+  // |entry| except metadata.
+  bool isSameSpecialFile(const SquashfsEntry& entry,
+                         const std::string& dest_file) const;
+
+  // Returns true if content of |dest_file| of |task| equals to its entry.
+  bool isSameFile(const FileTask& task) const;
+
+  // Keep existing regular file of |task| in update mode, only updating its
+  // metadata.
+  void keepFile(const FileTask& task);
+
+  // Returns true if regular file |entry| in |layer| is recorded in journal,
+  // and |dest_file| is not changed since then.
+  bool isExtracted(int layer, const SquashfsEntry& entry,
+                   const std::string& dest_file) const;
+
+  // Extract regular file of |task| in worker threads, or in current thread
+  // if no worker thread is used.
+  bool submitFile(const std::shared_ptr<FileTask>& task);
+
+  // Extract regular files collected in media order mode, sorted by position
+  // of their data blocks in image.
+  bool submitPendingFiles();
+
+  // Create regular file of |task| and set its size, without content.
+  bool createFile(FileTask& task);
+
+  // Create regular file and write its content.
+  void extractFile(const std::shared_ptr<FileTask>& task);
+
+  // Write a chunk of blocks in |task|, close file if all chunks are written.
+  void extractChunk(const std::shared_ptr<FileTask>& task, size_t first_block,
+                    size_t last_block);
+
+  // Update ownership, permissions, xattrs and modification time. Xattrs are
+  // read from |reader|. In update mode, metadata not changed is not written.
+  void applyMetadata(SquashfsReader* reader, const SquashfsEntry& entry,
+                     const std::string& dest_file);
+
+  // Mark one inode with |bytes| of content as extracted.
+  void updateProgress(uint64_t bytes);
+
+  // Submit extracted |path| in |layer| to verifier.
+  void verifyPath(int layer, const std::string& path);
+
+  std::string destPath(const SquashfsEntry& entry) const;
+
+  // Key of regular file |entry| in |layer| in journal.
+  static std::string JournalKey(int layer, const SquashfsEntry& entry);
+
+  // Stacked images, from bottom to top.
+  std::vector<SquashfsReader*> layers_;
+  std::unique_ptr<LayerMerger> merger_;
+  ExtractOptions options_;
+  ExtractProgress* progress_;
+  WritebackThrottle* throttle_;
+  ExtractJournal* journal_;
+  ManifestVerifier* verifier_;
+  std::unique_ptr<DeviceQueues> queues_;
+
+  // Maps relative path of folders to their devices in target, used to select
+  // writer queue of files in them.
+  std::unordered_map<std::string, dev_t> dir_devices_;
+
+  // Folders whose metadata is applied after all files are extracted, with
+  // their layer index.
+  std::vector<std::pair<int, SquashfsEntry>> dir_entries_;
+
+  // Maps inode number of regular files with hard links to the first path
+  // extracted, in current layer. Only accessed in tree walking thread.
+  std::unordered_map<uint32_t, std::string> hard_links_;
+
+  // Regular files of current layer and hard links to be created, collected
+  // in media order mode.
+  std::vector<std::shared_ptr<FileTask>> pending_files_;
+  std::vector<HardLink> pending_links_;
+
+  // Hard links created before content of their targets is written, and
+  // their layer index. They are verified after all files are extracted.
+  std::vector<std::pair<int, std::string>> unverified_links_;
+
+  std::atomic<bool> failed_;
+  std::atomic<uint64_t> unchanged_files_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_SQUASHFS_EXTRACTOR_H
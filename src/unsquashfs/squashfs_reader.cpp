@@ -0,0 +1,985 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/squashfs_reader.h"
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#include <algorithm>
+
+namespace installer {
+
+namespace {
+
+const uint32_t kSquashfsMagic = 0x73717368;  // "hsqs"
+const size_t kSuperBlockSize = 96;
+const uint16_t kSquashfsMajor = 4;
+
+// Uncompressed size of metadata block.
+const size_t kMetadataSize = 8192;
+// Metadata block is stored uncompressed if this bit is set in its header.
+const uint16_t kMetadataUncompressed = 1 << 15;
+// Data block or fragment block is stored uncompressed if this bit is set.
+const uint32_t kDataUncompressed = 1 << 24;
+// Unused table position.
+const uint64_t kInvalidTable = 0xFFFFFFFFFFFFFFFFULL;
+
+const uint32_t kMinBlockSize = 4 * 1024;
+const uint32_t kMaxBlockSize = 1024 * 1024;
+
+// Prefixes of extended attribute names.
+const uint16_t kXAttrValueOutOfLine = 0x100;
+const uint16_t kXAttrPrefixMask = 0xFF;
+const char* const kXAttrPrefixes[] = { "user.", "trusted.", "security." };
+
+// Inode types.
+const uint16_t kDirType = 1;
+const uint16_t kRegType = 2;
+const uint16_t kSymlinkType = 3;
+const uint16_t kBlkDevType = 4;
+const uint16_t kChrDevType = 5;
+const uint16_t kFifoType = 6;
+const uint16_t kSocketType = 7;
+const uint16_t kLDirType = 8;
+const uint16_t kLRegType = 9;
+const uint16_t kLSymlinkType = 10;
+const uint16_t kLBlkDevType = 11;
+const uint16_t kLChrDevType = 12;
+const uint16_t kLFifoType = 13;
+const uint16_t kLSocketType = 14;
+
+// Size of "." and ".." entries counted in file_size of folder inode.
+const uint32_t kDirSizeOffset = 3;
+
+// Maximum number of cached metadata blocks, about 32MB.
+const size_t kMaxMetadataBlocks = 4096;
+// Memory used by fragment cache, 16MB.
+const size_t kFragmentCacheBytes = 16 * 1024 * 1024;
+const size_t kMinFragmentCacheSize = 4;
+
+inline uint16_t GetLE16(const char* buf) {
+  uint16_t val;
+  memcpy(&val, buf, sizeof(val));
+  return le16toh(val);
+}
+
+inline uint32_t GetLE32(const char* buf) {
+  uint32_t val;
+  memcpy(&val, buf, sizeof(val));
+  return le32toh(val);
+}
+
+inline uint64_t GetLE64(const char* buf) {
+  uint64_t val;
+  memcpy(&val, buf, sizeof(val));
+  return le64toh(val);
+}
+
+// Write |len| bytes in |buf| into |fd| at |offset|.
+bool WriteAll(int fd, const char* buf, size_t len, off_t offset) {
+  while (len > 0) {
+    const ssize_t num_written = pwrite(fd, buf, len, offset);
+    if (num_written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    buf += num_written;
+    len -= size_t(num_written);
+    offset += num_written;
+  }
+  return true;
+}
+
+// Returns true if all of |len| bytes in |buf| are zero.
+bool IsZeroBlock(const char* buf, size_t len) {
+  return (len == 0) || (buf[0] == 0 && memcmp(buf, buf + 1, len - 1) == 0);
+}
+
+}  // namespace
+
+// Read continuous bytes from metadata blocks.
+class SquashfsReader::MetadataCursor {
+ public:
+  MetadataCursor(SquashfsReader* reader, uint64_t pos, uint32_t offset)
+      : reader_(reader),
+        pos_(pos),
+        offset_(offset) {
+  }
+
+  // Read |len| bytes into |buf|. If |buf| is nullptr, just skip them.
+  bool read(void* buf, size_t len) {
+    char* out = static_cast<char*>(buf);
+    while (len > 0) {
+      if (!block_) {
+        block_ = reader_->readMetadataBlock(pos_);
+        if (!block_) {
+          return false;
+        }
+      }
+      const size_t size = block_->data.size();
+      if (offset_ >= size) {
+        if (offset_ > size) {
+          fprintf(stderr, "MetadataCursor invalid offset: %zu\n", offset_);
+          return false;
+        }
+        // Move to next block.
+        pos_ = block_->next;
+        offset_ = 0;
+        block_.reset();
+        continue;
+      }
+      const size_t num = std::min(len, size - offset_);
+      if (out != nullptr) {
+        memcpy(out, block_->data.data() + offset_, num);
+        out += num;
+      }
+      offset_ += num;
+      len -= num;
+    }
+    return true;
+  }
+
+  // Returns true if all bytes before absolute position |end| are read.
+  bool atEnd(uint64_t end) const {
+    if (block_) {
+      return block_->next >= end && offset_ >= block_->data.size();
+    }
+    return pos_ >= end;
+  }
+
+  bool readU32(uint32_t& val) {
+    char buf[4];
+    if (!this->read(buf, sizeof(buf))) {
+      return false;
+    }
+    val = GetLE32(buf);
+    return true;
+  }
+
+ private:
+  SquashfsReader* reader_;
+  uint64_t pos_;
+  size_t offset_;
+  MetadataBlockPtr block_;
+};
+
+SquashfsReader::SquashfsReader()
+    : fd_(-1),
+      compression_(CompressionType::Gzip),
+      block_size_(0),
+      inode_count_(0),
+      root_inode_(0),
+      inode_table_start_(0),
+      directory_table_start_(0),
+      xattr_table_start_(0),
+      fragment_cache_size_(kMinFragmentCacheSize),
+      drop_cache_(false) {
+}
+
+SquashfsReader::~SquashfsReader() {
+  if (fd_ != -1) {
+    close(fd_);
+  }
+}
+
+bool SquashfsReader::open(const std::string& image) {
+  char sb[kSuperBlockSize];
+  if (!this->readSuperBlock(image, sb)) {
+    return false;
+  }
+
+  inode_count_ = GetLE32(sb + 4);
+  block_size_ = GetLE32(sb + 12);
+  const uint32_t fragment_count = GetLE32(sb + 16);
+  compression_ = static_cast<CompressionType>(GetLE16(sb + 20));
+  const uint16_t block_log = GetLE16(sb + 22);
+  const uint16_t id_count = GetLE16(sb + 26);
+  root_inode_ = GetLE64(sb + 32);
+  const uint64_t id_table_start = GetLE64(sb + 48);
+  const uint64_t xattr_id_table_start = GetLE64(sb + 56);
+  inode_table_start_ = GetLE64(sb + 64);
+  directory_table_start_ = GetLE64(sb + 72);
+  const uint64_t fragment_table_start = GetLE64(sb + 80);
+
+  if (block_size_ < kMinBlockSize || block_size_ > kMaxBlockSize ||
+      block_log > 31 || block_size_ != (1U << block_log)) {
+    fprintf(stderr, "SquashfsReader invalid block size: %u\n", block_size_);
+    return false;
+  }
+
+  if (!Decompressor::Create(compression_)) {
+    fprintf(stderr, "SquashfsReader unsupported compression: %s\n",
+            Decompressor::GetName(compression_));
+    return false;
+  }
+
+  // Read uid/gid table.
+  std::vector<char> table;
+  if (!this->readLookupTable(id_table_start, id_count, 4, table)) {
+    fprintf(stderr, "SquashfsReader failed to read id table\n");
+    return false;
+  }
+  ids_.resize(id_count);
+  for (size_t i = 0; i < ids_.size(); ++i) {
+    ids_[i] = GetLE32(table.data() + i * 4);
+  }
+
+  // Read fragment table.
+  if (fragment_count > 0 && fragment_table_start != kInvalidTable) {
+    if (!this->readLookupTable(fragment_table_start, fragment_count, 16,
+                               table)) {
+      fprintf(stderr, "SquashfsReader failed to read fragment table\n");
+      return false;
+    }
+    fragments_.resize(fragment_count);
+    for (size_t i = 0; i < fragments_.size(); ++i) {
+      fragments_[i].start = GetLE64(table.data() + i * 16);
+      fragments_[i].size = GetLE32(table.data() + i * 16 + 8);
+    }
+  }
+
+  // Read xattr id table.
+  if (xattr_id_table_start != kInvalidTable) {
+    char header[16];
+    if (!this->readAt(xattr_id_table_start, header, sizeof(header))) {
+      fprintf(stderr, "SquashfsReader failed to read xattr table\n");
+      return false;
+    }
+    xattr_table_start_ = GetLE64(header);
+    const uint32_t xattr_id_count = GetLE32(header + 8);
+    if (!this->readLookupTable(xattr_id_table_start + sizeof(header),
+                               xattr_id_count, 16, table)) {
+      fprintf(stderr, "SquashfsReader failed to read xattr id table\n");
+      return false;
+    }
+    xattr_ids_.resize(xattr_id_count);
+    for (size_t i = 0; i < xattr_ids_.size(); ++i) {
+      xattr_ids_[i].ref = GetLE64(table.data() + i * 16);
+      xattr_ids_[i].count = GetLE32(table.data() + i * 16 + 8);
+    }
+  }
+
+  fragment_cache_size_ = std::max(kMinFragmentCacheSize,
+                                  kFragmentCacheBytes / block_size_);
+
+  return true;
+}
+
+bool SquashfsReader::ReadInodeCount(const std::string& image,
+                                    uint32_t& count) {
+  SquashfsReader reader;
+  char sb[kSuperBlockSize];
+  if (!reader.readSuperBlock(image, sb)) {
+    return false;
+  }
+  count = GetLE32(sb + 4);
+  return true;
+}
+
+bool SquashfsReader::scanInodes(uint64_t& inodes, uint64_t& bytes) {
+  inodes = 0;
+  bytes = 0;
+  MetadataCursor cursor(this, inode_table_start_, 0);
+  uint32_t dir_block, dir_offset, dir_size;
+  while (!cursor.atEnd(directory_table_start_)) {
+    SquashfsEntry entry;
+    if (!this->parseInode(cursor, true, entry, dir_block, dir_offset,
+                          dir_size)) {
+      fprintf(stderr, "SquashfsReader failed to scan inode table\n");
+      return false;
+    }
+    inodes ++;
+    if (S_ISREG(entry.mode)) {
+      bytes += entry.file_size;
+    }
+  }
+  return true;
+}
+
+bool SquashfsReader::walk(const Visitor& visitor) {
+  SquashfsEntry root;
+  uint32_t dir_block, dir_offset, dir_size;
+  if (!this->readInode(root_inode_ >> 16, root_inode_ & 0xFFFF, root,
+                       dir_block, dir_offset, dir_size)) {
+    fprintf(stderr, "SquashfsReader failed to read root inode\n");
+    return false;
+  }
+  if (!S_ISDIR(root.mode)) {
+    fprintf(stderr, "SquashfsReader root inode is not a folder\n");
+    return false;
+  }
+  if (!visitor(root)) {
+    return false;
+  }
+  return this->walkDir(root.path, dir_block, dir_offset, dir_size, visitor);
+}
+
+bool SquashfsReader::readFile(const SquashfsEntry& entry, int fd) {
+  if (ftruncate(fd, off_t(entry.file_size)) != 0) {
+    fprintf(stderr, "SquashfsReader failed to truncate %s: %s\n",
+            entry.path.c_str(), strerror(errno));
+    return false;
+  }
+  return this->readFileRange(entry, 0, entry.block_list.size(), fd, false);
+}
+
+bool SquashfsReader::dataRange(const SquashfsEntry& entry, uint64_t& start,
+                               uint64_t& end) const {
+  start = entry.start_block;
+  end = start;
+  for (uint32_t block : entry.block_list) {
+    end += block & ~kDataUncompressed;
+  }
+  if (end > start) {
+    return true;
+  }
+  if (entry.fragment != kSquashfsNoFragment &&
+      entry.fragment < fragments_.size()) {
+    const Fragment& fragment = fragments_[entry.fragment];
+    start = fragment.start;
+    end = start + (fragment.size & ~kDataUncompressed);
+    return true;
+  }
+  return false;
+}
+
+void SquashfsReader::readAhead(uint64_t pos, uint64_t len) {
+  posix_fadvise(fd_, off_t(pos), off_t(len), POSIX_FADV_WILLNEED);
+}
+
+bool SquashfsReader::readFileRange(const SquashfsEntry& entry,
+                                   size_t first_block,
+                                   size_t last_block,
+                                   int fd,
+                                   bool skip_zero_blocks) {
+  return this->readBlocks(entry, first_block, last_block,
+      [&](const char* data, size_t len, uint64_t offset) {
+    if (data == nullptr) {
+      // Sparse block, leave a hole in |fd|.
+      return true;
+    }
+    if (skip_zero_blocks && IsZeroBlock(data, len)) {
+      return true;
+    }
+    if (!WriteAll(fd, data, len, off_t(offset))) {
+      fprintf(stderr, "SquashfsReader failed to write %s: %s\n",
+              entry.path.c_str(), strerror(errno));
+      return false;
+    }
+    return true;
+  });
+}
+
+bool SquashfsReader::sameContent(const SquashfsEntry& entry, int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || uint64_t(st.st_size) != entry.file_size) {
+    return false;
+  }
+  thread_local std::vector<char> file_buf;
+  file_buf.resize(block_size_);
+  return this->readBlocks(entry, 0, entry.block_list.size(),
+      [&](const char* data, size_t len, uint64_t offset) {
+    if (pread(fd, file_buf.data(), len, off_t(offset)) != ssize_t(len)) {
+      return false;
+    }
+    if (data == nullptr) {
+      return IsZeroBlock(file_buf.data(), len);
+    }
+    return memcmp(data, file_buf.data(), len) == 0;
+  });
+}
+
+bool SquashfsReader::readBlocks(const SquashfsEntry& entry,
+                                size_t first_block,
+                                size_t last_block,
+                                const BlockHandler& handler) {
+  // Buffers are reused in each thread.
+  thread_local std::vector<char> raw_buf;
+  thread_local std::vector<char> data_buf;
+  raw_buf.resize(block_size_);
+  data_buf.resize(block_size_);
+
+  last_block = std::min(last_block, entry.block_list.size());
+  uint64_t pos = entry.start_block;
+  for (size_t i = 0; i < first_block && i < last_block; ++i) {
+    pos += entry.block_list[i] & ~kDataUncompressed;
+  }
+  const uint64_t first_pos = pos;
+
+  for (size_t i = first_block; i < last_block; ++i) {
+    const uint32_t size = entry.block_list[i] & ~kDataUncompressed;
+    const uint64_t offset = uint64_t(i) * block_size_;
+    const size_t len = size_t(std::min(uint64_t(block_size_),
+                                       entry.file_size - offset));
+    const char* data = nullptr;
+    if (size != 0) {
+      if (size > block_size_ || !this->readAt(pos, raw_buf.data(), size)) {
+        fprintf(stderr, "SquashfsReader failed to read block %zu of %s\n",
+                i, entry.path.c_str());
+        return false;
+      }
+      long num;
+      if (entry.block_list[i] & kDataUncompressed) {
+        data = raw_buf.data();
+        num = size;
+      } else {
+        data = data_buf.data();
+        num = this->decompress(raw_buf.data(), size,
+                               data_buf.data(), block_size_);
+      }
+      if (num != long(len)) {
+        fprintf(stderr, "SquashfsReader corrupted block %zu of %s\n",
+                i, entry.path.c_str());
+        return false;
+      }
+    }
+    pos += size;
+    if (!handler(data, len, offset)) {
+      return false;
+    }
+  }
+
+  if (drop_cache_ && pos > first_pos) {
+    posix_fadvise(fd_, off_t(first_pos), off_t(pos - first_pos),
+                  POSIX_FADV_DONTNEED);
+  }
+
+  if (last_block == entry.block_list.size() &&
+      entry.fragment != kSquashfsNoFragment) {
+    const uint64_t offset = uint64_t(last_block) * block_size_;
+    const size_t len = size_t(entry.file_size - offset);
+    std::shared_ptr<const std::vector<char>> fragment =
+        this->readFragment(entry.fragment);
+    if (!fragment || entry.fragment_offset + len > fragment->size()) {
+      fprintf(stderr, "SquashfsReader failed to read fragment of %s\n",
+              entry.path.c_str());
+      return false;
+    }
+    if (!handler(fragment->data() + entry.fragment_offset, len, offset)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool SquashfsReader::readXAttrs(const SquashfsEntry& entry,
+                                XAttrList& xattrs) {
+  xattrs.clear();
+  if (entry.xattr == kSquashfsNoXAttr) {
+    return true;
+  }
+  if (entry.xattr >= xattr_ids_.size()) {
+    fprintf(stderr, "SquashfsReader invalid xattr index: %u\n", entry.xattr);
+    return false;
+  }
+
+  const XAttrId& xattr_id = xattr_ids_[entry.xattr];
+  MetadataCursor cursor(this, xattr_table_start_ + (xattr_id.ref >> 16),
+                        xattr_id.ref & 0xFFFF);
+  for (uint32_t i = 0; i < xattr_id.count; ++i) {
+    char header[4];
+    if (!cursor.read(header, sizeof(header))) {
+      return false;
+    }
+    const uint16_t type = GetLE16(header);
+    const uint16_t name_size = GetLE16(header + 2);
+    const uint16_t prefix = type & kXAttrPrefixMask;
+    if (prefix >= sizeof(kXAttrPrefixes) / sizeof(kXAttrPrefixes[0])) {
+      fprintf(stderr, "SquashfsReader unknown xattr type: %u\n", type);
+      return false;
+    }
+    std::string name(name_size, '\0');
+    if (!cursor.read(&name[0], name_size)) {
+      return false;
+    }
+    name.insert(0, kXAttrPrefixes[prefix]);
+
+    uint32_t value_size;
+    if (!cursor.readU32(value_size)) {
+      return false;
+    }
+    std::string value;
+    if (type & kXAttrValueOutOfLine) {
+      // Value is stored in another place, shared by multiple inodes.
+      char ref_buf[8];
+      if (!cursor.read(ref_buf, sizeof(ref_buf))) {
+        return false;
+      }
+      const uint64_t ref = GetLE64(ref_buf);
+      MetadataCursor value_cursor(this, xattr_table_start_ + (ref >> 16),
+                                  ref & 0xFFFF);
+      if (!value_cursor.readU32(value_size)) {
+        return false;
+      }
+      value.resize(value_size);
+      if (!value_cursor.read(&value[0], value_size)) {
+        return false;
+      }
+    } else {
+      value.resize(value_size);
+      if (!cursor.read(&value[0], value_size)) {
+        return false;
+      }
+    }
+    xattrs.emplace_back(name, value);
+  }
+
+  return true;
+}
+
+SquashfsReader::MetadataBlockPtr SquashfsReader::readMetadataBlock(
+    uint64_t pos) {
+  {
+    std::lock_guard<std::mutex> lock(metadata_mutex_);
+    auto iter = metadata_blocks_.find(pos);
+    if (iter != metadata_blocks_.end()) {
+      return iter->second;
+    }
+  }
+
+  char header[2];
+  if (!this->readAt(pos, header, sizeof(header))) {
+    fprintf(stderr, "SquashfsReader failed to read metadata at %lu\n",
+            (unsigned long)pos);
+    return nullptr;
+  }
+  const uint16_t size = GetLE16(header) & ~kMetadataUncompressed;
+  if (size == 0 || size > kMetadataSize) {
+    fprintf(stderr, "SquashfsReader invalid metadata size at %lu\n",
+            (unsigned long)pos);
+    return nullptr;
+  }
+  std::vector<char> raw(size);
+  if (!this->readAt(pos + sizeof(header), raw.data(), size)) {
+    return nullptr;
+  }
+
+  std::shared_ptr<MetadataBlock> block = std::make_shared<MetadataBlock>();
+  if (GetLE16(header) & kMetadataUncompressed) {
+    block->data.swap(raw);
+  } else {
+    block->data.resize(kMetadataSize);
+    const long num = this->decompress(raw.data(), size, block->data.data(),
+                                      kMetadataSize);
+    if (num < 0) {
+      fprintf(stderr, "SquashfsReader failed to decompress metadata at %lu\n",
+              (unsigned long)pos);
+      return nullptr;
+    }
+    block->data.resize(size_t(num));
+  }
+  block->next = pos + sizeof(header) + size;
+
+  std::lock_guard<std::mutex> lock(metadata_mutex_);
+  if (metadata_blocks_.size() >= kMaxMetadataBlocks) {
+    metadata_blocks_.clear();
+  }
+  metadata_blocks_[pos] = block;
+  return block;
+}
+
+bool SquashfsReader::readSuperBlock(const std::string& image, char* sb) {
+  fd_ = ::open(image.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ == -1) {
+    fprintf(stderr, "SquashfsReader failed to open %s: %s\n",
+            image.c_str(), strerror(errno));
+    return false;
+  }
+
+  if (!this->readAt(0, sb, kSuperBlockSize)) {
+    fprintf(stderr, "SquashfsReader failed to read superblock\n");
+    return false;
+  }
+  if (GetLE32(sb) != kSquashfsMagic) {
+    fprintf(stderr, "SquashfsReader invalid magic number: %s\n",
+            image.c_str());
+    return false;
+  }
+  const uint16_t major = GetLE16(sb + 28);
+  if (major != kSquashfsMajor) {
+    fprintf(stderr, "SquashfsReader unsupported version: %u\n", major);
+    return false;
+  }
+  return true;
+}
+
+bool SquashfsReader::readAt(uint64_t pos, void* buf, size_t len) {
+  char* out = static_cast<char*>(buf);
+  while (len > 0) {
+    const ssize_t num_read = pread(fd_, out, len, off_t(pos));
+    if (num_read < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    if (num_read == 0) {
+      // Unexpected end of file.
+      return false;
+    }
+    out += num_read;
+    pos += uint64_t(num_read);
+    len -= size_t(num_read);
+  }
+  return true;
+}
+
+long SquashfsReader::decompress(const char* src, size_t src_len, char* dest,
+                                size_t dest_len) {
+  // Each thread keeps its own decompressor objects.
+  const int kMaxCompressionType = int(CompressionType::Zstd);
+  thread_local std::unique_ptr<Decompressor>
+      decompressors[kMaxCompressionType + 1];
+  const int type = int(compression_);
+  if (type < 0 || type > kMaxCompressionType) {
+    return -1;
+  }
+  std::unique_ptr<Decompressor>& decompressor = decompressors[type];
+  if (!decompressor) {
+    decompressor = Decompressor::Create(compression_);
+    if (!decompressor) {
+      return -1;
+    }
+  }
+  return decompressor->decompress(src, src_len, dest, dest_len);
+}
+
+bool SquashfsReader::readInode(uint64_t block, uint32_t offset,
+                               SquashfsEntry& entry,
+                               uint32_t& dir_block, uint32_t& dir_offset,
+                               uint32_t& dir_size) {
+  MetadataCursor cursor(this, inode_table_start_ + block, offset);
+  return this->parseInode(cursor, false, entry, dir_block, dir_offset,
+                          dir_size);
+}
+
+bool SquashfsReader::parseInode(MetadataCursor& cursor, bool skip_index,
+                                SquashfsEntry& entry, uint32_t& dir_block,
+                                uint32_t& dir_offset, uint32_t& dir_size) {
+  char header[16];
+  if (!cursor.read(header, sizeof(header))) {
+    return false;
+  }
+  const uint16_t type = GetLE16(header);
+  const uint16_t uid_index = GetLE16(header + 4);
+  const uint16_t gid_index = GetLE16(header + 6);
+  if (uid_index >= ids_.size() || gid_index >= ids_.size()) {
+    fprintf(stderr, "SquashfsReader invalid uid/gid index\n");
+    return false;
+  }
+  entry.mode = GetLE16(header + 2) & 07777;
+  entry.uid = ids_[uid_index];
+  entry.gid = ids_[gid_index];
+  entry.mtime = GetLE32(header + 8);
+  entry.inode_number = GetLE32(header + 12);
+
+  char buf[40];
+  switch (type) {
+    case kDirType: {
+      if (!cursor.read(buf, 16)) {
+        return false;
+      }
+      entry.mode |= S_IFDIR;
+      dir_block = GetLE32(buf);
+      entry.nlink = GetLE32(buf + 4);
+      dir_size = GetLE16(buf + 8);
+      dir_offset = GetLE16(buf + 10);
+      break;
+    }
+    case kLDirType: {
+      // Directory index entries following this inode are only used in
+      // sequential scanning.
+      if (!cursor.read(buf, 24)) {
+        return false;
+      }
+      entry.mode |= S_IFDIR;
+      entry.nlink = GetLE32(buf);
+      dir_size = GetLE32(buf + 4);
+      dir_block = GetLE32(buf + 8);
+      dir_offset = GetLE16(buf + 18);
+      entry.xattr = GetLE32(buf + 20);
+      if (skip_index) {
+        const uint16_t index_count = GetLE16(buf + 16);
+        for (uint16_t i = 0; i < index_count; ++i) {
+          // index, start_block, size of name, and name.
+          char index[12];
+          if (!cursor.read(index, sizeof(index)) ||
+              !cursor.read(nullptr, size_t(GetLE32(index + 8)) + 1)) {
+            return false;
+          }
+        }
+      }
+      break;
+    }
+    case kRegType:
+    case kLRegType: {
+      entry.mode |= S_IFREG;
+      if (type == kRegType) {
+        if (!cursor.read(buf, 16)) {
+          return false;
+        }
+        entry.start_block = GetLE32(buf);
+        entry.fragment = GetLE32(buf + 4);
+        entry.fragment_offset = GetLE32(buf + 8);
+        entry.file_size = GetLE32(buf + 12);
+      } else {
+        if (!cursor.read(buf, 40)) {
+          return false;
+        }
+        entry.start_block = GetLE64(buf);
+        entry.file_size = GetLE64(buf + 8);
+        entry.nlink = GetLE32(buf + 24);
+        entry.fragment = GetLE32(buf + 28);
+        entry.fragment_offset = GetLE32(buf + 32);
+        entry.xattr = GetLE32(buf + 36);
+      }
+      uint64_t num_blocks = entry.file_size / block_size_;
+      if (entry.fragment == kSquashfsNoFragment &&
+          entry.file_size % block_size_ != 0) {
+        num_blocks ++;
+      }
+      entry.block_list.resize(size_t(num_blocks));
+      for (size_t i = 0; i < entry.block_list.size(); ++i) {
+        if (!cursor.readU32(entry.block_list[i])) {
+          return false;
+        }
+      }
+      break;
+    }
+    case kSymlinkType:
+    case kLSymlinkType: {
+      if (!cursor.read(buf, 8)) {
+        return false;
+      }
+      entry.mode |= S_IFLNK;
+      entry.nlink = GetLE32(buf);
+      const uint32_t target_size = GetLE32(buf + 4);
+      if (target_size == 0 || target_size >= PATH_MAX) {
+        fprintf(stderr, "SquashfsReader invalid symlink size: %u\n",
+                target_size);
+        return false;
+      }
+      entry.symlink.resize(target_size);
+      if (!cursor.read(&entry.symlink[0], target_size)) {
+        return false;
+      }
+      if (type == kLSymlinkType && !cursor.readU32(entry.xattr)) {
+        return false;
+      }
+      break;
+    }
+    case kBlkDevType:
+    case kChrDevType:
+    case kLBlkDevType:
+    case kLChrDevType: {
+      if (!cursor.read(buf, 8)) {
+        return false;
+      }
+      const bool is_blk = (type == kBlkDevType || type == kLBlkDevType);
+      entry.mode |= is_blk ? S_IFBLK : S_IFCHR;
+      entry.nlink = GetLE32(buf);
+      // Device number is encoded in the same way as new_encode_dev(),
+      // major in bits 8-19, minor in bits 0-7 and 20-31.
+      const uint32_t rdev = GetLE32(buf + 4);
+      entry.rdev = makedev((rdev >> 8) & 0xFFF,
+                           (rdev & 0xFF) | ((rdev >> 12) & 0xFFF00));
+      if ((type == kLBlkDevType || type == kLChrDevType) &&
+          !cursor.readU32(entry.xattr)) {
+        return false;
+      }
+      break;
+    }
+    case kFifoType:
+    case kSocketType:
+    case kLFifoType:
+    case kLSocketType: {
+      if (!cursor.readU32(entry.nlink)) {
+        return false;
+      }
+      const bool is_fifo = (type == kFifoType || type == kLFifoType);
+      entry.mode |= is_fifo ? S_IFIFO : S_IFSOCK;
+      if ((type == kLFifoType || type == kLSocketType) &&
+          !cursor.readU32(entry.xattr)) {
+        return false;
+      }
+      break;
+    }
+    default: {
+      fprintf(stderr, "SquashfsReader unknown inode type: %u\n", type);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool SquashfsReader::walkDir(const std::string& path, uint32_t dir_block,
+                             uint32_t dir_offset, uint32_t dir_size,
+                             const Visitor& visitor) {
+  if (dir_size <= kDirSizeOffset) {
+    // Empty folder.
+    return true;
+  }
+  size_t remaining = dir_size - kDirSizeOffset;
+  MetadataCursor cursor(this, directory_table_start_ + dir_block, dir_offset);
+  char header[12];
+  char buf[8];
+  char name[256];
+  while (remaining > 0) {
+    if (remaining < sizeof(header) || !cursor.read(header, sizeof(header))) {
+      fprintf(stderr, "SquashfsReader failed to read folder: %s\n",
+              path.c_str());
+      return false;
+    }
+    remaining -= sizeof(header);
+    const uint32_t count = GetLE32(header) + 1;
+    const uint32_t inode_block = GetLE32(header + 4);
+
+    for (uint32_t i = 0; i < count; ++i) {
+      if (remaining < sizeof(buf) || !cursor.read(buf, sizeof(buf))) {
+        fprintf(stderr, "SquashfsReader failed to read folder: %s\n",
+                path.c_str());
+        return false;
+      }
+      const uint16_t inode_offset = GetLE16(buf);
+      const size_t name_size = size_t(GetLE16(buf + 6)) + 1;
+      if (name_size >= sizeof(name) ||
+          remaining < sizeof(buf) + name_size ||
+          !cursor.read(name, name_size)) {
+        fprintf(stderr, "SquashfsReader invalid entry in folder: %s\n",
+                path.c_str());
+        return false;
+      }
+      remaining -= sizeof(buf) + name_size;
+      name[name_size] = '\0';
+      if (strchr(name, '/') != nullptr || strlen(name) != name_size ||
+          strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        fprintf(stderr, "SquashfsReader invalid filename in folder: %s\n",
+                path.c_str());
+        return false;
+      }
+
+      SquashfsEntry entry;
+      uint32_t child_block = 0, child_offset = 0, child_size = 0;
+      if (!this->readInode(inode_block, inode_offset, entry,
+                           child_block, child_offset, child_size)) {
+        fprintf(stderr, "SquashfsReader failed to read inode: %s/%s\n",
+                path.c_str(), name);
+        return false;
+      }
+      entry.path = path.empty() ? name : path + "/" + name;
+      if (!visitor(entry)) {
+        return false;
+      }
+      if (S_ISDIR(entry.mode)) {
+        if (!this->walkDir(entry.path, child_block, child_offset,
+                           child_size, visitor)) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool SquashfsReader::readLookupTable(uint64_t index_pos, size_t count,
+                                     size_t item_size,
+                                     std::vector<char>& table) {
+  const size_t total = count * item_size;
+  const size_t num_blocks = (total + kMetadataSize - 1) / kMetadataSize;
+  table.resize(total);
+  if (total == 0) {
+    return true;
+  }
+  std::vector<char> index(num_blocks * 8);
+  if (!this->readAt(index_pos, index.data(), index.size())) {
+    return false;
+  }
+  size_t done = 0;
+  for (size_t i = 0; i < num_blocks; ++i) {
+    MetadataCursor cursor(this, GetLE64(index.data() + i * 8), 0);
+    const size_t num = std::min(kMetadataSize, total - done);
+    if (!cursor.read(table.data() + done, num)) {
+      return false;
+    }
+    done += num;
+  }
+  return true;
+}
+
+std::shared_ptr<const std::vector<char>> SquashfsReader::readFragment(
+    uint32_t index) {
+  {
+    std::lock_guard<std::mutex> lock(fragment_mutex_);
+    for (auto iter = fragment_cache_.begin(); iter != fragment_cache_.end();
+         ++iter) {
+      if (iter->first == index) {
+        return iter->second;
+      }
+    }
+  }
+
+  if (index >= fragments_.size()) {
+    fprintf(stderr, "SquashfsReader invalid fragment index: %u\n", index);
+    return nullptr;
+  }
+  const Fragment& fragment = fragments_[index];
+  const uint32_t size = fragment.size & ~kDataUncompressed;
+  if (size == 0 || size > block_size_) {
+    fprintf(stderr, "SquashfsReader invalid fragment size: %u\n", size);
+    return nullptr;
+  }
+  std::vector<char> raw(size);
+  if (!this->readAt(fragment.start, raw.data(), size)) {
+    return nullptr;
+  }
+  std::shared_ptr<std::vector<char>> data =
+      std::make_shared<std::vector<char>>();
+  if (fragment.size & kDataUncompressed) {
+    data->swap(raw);
+  } else {
+    data->resize(block_size_);
+    const long num = this->decompress(raw.data(), size, data->data(),
+                                      block_size_);
+    if (num < 0) {
+      fprintf(stderr, "SquashfsReader failed to decompress fragment: %u\n",
+              index);
+      return nullptr;
+    }
+    data->resize(size_t(num));
+  }
+
+  std::lock_guard<std::mutex> lock(fragment_mutex_);
+  // Most recently used fragment is placed at front.
+  fragment_cache_.emplace(fragment_cache_.begin(), index, data);
+  if (fragment_cache_.size() > fragment_cache_size_) {
+    fragment_cache_.pop_back();
+  }
+  return data;
+}
+
+}  // namespace installer
@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_SQUASHFS_READER_H
+#define INSTALLER_UNSQUASHFS_SQUASHFS_READER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "unsquashfs/decompressor.h"
+
+namespace installer {
+
+// An extended attribute, name and value.
+typedef std::pair<std::string, std::string> XAttr;
+typedef std::vector<XAttr> XAttrList;
+
+// Value of |fragment| if file has no fragment tail.
+const uint32_t kSquashfsNoFragment = 0xFFFFFFFF;
+// Value of |xattr| if inode has no extended attributes.
+const uint32_t kSquashfsNoXAttr = 0xFFFFFFFF;
+
+// An inode in squashfs image and its relative path.
+struct SquashfsEntry {
+  // Relative path in image, without leading slash. Empty for root folder.
+  std::string path;
+
+  // File type and permissions, like st_mode in struct stat.
+  mode_t mode = 0;
+  uid_t uid = 0;
+  gid_t gid = 0;
+  uint32_t mtime = 0;
+  uint32_t inode_number = 0;
+  uint32_t nlink = 1;
+
+  // Regular file content.
+  uint64_t file_size = 0;
+  // Absolute position of first data block in image.
+  uint64_t start_block = 0;
+  uint32_t fragment = kSquashfsNoFragment;
+  uint32_t fragment_offset = 0;
+  // Size of each data block on disk.
+  std::vector<uint32_t> block_list;
+
+  // Device number of character and block device.
+  dev_t rdev = 0;
+
+  // Target of symbolic link.
+  std::string symlink;
+
+  // Index of extended attributes.
+  uint32_t xattr = kSquashfsNoXAttr;
+};
+
+// Read squashfs 4.0 image directly, without mounting it.
+// Metadata (inode table, directory table) are parsed in walk() in caller's
+// thread, while data blocks can be read in multiple threads at the same time.
+class SquashfsReader {
+ public:
+  SquashfsReader();
+  ~SquashfsReader();
+
+  SquashfsReader(const SquashfsReader&) = delete;
+  SquashfsReader& operator=(const SquashfsReader&) = delete;
+
+  // Open squashfs image at |image|, parse its superblock and lookup tables.
+  // Returns false if |image| is not a valid squashfs image or its
+  // compression algorithm is not supported.
+  bool open(const std::string& image);
+
+  // Read number of inodes in |image| from its superblock only. This works
+  // even if compression algorithm of |image| is not supported.
+  static bool ReadInodeCount(const std::string& image, uint32_t& count);
+
+  // Size of data block in bytes.
+  uint32_t blockSize() const { return block_size_; }
+  CompressionType compression() const { return compression_; }
+
+  // Number of inodes in image, read from superblock.
+  uint32_t inodeCount() const { return inode_count_; }
+
+  // Parse whole inode table sequentially, and count |inodes| in image and
+  // |bytes| of all regular files. Hard links are counted once.
+  bool scanInodes(uint64_t& inodes, uint64_t& bytes);
+
+  // Walk through whole file tree, folders are visited before their children.
+  // Stops walking and returns false if |visitor| returns false.
+  typedef std::function<bool(SquashfsEntry& entry)> Visitor;
+  bool walk(const Visitor& visitor);
+
+  // Write content of regular file |entry| into |fd|, and set file size of
+  // |fd|. Sparse blocks are kept as holes.
+  // This method is thread safe.
+  bool readFile(const SquashfsEntry& entry, int fd);
+
+  // Write data blocks in range [first_block, last_block) of |entry| into
+  // |fd| at their offsets. If |last_block| is the number of blocks,
+  // fragment tail is written too. This method is thread safe.
+  // Sparse blocks are not written, so |fd| shall be an empty file truncated
+  // to size of |entry|. If |skip_zero_blocks| is true, blocks full of zero
+  // are not written either.
+  bool readFileRange(const SquashfsEntry& entry, size_t first_block,
+                     size_t last_block, int fd, bool skip_zero_blocks);
+
+  // Returns true if content of opened file |fd| equals to content of regular
+  // file |entry|, without writing anything. This method is thread safe.
+  bool sameContent(const SquashfsEntry& entry, int fd);
+
+  // If |drop_cache| is true, data blocks read by readFileRange() are dropped
+  // from page cache, as they are never read again.
+  void setDropCache(bool drop_cache) { drop_cache_ = drop_cache; }
+
+  // Get position range [start, end) of data blocks of regular file |entry|
+  // in image, or of its fragment block if it has no data block. Returns false
+  // if |entry| has no content stored in image.
+  bool dataRange(const SquashfsEntry& entry, uint64_t& start,
+                 uint64_t& end) const;
+
+  // Ask kernel to read |len| bytes of image at |pos| into page cache
+  // asynchronously.
+  void readAhead(uint64_t pos, uint64_t len);
+
+  // Read extended attributes of |entry|. This method is thread safe.
+  bool readXAttrs(const SquashfsEntry& entry, XAttrList& xattrs);
+
+ private:
+  struct MetadataBlock {
+    std::vector<char> data;
+    // Absolute position of next metadata block in image.
+    uint64_t next = 0;
+  };
+  typedef std::shared_ptr<const MetadataBlock> MetadataBlockPtr;
+
+  struct Fragment {
+    uint64_t start = 0;
+    uint32_t size = 0;
+  };
+
+  struct XAttrId {
+    uint64_t ref = 0;
+    uint32_t count = 0;
+  };
+
+  class MetadataCursor;
+
+  // Read metadata block at absolute position |pos|.
+  MetadataBlockPtr readMetadataBlock(uint64_t pos);
+
+  // Handles decompressed content of a block at |offset| of file. |data| is
+  // null for sparse block. Returns false to stop reading.
+  typedef std::function<bool(const char* data, size_t len, uint64_t offset)>
+      BlockHandler;
+
+  // Read data blocks in range [first_block, last_block) of |entry| and pass
+  // them to |handler|, with fragment tail if |last_block| is the number of
+  // blocks.
+  bool readBlocks(const SquashfsEntry& entry, size_t first_block,
+                  size_t last_block, const BlockHandler& handler);
+
+  // Read |len| bytes at absolute position |pos|.
+  bool readAt(uint64_t pos, void* buf, size_t len);
+
+  // Decompress |src| with decompressor of current thread.
+  long decompress(const char* src, size_t src_len, char* dest,
+                  size_t dest_len);
+
+  // Open |image| and read its superblock into |sb|, checking magic number
+  // and version.
+  bool readSuperBlock(const std::string& image, char* sb);
+
+  // Read an inode at |block| (relative to inode table) with |offset|.
+  bool readInode(uint64_t block, uint32_t offset, SquashfsEntry& entry,
+                 uint32_t& dir_block, uint32_t& dir_offset,
+                 uint32_t& dir_size);
+
+  // Parse an inode at current position of |cursor|. If |skip_index| is
+  // true, index entries of extended folder inode are skipped too.
+  bool parseInode(MetadataCursor& cursor, bool skip_index,
+                  SquashfsEntry& entry, uint32_t& dir_block,
+                  uint32_t& dir_offset, uint32_t& dir_size);
+
+  // Walk through folder at |dir_block| of directory table.
+  bool walkDir(const std::string& path, uint32_t dir_block,
+               uint32_t dir_offset, uint32_t dir_size,
+               const Visitor& visitor);
+
+  // Read a lookup table (id table, fragment table, etc.) of |count| items
+  // of |item_size| bytes, whose index is located at |index_pos|.
+  bool readLookupTable(uint64_t index_pos, size_t count, size_t item_size,
+                       std::vector<char>& table);
+
+  // Get decompressed fragment block at |index|.
+  std::shared_ptr<const std::vector<char>> readFragment(uint32_t index);
+
+  int fd_;
+  CompressionType compression_;
+  uint32_t block_size_;
+  uint32_t inode_count_;
+  uint64_t root_inode_;
+  uint64_t inode_table_start_;
+  uint64_t directory_table_start_;
+  uint64_t xattr_table_start_;
+
+  std::vector<uint32_t> ids_;
+  std::vector<Fragment> fragments_;
+  std::vector<XAttrId> xattr_ids_;
+
+  // Cache of decompressed metadata blocks, protected by |metadata_mutex_|.
+  std::mutex metadata_mutex_;
+  std::map<uint64_t, MetadataBlockPtr> metadata_blocks_;
+
+  // Recently used fragment blocks, protected by |fragment_mutex_|.
+  std::mutex fragment_mutex_;
+  std::vector<std::pair<uint32_t, std::shared_ptr<const std::vector<char>>>>
+      fragment_cache_;
+  size_t fragment_cache_size_;
+
+  bool drop_cache_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_SQUASHFS_READER_H
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/squashfs_reader.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+#include <map>
+
+#include "third_party/googletest/include/gtest/gtest.h"
+
+namespace installer {
+namespace {
+
+// Generated by testdata/generate_test_image.py.
+const char kTestImage[] = UNSQUASHFS_TESTDATA_DIR "/test.squashfs";
+const char kTestFile[] = "/tmp/installer-squashfs-reader-test";
+
+// Content of regular files in test image.
+std::string RegularContent() {
+  std::string content(5000, '\0');
+  for (size_t i = 0; i < content.size(); ++i) {
+    content[i] = char(i % 251);
+  }
+  return content;
+}
+
+std::string SparseContent() {
+  std::string content(4096, '\0');
+  for (size_t i = 0; i < content.size(); ++i) {
+    content[i] = char((i * 7) % 256);
+  }
+  content.append(4096, '\0');
+  for (int i = 0; i < 452; ++i) {
+    content.append("tail");
+  }
+  return content;
+}
+
+// Returns all entries in |reader|, indexed by path.
+std::map<std::string, SquashfsEntry> ReadEntries(SquashfsReader& reader) {
+  std::map<std::string, SquashfsEntry> entries;
+  EXPECT_TRUE(reader.walk([&](SquashfsEntry& entry) {
+    entries[entry.path] = entry;
+    return true;
+  }));
+  return entries;
+}
+
+// Extract |entry| to kTestFile, and returns its content.
+std::string ExtractFile(SquashfsReader& reader, const SquashfsEntry& entry) {
+  const int fd = open(kTestFile, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  EXPECT_NE(fd, -1);
+  EXPECT_TRUE(reader.readFile(entry, fd));
+  EXPECT_TRUE(reader.sameContent(entry, fd));
+  std::string content(entry.file_size, '\0');
+  EXPECT_EQ(pread(fd, &content[0], content.size(), 0),
+            ssize_t(content.size()));
+  close(fd);
+  unlink(kTestFile);
+  return content;
+}
+
+TEST(SquashfsReaderTest, Open) {
+  SquashfsReader reader;
+  ASSERT_TRUE(reader.open(kTestImage));
+  EXPECT_EQ(reader.blockSize(), 4096u);
+  EXPECT_EQ(reader.compression(), CompressionType::Gzip);
+  EXPECT_EQ(reader.inodeCount(), 9u);
+
+  uint32_t count = 0;
+  EXPECT_TRUE(SquashfsReader::ReadInodeCount(kTestImage, count));
+  EXPECT_EQ(count, 9u);
+
+  uint64_t inodes, bytes;
+  ASSERT_TRUE(reader.scanInodes(inodes, bytes));
+  EXPECT_EQ(inodes, 9u);
+  EXPECT_EQ(bytes, 5000u + 6u + 10000u);
+
+  SquashfsReader invalid_reader;
+  EXPECT_FALSE(invalid_reader.open(UNSQUASHFS_TESTDATA_DIR
+                                   "/generate_test_image.py"));
+}
+
+TEST(SquashfsReaderTest, Walk) {
+  SquashfsReader reader;
+  ASSERT_TRUE(reader.open(kTestImage));
+  std::vector<std::string> paths;
+  ASSERT_TRUE(reader.walk([&](SquashfsEntry& entry) {
+    paths.push_back(entry.path);
+    return true;
+  }));
+  const std::vector<std::string> expected_paths = {
+      "", "dir", "dir/blk", "dir/fifo", "dir/null", "hardlink", "regular",
+      "small", "sparse", "symlink",
+  };
+  EXPECT_EQ(paths, expected_paths);
+
+  // Stops walking if visitor returns false.
+  size_t num_visited = 0;
+  EXPECT_FALSE(reader.walk([&](SquashfsEntry&) {
+    return ++num_visited < 3;
+  }));
+  EXPECT_EQ(num_visited, 3u);
+}
+
+TEST(SquashfsReaderTest, SpecialFiles) {
+  SquashfsReader reader;
+  ASSERT_TRUE(reader.open(kTestImage));
+  std::map<std::string, SquashfsEntry> entries = ReadEntries(reader);
+
+  const SquashfsEntry& root = entries[""];
+  EXPECT_EQ(root.mode, mode_t(S_IFDIR | 0755));
+  EXPECT_EQ(root.nlink, 3u);
+  EXPECT_EQ(root.mtime, 1514764800u);
+
+  const SquashfsEntry& symlink = entries["symlink"];
+  EXPECT_EQ(symlink.mode, mode_t(S_IFLNK | 0777));
+  EXPECT_EQ(symlink.symlink, "regular");
+
+  // Major and minor numbers beyond 8 bits.
+  const SquashfsEntry& blk = entries["dir/blk"];
+  EXPECT_EQ(blk.mode, mode_t(S_IFBLK | 0660));
+  EXPECT_EQ(blk.gid, 1000u);
+  EXPECT_EQ(major(blk.rdev), 259u);
+  EXPECT_EQ(minor(blk.rdev), 300u);
+
+  const SquashfsEntry& null = entries["dir/null"];
+  EXPECT_EQ(null.mode, mode_t(S_IFCHR | 0666));
+  EXPECT_EQ(null.rdev, makedev(1, 3));
+
+  EXPECT_EQ(entries["dir/fifo"].mode, mode_t(S_IFIFO | 0644));
+}
+
+TEST(SquashfsReaderTest, HardLink) {
+  SquashfsReader reader;
+  ASSERT_TRUE(reader.open(kTestImage));
+  std::map<std::string, SquashfsEntry> entries = ReadEntries(reader);
+
+  const SquashfsEntry& regular = entries["regular"];
+  const SquashfsEntry& hardlink = entries["hardlink"];
+  EXPECT_EQ(regular.inode_number, hardlink.inode_number);
+  EXPECT_EQ(regular.nlink, 2u);
+  EXPECT_EQ(hardlink.nlink, 2u);
+  EXPECT_EQ(regular.start_block, hardlink.start_block);
+  EXPECT_NE(regular.inode_number, entries["small"].inode_number);
+}
+
+TEST(SquashfsReaderTest, ReadFile) {
+  SquashfsReader reader;
+  ASSERT_TRUE(reader.open(kTestImage));
+  std::map<std::string, SquashfsEntry> entries = ReadEntries(reader);
+
+  // One compressed block and a fragment tail.
+  const SquashfsEntry& regular = entries["regular"];
+  EXPECT_EQ(regular.mode, mode_t(S_IFREG | 0644));
+  EXPECT_EQ(regular.uid, 1000u);
+  EXPECT_EQ(regular.block_list.size(), 1u);
+  EXPECT_NE(regular.fragment, kSquashfsNoFragment);
+  EXPECT_EQ(ExtractFile(reader, regular), RegularContent());
+
+  // Fragment only, shares fragment block with regular.
+  const SquashfsEntry& small = entries["small"];
+  EXPECT_TRUE(small.block_list.empty());
+  EXPECT_EQ(small.fragment, regular.fragment);
+  EXPECT_EQ(ExtractFile(reader, small), "hello\n");
+  uint64_t start, end;
+  ASSERT_TRUE(reader.dataRange(small, start, end));
+  EXPECT_LT(start, end);
+
+  // Uncompressed block, hole, and a partial block without fragment.
+  const SquashfsEntry& sparse = entries["sparse"];
+  ASSERT_EQ(sparse.block_list.size(), 3u);
+  EXPECT_EQ(sparse.block_list[1], 0u);
+  EXPECT_EQ(sparse.fragment, kSquashfsNoFragment);
+  EXPECT_EQ(ExtractFile(reader, sparse), SparseContent());
+
+  // Only the second half of sparse.
+  const int fd = open(kTestFile, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  ASSERT_NE(fd, -1);
+  ASSERT_EQ(ftruncate(fd, off_t(sparse.file_size)), 0);
+  EXPECT_TRUE(reader.readFileRange(sparse, 1, 3, fd, true));
+  std::string content(sparse.file_size, '\0');
+  EXPECT_EQ(pread(fd, &content[0], content.size(), 0),
+            ssize_t(content.size()));
+  EXPECT_EQ(content.substr(0, 4096), std::string(4096, '\0'));
+  EXPECT_EQ(content.substr(4096), SparseContent().substr(4096));
+  EXPECT_FALSE(reader.sameContent(sparse, fd));
+  close(fd);
+  unlink(kTestFile);
+}
+
+TEST(SquashfsReaderTest, ReadXAttrs) {
+  SquashfsReader reader;
+  ASSERT_TRUE(reader.open(kTestImage));
+  std::map<std::string, SquashfsEntry> entries = ReadEntries(reader);
+
+  // Value of security.selinux is stored out of line.
+  XAttrList xattrs;
+  ASSERT_TRUE(reader.readXAttrs(entries["regular"], xattrs));
+  const XAttrList expected_xattrs = {
+      {"user.comment", "regular file"},
+      {"security.selinux", "system_u:object_r:bin_t:s0"},
+  };
+  EXPECT_EQ(xattrs, expected_xattrs);
+
+  ASSERT_TRUE(reader.readXAttrs(entries["dir"], xattrs));
+  ASSERT_EQ(xattrs.size(), 1u);
+  EXPECT_EQ(xattrs[0].first, "trusted.overlay.opaque");
+  EXPECT_EQ(xattrs[0].second, "y");
+
+  ASSERT_TRUE(reader.readXAttrs(entries["small"], xattrs));
+  EXPECT_TRUE(xattrs.empty());
+
+  SquashfsEntry invalid = entries["regular"];
+  invalid.xattr = 2;
+  EXPECT_FALSE(reader.readXAttrs(invalid, xattrs));
+}
+
+}  // namespace
+}  // namespace installer
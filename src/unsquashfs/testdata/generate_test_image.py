@@ -0,0 +1,317 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+# Generate test.squashfs used in squashfs_reader_test.cpp.
+# squashfs-tools is not required to build this project, so the image is
+# written byte by byte here and committed, gzip compressed, 4KiB blocks.
+#
+# Content of image:
+#   regular      5000 bytes, one data block and a fragment tail,
+#                nlink 2, xattrs user.comment and security.selinux
+#   hardlink     hard link of regular
+#   small        "hello\n", in the same fragment block
+#   sparse       10000 bytes, middle block is a hole
+#   symlink      -> regular
+#   dir/         trusted.overlay.opaque=y
+#   dir/blk      block device 259:300
+#   dir/null     character device 1:3
+#   dir/fifo     named pipe
+
+import struct
+import sys
+import zlib
+
+BLOCK_SIZE = 4096
+BLOCK_LOG = 12
+METADATA_SIZE = 8192
+MTIME = 1514764800
+GZIP = 1
+NO_FRAGMENT = 0xFFFFFFFF
+NO_XATTR = 0xFFFFFFFF
+INVALID_TABLE = 0xFFFFFFFFFFFFFFFF
+METADATA_UNCOMPRESSED = 1 << 15
+DATA_UNCOMPRESSED = 1 << 24
+
+DIR_TYPE = 1
+REG_TYPE = 2
+SYMLINK_TYPE = 3
+BLKDEV_TYPE = 4
+CHRDEV_TYPE = 5
+FIFO_TYPE = 6
+LDIR_TYPE = 8
+LREG_TYPE = 9
+
+XATTR_USER = 0
+XATTR_TRUSTED = 1
+XATTR_SECURITY = 2
+XATTR_VALUE_OUT_OF_LINE = 0x100
+
+# Uid/gid table.
+IDS = [0, 1000]
+
+REGULAR = bytes(i % 251 for i in range(5000))
+SMALL = b"hello\n"
+SPARSE_HEAD = bytes((i * 7) % 256 for i in range(BLOCK_SIZE))
+SPARSE_TAIL = b"tail" * 452
+SPARSE = SPARSE_HEAD + bytes(BLOCK_SIZE) + SPARSE_TAIL
+
+
+def new_encode_dev(major, minor):
+    return (minor & 0xFF) | (major << 8) | ((minor & ~0xFF) << 12)
+
+
+class MetadataWriter(object):
+    """Write metadata blocks, and keep reference of each record."""
+
+    def __init__(self):
+        self.blocks = bytearray()
+        self.pending = bytearray()
+
+    def ref(self):
+        """Returns (block, offset) of next record."""
+        return len(self.blocks), len(self.pending)
+
+    def write(self, data):
+        self.pending += data
+        while len(self.pending) >= METADATA_SIZE:
+            self.flush_block(self.pending[:METADATA_SIZE])
+            self.pending = self.pending[METADATA_SIZE:]
+
+    def flush_block(self, data):
+        compressed = zlib.compress(bytes(data), 9)
+        if len(compressed) < len(data):
+            self.blocks += struct.pack("<H", len(compressed)) + compressed
+        else:
+            self.blocks += struct.pack("<H", len(data) | METADATA_UNCOMPRESSED)
+            self.blocks += data
+
+    def finish(self):
+        if self.pending:
+            self.flush_block(self.pending)
+            self.pending = bytearray()
+        return bytes(self.blocks)
+
+
+def inode_header(inode_type, mode, inode_number, uid=0, gid=0):
+    return struct.pack("<HHHHII", inode_type, mode, uid, gid, MTIME,
+                       inode_number)
+
+
+def main(output):
+    image = bytearray(96)
+
+    # Data blocks, first block of regular is compressed, first block of
+    # sparse is stored uncompressed.
+    regular_start = len(image)
+    block = zlib.compress(REGULAR[:BLOCK_SIZE], 9)
+    image += block
+    regular_blocks = [len(block)]
+
+    sparse_start = len(image)
+    image += SPARSE_HEAD
+    sparse_blocks = [len(SPARSE_HEAD) | DATA_UNCOMPRESSED, 0]
+    block = zlib.compress(SPARSE_TAIL, 9)
+    image += block
+    sparse_blocks.append(len(block))
+
+    # Fragment block shared by tail of regular and small.
+    fragment = REGULAR[BLOCK_SIZE:] + SMALL
+    regular_fragment_offset = 0
+    small_fragment_offset = len(REGULAR) - BLOCK_SIZE
+    fragment_start = len(image)
+    block = zlib.compress(fragment, 9)
+    image += block
+    fragments = [(fragment_start, len(block))]
+
+    # Extended attributes, value of security.selinux is stored out of line.
+    xattr_kv = MetadataWriter()
+    selinux_ref = xattr_kv.ref()
+    value = b"system_u:object_r:bin_t:s0"
+    xattr_kv.write(struct.pack("<I", len(value)) + value)
+    xattr_ids = []
+
+    ref = xattr_kv.ref()
+    name = b"comment"
+    value = b"regular file"
+    data = struct.pack("<HH", XATTR_USER, len(name)) + name
+    data += struct.pack("<I", len(value)) + value
+    name = b"selinux"
+    data += struct.pack("<HH", XATTR_SECURITY | XATTR_VALUE_OUT_OF_LINE,
+                        len(name)) + name
+    data += struct.pack("<IQ", 8, (selinux_ref[0] << 16) | selinux_ref[1])
+    xattr_kv.write(data)
+    xattr_ids.append(((ref[0] << 16) | ref[1], 2, len(data)))
+
+    ref = xattr_kv.ref()
+    name = b"overlay.opaque"
+    value = b"y"
+    data = struct.pack("<HH", XATTR_TRUSTED, len(name)) + name
+    data += struct.pack("<I", len(value)) + value
+    xattr_kv.write(data)
+    xattr_ids.append(((ref[0] << 16) | ref[1], 1, len(data)))
+
+    # Inodes, children are written before their parent folders, as
+    # mksquashfs does.  Folder inodes need position of their listings,
+    # so directory table is built at the same time.
+    inodes = MetadataWriter()
+    dirs = MetadataWriter()
+    refs = {}
+
+    def add_inode(name, inode_number, inode_type, data):
+        refs[name] = inodes.ref() + (inode_number, inode_type)
+        inodes.write(data)
+
+    def add_listing(names):
+        """Write listing of |names| into directory table, returns
+        (block, offset, size) of it."""
+        block, offset = dirs.ref()
+        data = bytearray()
+        entries = sorted(names, key=lambda item: item[0])
+        inode_block = refs[entries[0][1]][0]
+        base = refs[entries[0][1]][2]
+        data += struct.pack("<III", len(entries) - 1, inode_block, base)
+        for entry_name, key in entries:
+            inode_block_, inode_offset, inode_number, inode_type = refs[key]
+            assert inode_block_ == inode_block
+            # Folder listings only use basic inode types.
+            basic_type = {LDIR_TYPE: DIR_TYPE, LREG_TYPE: REG_TYPE}.get(
+                inode_type, inode_type)
+            data += struct.pack("<HhHH", inode_offset, inode_number - base,
+                                basic_type, len(entry_name) - 1)
+            data += entry_name
+        dirs.write(data)
+        return block, offset, len(data) + 3
+
+    add_inode("dir/blk", 1, BLKDEV_TYPE,
+              inode_header(BLKDEV_TYPE, 0o660, 1, gid=1) +
+              struct.pack("<II", 1, new_encode_dev(259, 300)))
+    add_inode("dir/fifo", 2, FIFO_TYPE,
+              inode_header(FIFO_TYPE, 0o644, 2) + struct.pack("<I", 1))
+    add_inode("dir/null", 3, CHRDEV_TYPE,
+              inode_header(CHRDEV_TYPE, 0o666, 3) +
+              struct.pack("<II", 1, new_encode_dev(1, 3)))
+    block, offset, size = add_listing([(b"blk", "dir/blk"),
+                                       (b"fifo", "dir/fifo"),
+                                       (b"null", "dir/null")])
+    add_inode("dir", 4, LDIR_TYPE,
+              inode_header(LDIR_TYPE, 0o755, 4) +
+              struct.pack("<IIIIHHI", 2, size, block, 9, 0, offset, 1))
+
+    data = inode_header(LREG_TYPE, 0o644, 5, uid=1, gid=1)
+    data += struct.pack("<QQQIIII", regular_start, len(REGULAR), 0, 2, 0,
+                        regular_fragment_offset, 0)
+    data += struct.pack("<%dI" % len(regular_blocks), *regular_blocks)
+    add_inode("regular", 5, LREG_TYPE, data)
+    refs["hardlink"] = refs["regular"]
+
+    add_inode("small", 6, REG_TYPE,
+              inode_header(REG_TYPE, 0o600, 6) +
+              struct.pack("<IIII", 0, 0, small_fragment_offset, len(SMALL)))
+
+    data = inode_header(REG_TYPE, 0o755, 7)
+    data += struct.pack("<IIII", sparse_start, NO_FRAGMENT, 0, len(SPARSE))
+    data += struct.pack("<%dI" % len(sparse_blocks), *sparse_blocks)
+    add_inode("sparse", 7, REG_TYPE, data)
+
+    target = b"regular"
+    add_inode("symlink", 8, SYMLINK_TYPE,
+              inode_header(SYMLINK_TYPE, 0o777, 8) +
+              struct.pack("<II", 1, len(target)) + target)
+
+    block, offset, size = add_listing([(b"dir", "dir"),
+                                       (b"hardlink", "hardlink"),
+                                       (b"regular", "regular"),
+                                       (b"small", "small"),
+                                       (b"sparse", "sparse"),
+                                       (b"symlink", "symlink")])
+    root_ref = inodes.ref()
+    add_inode("", 9, DIR_TYPE,
+              inode_header(DIR_TYPE, 0o755, 9) +
+              struct.pack("<IIHHI", block, 3, size, offset, 10))
+
+    inode_table_start = len(image)
+    image += inodes.finish()
+    directory_table_start = len(image)
+    image += dirs.finish()
+
+    def add_lookup_table(items):
+        """Write |items| in metadata blocks, followed by their index."""
+        table = MetadataWriter()
+        table.write(b"".join(items))
+        blocks_start = len(image)
+        blocks = table.finish()
+        index = []
+        pos = 0
+        while pos < len(blocks):
+            index.append(blocks_start + pos)
+            size = struct.unpack_from("<H", blocks, pos)[0]
+            pos += 2 + (size & ~METADATA_UNCOMPRESSED)
+        image.extend(blocks)
+        index_start = len(image)
+        image.extend(struct.pack("<%dQ" % len(index), *index))
+        return index_start
+
+    fragment_table_start = add_lookup_table(
+        [struct.pack("<QII", start, size, 0) for start, size in fragments])
+    id_table_start = add_lookup_table([struct.pack("<I", i) for i in IDS])
+
+    xattr_table_start = len(image)
+    image += xattr_kv.finish()
+    xattr_id_table = MetadataWriter()
+    xattr_id_table.write(b"".join(struct.pack("<QII", *item)
+                                  for item in xattr_ids))
+    xattr_id_blocks_start = len(image)
+    image += xattr_id_table.finish()
+    xattr_id_table_start = len(image)
+    image += struct.pack("<QII", xattr_table_start, len(xattr_ids), 0)
+    image += struct.pack("<Q", xattr_id_blocks_start)
+
+    bytes_used = len(image)
+    image[0:96] = struct.pack(
+        "<IIIIIHHHHHHQQQQQQQQ",
+        0x73717368,  # magic
+        9,  # inode count
+        MTIME,
+        BLOCK_SIZE,
+        len(fragments),
+        GZIP,
+        BLOCK_LOG,
+        0,  # flags
+        len(IDS),
+        4, 0,  # version
+        (root_ref[0] << 16) | root_ref[1],
+        bytes_used,
+        id_table_start,
+        xattr_id_table_start,
+        inode_table_start,
+        directory_table_start,
+        fragment_table_start,
+        INVALID_TABLE,  # export table
+    )
+    # Image is padded to 4KiB, as mksquashfs does.
+    image += bytes(-len(image) % 4096)
+
+    with open(output, "wb") as fh:
+        fh.write(image)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        print("Usage: %s test.squashfs" % sys.argv[0])
+        sys.exit(1)
+    main(sys.argv[1])
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/work_stealing_pool.h"
+
+namespace installer {
+
+WorkStealingPool::WorkStealingPool(int num_threads, int max_pending)
+    : queued_(0),
+      pending_(0),
+      max_pending_(max_pending > 0 ? max_pending : 1) {
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    workers_.emplace_back(new Worker());
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&WorkStealingPool::run, this, i);
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  this->wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  task_cond_.notify_all();
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+void WorkStealingPool::submit(Task task) {
+  const int index = static_cast<int>(next_worker_ % workers_.size());
+  next_worker_ ++;
+  this->submitTo(index, std::move(task));
+}
+
+void WorkStealingPool::submitTo(int index, Task task) {
+  {
+    // Apply back pressure to submitter.
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cond_.wait(lock, [this]() {
+      return pending_.load() < max_pending_;
+    });
+    pending_ ++;
+  }
+
+  Worker* worker = workers_.at(static_cast<size_t>(index)).get();
+  {
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    worker->tasks.push_back(std::move(task));
+  }
+
+  {
+    // Update counter while holding |mutex_|, or else wake up event of
+    // sleeping worker might be lost.
+    std::lock_guard<std::mutex> lock(mutex_);
+    queued_ ++;
+  }
+  task_cond_.notify_one();
+}
+
+void WorkStealingPool::wait() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cond_.wait(lock, [this]() {
+    return pending_.load() == 0;
+  });
+}
+
+bool WorkStealingPool::popTask(int index, Task& task) {
+  const int num = this->size();
+  for (int i = 0; i < num; ++i) {
+    Worker* worker = workers_.at(static_cast<size_t>((index + i) % num)).get();
+    std::lock_guard<std::mutex> lock(worker->mutex);
+    if (worker->tasks.empty()) {
+      continue;
+    }
+    if (i == 0 && !fifo_) {
+      // Own deque, LIFO.
+      task = std::move(worker->tasks.back());
+      worker->tasks.pop_back();
+    } else {
+      // Steal from the other end of victim deque, or pop in FIFO mode.
+      task = std::move(worker->tasks.front());
+      worker->tasks.pop_front();
+    }
+    queued_ --;
+    return true;
+  }
+  return false;
+}
+
+void WorkStealingPool::run(int index) {
+  Task task;
+  while (true) {
+    if (this->popTask(index, task)) {
+      task(index);
+      task = nullptr;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ --;
+      }
+      done_cond_.notify_all();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    task_cond_.wait(lock, [this]() {
+      return quit_ || queued_.load() > 0;
+    });
+    if (quit_ && queued_.load() == 0) {
+      break;
+    }
+  }
+}
+
+}  // namespace installer
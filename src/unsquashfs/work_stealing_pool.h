@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_WORK_STEALING_POOL_H
+#define INSTALLER_UNSQUASHFS_WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace installer {
+
+// A fixed size thread pool used to copy files in parallel.
+// Each worker owns a task deque. Worker pops tasks from back of its own deque,
+// and steals tasks from front of other deques when its own deque is empty.
+// Tasks are submitted in round-robin order, so that files in the same folder
+// are spread across workers.
+// In FIFO mode, workers pop tasks from front of their own deques too, so that
+// tasks are run roughly in submission order.
+class WorkStealingPool {
+ public:
+  typedef std::function<void(int worker_index)> Task;
+
+  // Spawn |num_threads| worker threads.
+  // Submitting blocks if more than |max_pending| tasks are not finished yet,
+  // this keeps memory usage low when walking a large file tree.
+  WorkStealingPool(int num_threads, int max_pending);
+  ~WorkStealingPool();
+
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  // Number of worker threads.
+  int size() const { return static_cast<int>(workers_.size()); }
+
+  // Enable FIFO mode, shall be called before submitting any task.
+  void setFifo(bool fifo) { fifo_ = fifo; }
+
+  // Append |task| to task queue of next worker.
+  void submit(Task task);
+
+  // Same as submit(), but push |task| into queue of worker at |index|.
+  void submitTo(int index, Task task);
+
+  // Block current thread until all submitted tasks are finished.
+  void wait();
+
+ private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  // Pop a task from own deque at |index|, or steal one from other workers.
+  bool popTask(int index, Task& task);
+
+  // Main loop of worker thread at |index|.
+  void run(int index);
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> threads_;
+
+  // Protects sleeping and waking up of worker threads and submitter.
+  std::mutex mutex_;
+  std::condition_variable task_cond_;
+  std::condition_variable done_cond_;
+
+  // Number of tasks in all deques.
+  std::atomic<int> queued_;
+  // Number of tasks submitted but not finished.
+  std::atomic<int> pending_;
+  const int max_pending_;
+  unsigned int next_worker_ = 0;
+  bool quit_ = false;
+  bool fifo_ = false;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_WORK_STEALING_POOL_H
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "unsquashfs/writeback_throttle.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace installer {
+
+WritebackThrottle::WritebackThrottle(uint64_t budget)
+    : budget_(budget),
+      dirty_bytes_(0),
+      flush_count_(0) {
+}
+
+void WritebackThrottle::addRange(int fd, off_t offset, size_t len) {
+  if (len == 0) {
+    return;
+  }
+
+  // Start writeback without waiting for it.
+  sync_file_range(fd, offset, off_t(len), SYNC_FILE_RANGE_WRITE);
+  const uint64_t flush_count = flush_count_;
+  dirty_bytes_ += int64_t(len);
+
+  // Wait for ranges of the same file added before.
+  std::vector<Range> prev_ranges;
+  {
+    std::lock_guard<std::mutex> lock(ranges_mutex_);
+    std::vector<Range>& ranges = ranges_[fd];
+    prev_ranges.swap(ranges);
+    ranges.push_back({offset, off_t(len), flush_count});
+  }
+  this->waitRanges(fd, prev_ranges);
+
+  if (dirty_bytes_ < int64_t(budget_)) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(flush_mutex_);
+  // Check again, as other thread might have flushed it.
+  if (dirty_bytes_ >= int64_t(budget_)) {
+    syncfs(fd);
+    flush_count_ ++;
+    dirty_bytes_ = 0;
+  }
+}
+
+void WritebackThrottle::finishFile(int fd) {
+  std::vector<Range> ranges;
+  {
+    std::lock_guard<std::mutex> lock(ranges_mutex_);
+    const auto iter = ranges_.find(fd);
+    if (iter != ranges_.end()) {
+      ranges.swap(iter->second);
+      ranges_.erase(iter);
+    }
+  }
+  this->waitRanges(fd, ranges);
+
+  // Starts writeback of remaining dirty pages, and drops clean pages.
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+// static
+void WritebackThrottle::DropCache(int fd, off_t offset, off_t len) {
+  posix_fadvise(fd, offset, len, POSIX_FADV_DONTNEED);
+}
+
+void WritebackThrottle::waitRanges(int fd, const std::vector<Range>& ranges) {
+  for (const Range& range : ranges) {
+    sync_file_range(fd, range.offset, range.len,
+                    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                    SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(fd, range.offset, range.len, POSIX_FADV_DONTNEED);
+    if (range.flush_count == flush_count_) {
+      dirty_bytes_ -= int64_t(range.len);
+    }
+  }
+}
+
+}  // namespace installer
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2017 ~ 2018 Deepin Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTALLER_UNSQUASHFS_WRITEBACK_THROTTLE_H
+#define INSTALLER_UNSQUASHFS_WRITEBACK_THROTTLE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace installer {
+
+// Limits dirty pages in page cache when writing lots of files on low memory
+// machines, so that system does not stall in direct reclaim.
+// Writeback of each written range is started at once. Ranges of the same
+// file form a sliding window, ranges added before are waited for and dropped
+// from page cache when next one is added, and the remaining ones when the
+// file is finished. If more than |budget| bytes are written but not waited
+// for, writers are blocked until dirty pages of target filesystem are
+// flushed.
+// This class is thread safe.
+class WritebackThrottle {
+ public:
+  explicit WritebackThrottle(uint64_t budget);
+
+  WritebackThrottle(const WritebackThrottle&) = delete;
+  WritebackThrottle& operator=(const WritebackThrottle&) = delete;
+
+  uint64_t budget() const { return budget_; }
+
+  // Call after |len| bytes at |offset| of |fd| are written.
+  void addRange(int fd, off_t offset, size_t len);
+
+  // Call before closing |fd| when all of its content is written. Waits for
+  // writeback of ranges not waited for yet.
+  void finishFile(int fd);
+
+  // Drop cached pages of |fd| in range [offset, offset + len), used for
+  // source files which are not read again. If |len| is 0, drop pages to end
+  // of file.
+  static void DropCache(int fd, off_t offset, off_t len);
+
+ private:
+  struct Range {
+    off_t offset;
+    off_t len;
+    // Value of |flush_count_| when this range is added. If target
+    // filesystem is flushed since then, it is no longer counted in
+    // |dirty_bytes_|.
+    uint64_t flush_count;
+  };
+
+  // Wait for writeback of |ranges| of |fd|, and drop them from page cache.
+  void waitRanges(int fd, const std::vector<Range>& ranges);
+
+  const uint64_t budget_;
+
+  // Number of bytes whose writeback is not waited for yet.
+  std::atomic<int64_t> dirty_bytes_;
+
+  // Only one thread flushes dirty pages at a time, others wait for it.
+  std::mutex flush_mutex_;
+  // Number of times target filesystem is flushed.
+  std::atomic<uint64_t> flush_count_;
+
+  // Ranges of each file whose writeback is started but not waited for.
+  // Chunks of a file may be written by several threads, so only ranges
+  // which are already added are waited for.
+  std::mutex ranges_mutex_;
+  std::unordered_map<int, std::vector<Range>> ranges_;
+};
+
+}  // namespace installer
+
+#endif  // INSTALLER_UNSQUASHFS_WRITEBACK_THROTTLE_H
@@ -23,6 +23,8 @@ sudo aptitude install \
     g++ \
     gettext \
     libattr1-dev \
+    liblz4-dev \
+    liblzma-dev \
     libparted-dev \
     libqt5x11extras5-dev \
     libx11-dev \
@@ -36,6 +38,7 @@ sudo aptitude install \
     qtbase5-dev \
     qttools5-dev-tools \
     zlib1g-dev \
+    libzstd-dev \
     btrfs-progs \
     dosfstools \
     e2fsprogs \